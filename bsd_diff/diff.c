@@ -42,6 +42,7 @@ int	 Nflag, Pflag, diff_rflag, Tflag, diff_cflag;
 static int     sflag;
 int	 diff_format, diff_context, status, ignore_file_case;
 int	 tabsize = 8;
+int	 diff_jobs = 1;
 char	*start, *ifdefname, *diffargs, *diff_label[2], *ignore_pats;
 char	*group_format = NULL;
 struct stat stb1, stb2;
@@ -57,6 +58,8 @@ enum {
 	OPT_NORMAL,
 	OPT_HORIZON_LINES,
 	OPT_CHANGED_GROUP_FORMAT,
+	OPT_ALGORITHM,
+	OPT_JOBS,
 };
 
 static struct option longopts[] = {
@@ -93,6 +96,8 @@ static struct option longopts[] = {
 	{ "strip-trailing-cr",		no_argument,		NULL,	OPT_STRIPCR },
 	{ "tabsize",			optional_argument,	NULL,	OPT_TSIZE },
 	{ "changed-group-format",	required_argument,	NULL,	OPT_CHANGED_GROUP_FORMAT},
+	{ "diff-algorithm",		required_argument,	NULL,	OPT_ALGORITHM },
+	{ "jobs",			required_argument,	NULL,	OPT_JOBS },
 	{ NULL,				0,			0,	'\0'}
 };
 
@@ -128,6 +133,7 @@ diff_main(int argc, char **argv)
     status = 0;
     ignore_file_case = 0;
     tabsize = 8;
+    diff_jobs = 1;
     start = NULL;
     ifdefname = NULL;
     diffargs = NULL;
@@ -264,6 +270,25 @@ diff_main(int argc, char **argv)
 		case 'x':
 			push_excludes(optarg);
 			break;
+		case OPT_ALGORITHM:
+			dflags &= ~(D_MYERS|D_PATIENCE);
+			if (strcmp(optarg, "myers") == 0)
+				dflags |= D_MYERS;
+			else if (strcmp(optarg, "patience") == 0)
+				dflags |= D_PATIENCE;
+			else if (strcmp(optarg, "stone") != 0) {
+				warnx("Invalid argument for diff-algorithm");
+				usage();
+			}
+			break;
+		case OPT_JOBS:
+			l = strtol(optarg, &ep, 10);
+			if (*ep != '\0' || l < 1 || l > 64) {
+				warnx("Invalid argument for jobs");
+				usage();
+			}
+			diff_jobs = (int)l;
+			break;
 		case OPT_CHANGED_GROUP_FORMAT:
 			diff_format = D_GFORMAT;
 			group_format = optarg;
@@ -484,6 +509,7 @@ usage(void)
 	(void)fprintf(thread_stderr,
 	    "usage: diff [-abdilpTtw] [-c | -e | -f | -n | -q | -u] [--ignore-case]\n"
 	    "            [--no-ignore-case] [--normal] [--strip-trailing-cr] [--tabsize]\n"
+	    "            [--diff-algorithm stone|myers|patience]\n"
 	    "            [-I pattern] [-L label] file1 file2\n"
 	    "       diff [-abdilpTtw] [-I pattern] [-L label] [--ignore-case]\n"
 	    "            [--no-ignore-case] [--normal] [--strip-trailing-cr] [--tabsize]\n"
@@ -495,7 +521,7 @@ usage(void)
 	    "            -U number file1 file2\n"
 	    "       diff [-abdilNPprsTtw] [-c | -e | -f | -n | -q | -u] [--ignore-case]\n"
 	    "            [--no-ignore-case] [--normal] [--tabsize] [-I pattern] [-L label]\n"
-	    "            [-S name] [-X file] [-x pattern] dir1 dir2\n");
+	    "            [--jobs number] [-S name] [-X file] [-x pattern] dir1 dir2\n");
 
 	exit(2);
 }
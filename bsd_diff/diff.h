@@ -67,6 +67,8 @@
 #define D_EXPANDTABS		0x100	/* Expand tabs to spaces */
 #define D_IGNOREBLANKS		0x200	/* Ignore white space changes */
 #define D_STRIPCR		0x400	/* Strip trailing cr */
+#define D_MYERS			0x800	/* Use Myers' O(ND) algorithm */
+#define D_PATIENCE		0x1000	/* Patience diff, Myers in between */
 
 /*
  * Status values for print_status() and diffreg() return values
@@ -86,7 +88,7 @@ struct excludes {
 
 extern int	Nflag, Pflag, diff_rflag, Tflag, diff_cflag;
 extern int	diff_format, diff_context, status, ignore_file_case;
-extern int	tabsize;
+extern int	tabsize, diff_jobs;
 extern char	*start, *ifdefname, *diffargs, *diff_label[2], *ignore_pats;
 extern char	*group_format;
 extern struct	stat stb1, stb2;
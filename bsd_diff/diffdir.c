@@ -23,38 +23,109 @@
 #include <sys/cdefs.h>
 __FBSDID("$FreeBSD$");
 
+#include <sys/param.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <dirent.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fnmatch.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
 
 #include "diff.h"
+#include "xmalloc.h"
 #include "ios_error.h"
 
+/*
+ * With --jobs, the files present on both sides of a directory are
+ * compared by a pool of threads ahead of the main thread, which still
+ * walks the trees in sorted order and does all the output.  Pairs that
+ * turn out identical byte for byte skip diffreg(); everything else goes
+ * through it as before, so the output does not depend on the number of
+ * jobs.
+ */
+struct cmpjob {
+	struct cmpjob	*next;
+	char		*path1;
+	char		*path2;
+	int		 done;
+	int		 same;
+};
+
+static pthread_mutex_t	 cmp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	 cmp_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	 cmp_done = PTHREAD_COND_INITIALIZER;
+static struct cmpjob	*cmp_head, **cmp_tail = &cmp_head;
+static pthread_t	*cmp_threads;
+static int		 cmp_nthreads, cmp_quit;
+
 static int selectfile(const struct dirent *);
-static void diffit(struct dirent *, char *, size_t, char *, size_t, int);
+static void diffit(struct dirent *, char *, size_t, char *, size_t, int, int);
+static void diffdir1(char *, char *, int);
+static void *cmp_worker(void *);
+static int samefile(const char *, const char *);
 
 #define d_status	d_type		/* we need to store status for -l */
 
 /*
- * Diff directory traversal. Will be called recursively if -r was specified.
+ * Diff two directories, with the comparison threads running if
+ * requested.
  */
 void
 diffdir(char *p1, char *p2, int flags)
+{
+	int i;
+
+	cmp_head = NULL;
+	cmp_tail = &cmp_head;
+	cmp_quit = 0;
+	cmp_nthreads = 0;
+	if (diff_jobs > 1) {
+		cmp_threads = xcalloc(diff_jobs, sizeof(*cmp_threads));
+		for (i = 0; i < diff_jobs; i++)
+			if (pthread_create(&cmp_threads[cmp_nthreads], NULL,
+			    cmp_worker, NULL) == 0)
+				cmp_nthreads++;
+	}
+
+	diffdir1(p1, p2, flags);
+
+	if (cmp_nthreads > 0) {
+		pthread_mutex_lock(&cmp_lock);
+		cmp_quit = 1;
+		pthread_cond_broadcast(&cmp_work);
+		pthread_mutex_unlock(&cmp_lock);
+		for (i = 0; i < cmp_nthreads; i++)
+			pthread_join(cmp_threads[i], NULL);
+		cmp_nthreads = 0;
+	}
+	free(cmp_threads);
+	cmp_threads = NULL;
+}
+
+/*
+ * Diff directory traversal. Will be called recursively if -r was specified.
+ */
+static void
+diffdir1(char *p1, char *p2, int flags)
 {
 	struct dirent *dent1, **dp1, **edp1, **dirp1 = NULL;
 	struct dirent *dent2, **dp2, **edp2, **dirp2 = NULL;
-	size_t dirlen1, dirlen2;
+	struct cmpjob *jobs, *job;
+	size_t dirlen1, dirlen2, njobs, i;
 	char path1[PATH_MAX], path2[PATH_MAX];
 	int pos;
 
 	edp1 = edp2 = NULL;
+	jobs = NULL;
+	njobs = 0;
 
 	dirlen1 = strlcpy(path1, *p1 ? p1 : ".", sizeof(path1));
 	if (dirlen1 >= sizeof(path1) - 1) {
@@ -115,6 +186,40 @@ diffdir(char *p1, char *p2, int flags)
 			dp2++;
 	}
 
+	/*
+	 * Queue the names found on both sides for the comparison threads,
+	 * in the order they will be needed below.
+	 */
+	if (cmp_nthreads > 0) {
+		struct dirent **d1, **d2;
+
+		jobs = xcalloc(MIN(edp1 - dp1, edp2 - dp2) + 1, sizeof(*jobs));
+		for (d1 = dp1, d2 = dp2; d1 != edp1 && d2 != edp2;) {
+			pos = ignore_file_case ?
+			    strcasecmp((*d1)->d_name, (*d2)->d_name) :
+			    strcmp((*d1)->d_name, (*d2)->d_name);
+			if (pos == 0) {
+				job = &jobs[njobs++];
+				xasprintf(&job->path1, "%s%s", path1,
+				    (*d1)->d_name);
+				xasprintf(&job->path2, "%s%s", path2,
+				    (*d1)->d_name);
+			}
+			if (pos <= 0)
+				d1++;
+			if (pos >= 0)
+				d2++;
+		}
+		pthread_mutex_lock(&cmp_lock);
+		for (i = 0; i < njobs; i++) {
+			*cmp_tail = &jobs[i];
+			cmp_tail = &jobs[i].next;
+		}
+		pthread_cond_broadcast(&cmp_work);
+		pthread_mutex_unlock(&cmp_lock);
+	}
+	i = 0;
+
 	/*
 	 * Iterate through the two directory lists, diffing as we go.
 	 */
@@ -127,14 +232,23 @@ diffdir(char *p1, char *p2, int flags)
 		    strcmp(dent1->d_name, dent2->d_name) ;
 		if (pos == 0) {
 			/* file exists in both dirs, diff it */
-			diffit(dent1, path1, dirlen1, path2, dirlen2, flags);
+			job = NULL;
+			if (jobs != NULL) {
+				job = &jobs[i++];
+				pthread_mutex_lock(&cmp_lock);
+				while (!job->done)
+					pthread_cond_wait(&cmp_done, &cmp_lock);
+				pthread_mutex_unlock(&cmp_lock);
+			}
+			diffit(dent1, path1, dirlen1, path2, dirlen2, flags,
+			    job != NULL && job->same);
 			dp1++;
 			dp2++;
 		} else if (pos < 0) {
 			/* file only in first dir, only diff if -N */
 			if (Nflag)
 				diffit(dent1, path1, dirlen1, path2, dirlen2,
-				    flags);
+				    flags, 0);
 			else {
 				print_only(path1, dirlen1, dent1->d_name);
 				status = 1;
@@ -144,7 +258,7 @@ diffdir(char *p1, char *p2, int flags)
 			/* file only in second dir, only diff if -N or -P */
 			if (Nflag || Pflag)
 				diffit(dent2, path1, dirlen1, path2, dirlen2,
-				    flags);
+				    flags, 0);
 			else {
 				print_only(path2, dirlen2, dent2->d_name);
 				status = 1;
@@ -154,6 +268,11 @@ diffdir(char *p1, char *p2, int flags)
 	}
 
 closem:
+	for (i = 0; i < njobs; i++) {
+		free(jobs[i].path1);
+		free(jobs[i].path2);
+	}
+	free(jobs);
 	if (dirp1 != NULL) {
 		for (dp1 = dirp1; dp1 < edp1; dp1++)
 			free(*dp1);
@@ -168,10 +287,11 @@ closem:
 
 /*
  * Do the actual diff by calling either diffreg() or diffdir().
+ * "same" says the comparison threads found the files identical.
  */
 static void
 diffit(struct dirent *dp, char *path1, size_t plen1, char *path2, size_t plen2,
-    int flags)
+    int flags, int same)
 {
 	flags |= D_HEADER;
 	strlcpy(path1 + plen1, dp->d_name, PATH_MAX - plen1);
@@ -199,7 +319,7 @@ diffit(struct dirent *dp, char *path1, size_t plen1, char *path2, size_t plen2,
 
 	if (S_ISDIR(stb1.st_mode) && S_ISDIR(stb2.st_mode)) {
 		if (diff_rflag)
-			diffdir(path1, path2, flags);
+			diffdir1(path1, path2, flags);
 		else
 			printf("Common subdirectories: %s and %s\n",
 			    path1, path2);
@@ -209,11 +329,87 @@ diffit(struct dirent *dp, char *path1, size_t plen1, char *path2, size_t plen2,
 		dp->d_status = D_SKIPPED1;
 	else if (!S_ISREG(stb2.st_mode) && !S_ISDIR(stb2.st_mode))
 		dp->d_status = D_SKIPPED2;
+	else if (same && S_ISREG(stb1.st_mode) && S_ISREG(stb2.st_mode))
+		dp->d_status = D_SAME;
 	else
 		dp->d_status = diffreg(path1, path2, flags, 0);
 	print_status(dp->d_status, path1, path2, "");
 }
 
+static void *
+cmp_worker(void *arg)
+{
+	struct cmpjob *job;
+	int same;
+
+	pthread_mutex_lock(&cmp_lock);
+	for (;;) {
+		while (cmp_head == NULL && !cmp_quit)
+			pthread_cond_wait(&cmp_work, &cmp_lock);
+		if ((job = cmp_head) == NULL)
+			break;
+		if ((cmp_head = job->next) == NULL)
+			cmp_tail = &cmp_head;
+		pthread_mutex_unlock(&cmp_lock);
+		same = samefile(job->path1, job->path2);
+		pthread_mutex_lock(&cmp_lock);
+		job->same = same;
+		job->done = 1;
+		pthread_cond_broadcast(&cmp_done);
+	}
+	pthread_mutex_unlock(&cmp_lock);
+	return (NULL);
+}
+
+/*
+ * Returns 1 if both paths are regular files with the same contents.
+ * Files of different sizes are never read; anything unusual, including
+ * errors, is left for diffreg() to deal with and report.
+ */
+static int
+samefile(const char *path1, const char *path2)
+{
+	struct stat sb1, sb2;
+	char buf1[65536], buf2[65536];
+	void *m1, *m2;
+	ssize_t n1, n2;
+	int fd1, fd2, same;
+
+	if (stat(path1, &sb1) != 0 || stat(path2, &sb2) != 0 ||
+	    !S_ISREG(sb1.st_mode) || !S_ISREG(sb2.st_mode) ||
+	    sb1.st_size != sb2.st_size)
+		return (0);
+	if (sb1.st_size == 0 ||
+	    (sb1.st_dev == sb2.st_dev && sb1.st_ino == sb2.st_ino))
+		return (1);
+	if ((fd1 = open(path1, O_RDONLY)) < 0)
+		return (0);
+	if ((fd2 = open(path2, O_RDONLY)) < 0) {
+		close(fd1);
+		return (0);
+	}
+	m1 = mmap(NULL, sb1.st_size, PROT_READ, MAP_PRIVATE, fd1, 0);
+	m2 = mmap(NULL, sb2.st_size, PROT_READ, MAP_PRIVATE, fd2, 0);
+	if (m1 != MAP_FAILED && m2 != MAP_FAILED)
+		same = memcmp(m1, m2, sb1.st_size) == 0;
+	else {
+		same = 1;
+		do {
+			n1 = read(fd1, buf1, sizeof(buf1));
+			n2 = read(fd2, buf2, sizeof(buf2));
+			if (n1 != n2 || n1 < 0 || memcmp(buf1, buf2, n1) != 0)
+				same = 0;
+		} while (same && n1 > 0);
+	}
+	if (m1 != MAP_FAILED)
+		munmap(m1, sb1.st_size);
+	if (m2 != MAP_FAILED)
+		munmap(m2, sb2.st_size);
+	close(fd1);
+	close(fd2);
+	return (same);
+}
+
 /*
  * Returns 1 if the directory entry should be included in the
  * diff, else 0.  Checks the excludes list.
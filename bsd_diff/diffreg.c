@@ -71,6 +71,7 @@ __FBSDID("$FreeBSD$");
 
 // #include <sys/capsicum.h>
 // #include <sys/procdesc.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/event.h>
@@ -167,6 +168,14 @@ __FBSDID("$FreeBSD$");
  *	are (in words) 2*length(file0) + length(file1) +
  *	3*(number of k-candidates installed),  typically about
  *	6n words for files of length n.
+ *
+ *	With D_MYERS, J is instead computed by Myers' O(ND) algorithm
+ *	("An O(ND) Difference Algorithm and Its Variations", 1986) on
+ *	the same hash values, in linear space by recursing around the
+ *	middle snake.  D_PATIENCE first matches up lines that occur
+ *	exactly once in both files, in order, and only runs Myers on the
+ *	stretches between them.  Either way check() still weeds out
+ *	hash collisions and the output code is shared.
  */
 
 struct cand {
@@ -205,6 +214,10 @@ static void	 prepare(int, FILE *, size_t, int);
 static void	 prune(void);
 static void	 equiv(struct line *, int, struct line *, int, int *);
 static void	 unravel(int);
+static void	 jinit(void);
+static void	 lcs(int);
+static void	 myers(int, int, int, int);
+static void	 patience(int, int, int, int);
 static void	 unsort(struct line *, int, int *);
 static void	 change(char *, FILE *, char *, FILE *, int, int, int, int, int *);
 static void	 sort(struct line *, int);
@@ -218,6 +231,7 @@ static int	 skipline(FILE *);
 static int	 isqrt(int);
 static int	 stone(int *, int, int *, int *, int);
 static int	 readhash(FILE *, int);
+static int	 readhashmem(const u_char **, const u_char *, int);
 static int	 files_differ(FILE *, FILE *, int);
 static char	*match_function(const long *, int, FILE *);
 static char	*preadline(int, size_t, off_t);
@@ -247,6 +261,11 @@ static char lastbuf[FUNCTION_CONTEXT_SIZE];
 static int lastline;
 static int lastmatchline;
 
+/* State for lcs(): hash values, the V vectors and the cost limit. */
+static int  *lcs_a, *lcs_b;
+static int  *vf, *vb, voff;
+static int   maxcost;
+
 static int
 clow2low(int c)
 {
@@ -449,29 +468,33 @@ diffreg(char *file1, char *file2, int flags, int capsicum)
 	prepare(1, f2, stb2.st_size, flags);
 
 	prune();
-	sort(sfile[0], slen[0]);
-	sort(sfile[1], slen[1]);
-
-	member = (int *)file[1];
-	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
-	member = xreallocarray(member, slen[1] + 2, sizeof(*member));
-
-	class = (int *)file[0];
-	unsort(sfile[0], slen[0], class);
-	class = xreallocarray(class, slen[0] + 2, sizeof(*class));
-
-	klist = xcalloc(slen[0] + 2, sizeof(*klist));
-	clen = 0;
-	clistlen = 100;
-	clist = xcalloc(clistlen, sizeof(*clist));
-	i = stone(class, slen[0], member, klist, flags);
-	free(member);
-	free(class);
-
-	J = xreallocarray(J, len[0] + 2, sizeof(*J));
-	unravel(klist[i]);
-	free(clist);
-	free(klist);
+	if (flags & (D_MYERS|D_PATIENCE))
+		lcs(flags);
+	else {
+		sort(sfile[0], slen[0]);
+		sort(sfile[1], slen[1]);
+
+		member = (int *)file[1];
+		equiv(sfile[0], slen[0], sfile[1], slen[1], member);
+		member = xreallocarray(member, slen[1] + 2, sizeof(*member));
+
+		class = (int *)file[0];
+		unsort(sfile[0], slen[0], class);
+		class = xreallocarray(class, slen[0] + 2, sizeof(*class));
+
+		klist = xcalloc(slen[0] + 2, sizeof(*klist));
+		clen = 0;
+		clistlen = 100;
+		clist = xcalloc(clistlen, sizeof(*clist));
+		i = stone(class, slen[0], member, klist, flags);
+		free(member);
+		free(class);
+
+		J = xreallocarray(J, len[0] + 2, sizeof(*J));
+		unravel(klist[i]);
+		free(clist);
+		free(klist);
+	}
 
 	ixold = xreallocarray(ixold, len[0] + 2, sizeof(*ixold));
 	ixnew = xreallocarray(ixnew, len[1] + 2, sizeof(*ixnew));
@@ -592,6 +615,8 @@ static void
 prepare(int i, FILE *fd, size_t filesize, int flags)
 {
 	struct line *p;
+	struct stat st;
+	const u_char *base, *cp;
 	int h;
 	size_t sz, j;
 
@@ -601,14 +626,27 @@ prepare(int i, FILE *fd, size_t filesize, int flags)
 	if (sz < 100)
 		sz = 100;
 
+	/*
+	 * Regular files are hashed straight from a mapping rather than
+	 * a character at a time through stdio.
+	 */
+	base = MAP_FAILED;
+	if (filesize > 0 && fstat(fileno(fd), &st) == 0 &&
+	    S_ISREG(st.st_mode) && (size_t)st.st_size == filesize)
+		base = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE,
+		    fileno(fd), 0);
+
 	p = xcalloc(sz + 3, sizeof(*p));
-	for (j = 0; (h = readhash(fd, flags));) {
+	for (j = 0, cp = base; (h = base != MAP_FAILED ?
+	    readhashmem(&cp, base + filesize, flags) : readhash(fd, flags));) {
 		if (j == sz) {
 			sz = sz * 3 / 2;
 			p = xreallocarray(p, sz + 3, sizeof(*p));
 		}
 		p[++j].value = h;
 	}
+	if (base != MAP_FAILED)
+		munmap((void *)base, filesize);
 	len[i] = j;
 	file[i] = p;
 }
@@ -773,13 +811,301 @@ static void
 unravel(int p)
 {
 	struct cand *q;
+
+	jinit();
+	for (q = clist + p; q->y != 0; q = clist + q->pred)
+		J[q->x + pref] = q->y + pref;
+}
+
+/*
+ * Set up J with the common prefix and suffix matched and nothing else.
+ */
+static void
+jinit(void)
+{
 	int i;
 
 	for (i = 0; i <= len[0]; i++)
 		J[i] = i <= pref ? i :
 		    i > len[0] - suff ? i + len[1] - len[0] : 0;
-	for (q = clist + p; q->y != 0; q = clist + q->pred)
-		J[q->x + pref] = q->y + pref;
+}
+
+/*
+ * Compute J for the pruned files with Myers' algorithm, or the patience
+ * variant, instead of stone().
+ */
+static void
+lcs(int flags)
+{
+	int i, n, m;
+
+	n = slen[0];
+	m = slen[1];
+	J = xreallocarray(J, len[0] + 2, sizeof(*J));
+	jinit();
+
+	lcs_a = xcalloc(n + 1, sizeof(*lcs_a));
+	lcs_b = xcalloc(m + 1, sizeof(*lcs_b));
+	for (i = 1; i <= n; i++)
+		lcs_a[i - 1] = sfile[0][i].value;
+	for (i = 1; i <= m; i++)
+		lcs_b[i - 1] = sfile[1][i].value;
+
+	/* Diagonals run from -m to n; keep one spare on either side. */
+	voff = m + 1;
+	vf = xcalloc(n + m + 3, sizeof(*vf));
+	vb = xcalloc(n + m + 3, sizeof(*vb));
+	if (flags & D_MINIMAL)
+		maxcost = INT_MAX;
+	else
+		maxcost = MAX(256, isqrt(n + m));
+
+	if (flags & D_PATIENCE)
+		patience(0, n, 0, m);
+	else
+		myers(0, n, 0, m);
+
+	free(vb);
+	free(vf);
+	free(lcs_b);
+	free(lcs_a);
+	vf = vb = lcs_a = lcs_b = NULL;
+}
+
+/* Record that line x of the pruned file0 matches line y of file1. */
+#define	LCS_MATCH(x, y)	(J[(x) + 1 + pref] = (y) + 1 + pref)
+
+/*
+ * Linear space Myers diff of lcs_a[alo, ahi) against lcs_b[blo, bhi):
+ * run the forward and backward searches until they overlap, then
+ * recurse on either side of the meeting point.  The common prefix and
+ * suffix trimmed on entry are what record the matches.  Past maxcost
+ * differences the furthest reaching path is taken as the split point
+ * instead, which keeps large and very different inputs from going
+ * quadratic; -d turns that off.
+ */
+static void
+myers(int alo, int ahi, int blo, int bhi)
+{
+	int *a, *b, *fv, *bv, n, m, odd, d, k, x, y;
+	int fmin, fmax, bmin, bmax, best, bx, by;
+
+	while (alo < ahi && blo < bhi && lcs_a[alo] == lcs_b[blo]) {
+		LCS_MATCH(alo, blo);
+		alo++;
+		blo++;
+	}
+	while (alo < ahi && blo < bhi && lcs_a[ahi - 1] == lcs_b[bhi - 1]) {
+		ahi--;
+		bhi--;
+		LCS_MATCH(ahi, bhi);
+	}
+	if (alo == ahi || blo == bhi)
+		return;
+
+	a = lcs_a + alo;
+	b = lcs_b + blo;
+	n = ahi - alo;
+	m = bhi - blo;
+	odd = (n - m) & 1;
+	/*
+	 * fv[k] is the furthest x reached on diagonal k = x - y from the
+	 * start, bv[k] the smallest x reached from the end.  Diagonals
+	 * outside [-m, n] leave the box; the entry just past either end
+	 * of the active range holds a sentinel.
+	 */
+	fv = vf + voff;
+	bv = vb + voff;
+	fmin = fmax = 0;
+	bmin = bmax = n - m;
+	fv[0] = 0;
+	bv[n - m] = n;
+	for (d = 1;; d++) {
+		if (fmin > -m)
+			fv[--fmin - 1] = -1;
+		else
+			++fmin;
+		if (fmax < n)
+			fv[++fmax + 1] = -1;
+		else
+			--fmax;
+		for (k = fmax; k >= fmin; k -= 2) {
+			if (fv[k - 1] >= fv[k + 1])
+				x = fv[k - 1] + 1;
+			else
+				x = fv[k + 1];
+			for (y = x - k; x < n && y < m && a[x] == b[y]; x++, y++)
+				;
+			fv[k] = x;
+			if (odd && bmin <= k && k <= bmax && bv[k] <= x)
+				goto split;
+		}
+
+		if (bmin > -m)
+			bv[--bmin - 1] = INT_MAX;
+		else
+			++bmin;
+		if (bmax < n)
+			bv[++bmax + 1] = INT_MAX;
+		else
+			--bmax;
+		for (k = bmax; k >= bmin; k -= 2) {
+			if (bv[k - 1] < bv[k + 1])
+				x = bv[k - 1];
+			else
+				x = bv[k + 1] - 1;
+			for (y = x - k; x > 0 && y > 0 && a[x - 1] == b[y - 1];
+			    x--, y--)
+				;
+			bv[k] = x;
+			if (!odd && fmin <= k && k <= fmax && x <= fv[k])
+				goto split;
+		}
+
+		if (d < maxcost)
+			continue;
+		best = 0;
+		bx = by = 0;
+		for (k = fmax; k >= fmin; k -= 2) {
+			x = MIN(fv[k], n);
+			y = x - k;
+			if (y > m) {
+				x = m + k;
+				y = m;
+			}
+			if (x + y > best && x + y < n + m) {
+				best = x + y;
+				bx = x;
+				by = y;
+			}
+		}
+		for (k = bmax; k >= bmin; k -= 2) {
+			x = MAX(0, bv[k]);
+			y = x - k;
+			if (y < 0) {
+				x = k;
+				y = 0;
+			}
+			if (n + m - (x + y) > best && x + y > 0) {
+				best = n + m - (x + y);
+				bx = x;
+				by = y;
+			}
+		}
+		if (best > 0) {
+			x = bx;
+			y = by;
+			goto split;
+		}
+	}
+split:
+	myers(alo, alo + x, blo, blo + y);
+	myers(alo + x, ahi, blo + y, bhi);
+}
+
+/*
+ * Patience diff: lines whose hash occurs exactly once on each side are
+ * matched up by a longest increasing subsequence, and the stretches in
+ * between are diffed recursively, with Myers when no unique lines are
+ * left.
+ */
+static void
+patience(int alo, int ahi, int blo, int bhi)
+{
+	struct uniq {
+		int	value;
+		int	na, nb;
+		int	ia, ib;
+	} *tab, *u;
+	int *pile, *pred, *order, *anchor;
+	int i, j, n, mask, size, npile, nanchor, lo, hi, mid;
+
+	while (alo < ahi && blo < bhi && lcs_a[alo] == lcs_b[blo]) {
+		LCS_MATCH(alo, blo);
+		alo++;
+		blo++;
+	}
+	while (alo < ahi && blo < bhi && lcs_a[ahi - 1] == lcs_b[bhi - 1]) {
+		ahi--;
+		bhi--;
+		LCS_MATCH(ahi, bhi);
+	}
+	if (alo == ahi || blo == bhi)
+		return;
+
+	/* Count each hash value on both sides in an open addressed table. */
+	for (size = 16; size < 2 * (ahi - alo + bhi - blo); size <<= 1)
+		;
+	mask = size - 1;
+	tab = xcalloc(size, sizeof(*tab));
+	for (i = alo; i < bhi - blo + ahi; i++) {
+		int v, isa;
+
+		isa = i < ahi;
+		v = isa ? lcs_a[i] : lcs_b[i - ahi + blo];
+		for (j = (v * 0x9e3779b1U) & mask; tab[j].na + tab[j].nb != 0 &&
+		    tab[j].value != v; j = (j + 1) & mask)
+			;
+		u = &tab[j];
+		u->value = v;
+		if (isa) {
+			u->na++;
+			u->ia = i;
+		} else {
+			u->nb++;
+			u->ib = i - ahi + blo;
+		}
+	}
+
+	/* Unique pairs in file0 order. */
+	order = xcalloc(ahi - alo, sizeof(*order));
+	for (n = 0, i = alo; i < ahi; i++) {
+		for (j = (lcs_a[i] * 0x9e3779b1U) & mask;
+		    tab[j].value != lcs_a[i]; j = (j + 1) & mask)
+			;
+		if (tab[j].na == 1 && tab[j].nb == 1)
+			order[n++] = j;
+	}
+	if (n == 0) {
+		free(order);
+		free(tab);
+		myers(alo, ahi, blo, bhi);
+		return;
+	}
+
+	/* Longest increasing subsequence of the file1 positions. */
+	pile = xcalloc(n, sizeof(*pile));
+	pred = xcalloc(n, sizeof(*pred));
+	for (npile = 0, i = 0; i < n; i++) {
+		for (lo = 0, hi = npile; lo < hi;) {
+			mid = (lo + hi) / 2;
+			if (tab[order[pile[mid]]].ib < tab[order[i]].ib)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		pred[i] = lo > 0 ? pile[lo - 1] : -1;
+		pile[lo] = i;
+		if (lo == npile)
+			npile++;
+	}
+	anchor = xcalloc(npile, sizeof(*anchor));
+	for (nanchor = npile, i = pile[npile - 1]; i >= 0; i = pred[i])
+		anchor[--nanchor] = order[i];
+
+	for (i = 0; i < npile; i++) {
+		u = &tab[anchor[i]];
+		patience(alo, u->ia, blo, u->ib);
+		LCS_MATCH(u->ia, u->ib);
+		alo = u->ia + 1;
+		blo = u->ib + 1;
+	}
+	free(anchor);
+	free(pred);
+	free(pile);
+	free(order);
+	free(tab);
+	patience(alo, ahi, blo, bhi);
 }
 
 /*
@@ -1311,6 +1637,74 @@ fetch(long *f, int a, int b, FILE *lb, int ch, int oldfile, int flags)
 	return (0);
 }
 
+/*
+ * readhash() for a file mapped in memory: *pp is the current position.
+ * The result must be the same as readhash() on the same bytes.
+ */
+static int
+readhashmem(const u_char **pp, const u_char *ep, int flags)
+{
+	const u_char *p;
+	int i, t, space;
+	int sum;
+
+#define	MGETC()		(p < ep ? *p++ : EOF)
+	p = *pp;
+	sum = 1;
+	space = 0;
+	if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS)) == 0) {
+		for (i = 0; (t = MGETC()) != '\n'; i++) {
+			if (flags & D_STRIPCR && t == '\r') {
+				t = MGETC();
+				if (t == '\n')
+					break;
+				if (t != EOF)
+					p--;
+			}
+			if (t == EOF) {
+				if (i == 0) {
+					*pp = p;
+					return (0);
+				}
+				break;
+			}
+			sum = sum * 127 + (flags & D_IGNORECASE ? chrtran(t) : t);
+		}
+	} else {
+		for (i = 0;;) {
+			switch (t = MGETC()) {
+			case '\r':
+			case '\t':
+			case '\v':
+			case '\f':
+			case ' ':
+				space++;
+				continue;
+			default:
+				if (space && (flags & D_IGNOREBLANKS) == 0) {
+					i++;
+					space = 0;
+				}
+				sum = sum * 127 + chrtran(t);
+				i++;
+				continue;
+			case EOF:
+				if (i == 0) {
+					*pp = p;
+					return (0);
+				}
+				/* FALLTHROUGH */
+			case '\n':
+				break;
+			}
+			break;
+		}
+	}
+#undef	MGETC
+	*pp = p;
+	return (sum == 0 ? 1 : sum);
+}
+
 /*
  * Hash function taken from Robert Sedgewick, Algorithms in C, 3d ed., p 578.
  */
@@ -54,6 +54,10 @@
 
 #define H3VERSION "h3"
 
+/* ALPN id and port go in front of the host name in a hash key */
+#define ALTSVC_KEYLEN (MAX_ALTSVC_HOSTLEN + 16)
+#define ALTSVC_SLOTS 63
+
 static enum alpnid alpn2alpnid(char *name)
 {
   if(strcasecompare(name, "h1"))
@@ -137,6 +141,83 @@ static struct altsvc *altsvc_create(char *srchost,
                          srcport, dstport);
 }
 
+/*
+ * Store the hash key for a source origin in 'key': the ALPN id, the port and
+ * the lower-cased host name without trailing dot. Returns the key length, 0
+ * if the host name is empty or too long.
+ */
+static size_t altsvc_key(char *key, enum alpnid alpnid, const char *host,
+                         unsigned short port)
+{
+  size_t hlen = strlen(host);
+  size_t klen;
+  if(hlen && (host[hlen - 1] == '.'))
+    hlen--;
+  if(!hlen || (hlen > MAX_ALTSVC_HOSTLEN))
+    return 0;
+  klen = msnprintf(key, ALTSVC_KEYLEN - MAX_ALTSVC_HOSTLEN, "%d:%u:",
+                   (int)alpnid, port);
+  Curl_strntolower(&key[klen], host, hlen);
+  klen += hlen;
+  key[klen] = 0;
+  return klen;
+}
+
+/* the entries are owned by the list, the hash only points to them */
+static void altsvc_hash_dtor(void *p)
+{
+  (void)p;
+}
+
+/* add an entry last in the list and last among the alternatives for its
+   source origin. An entry whose source host cannot be used as a key is
+   freed and rejected with CURLE_BAD_FUNCTION_ARGUMENT. */
+static CURLcode altsvc_insert(struct altsvcinfo *asi, struct altsvc *as)
+{
+  char key[ALTSVC_KEYLEN];
+  size_t klen = altsvc_key(key, as->src.alpnid, as->src.host, as->src.port);
+  struct altsvc *first;
+
+  if(!klen) {
+    altsvc_free(as);
+    return CURLE_BAD_FUNCTION_ARGUMENT;
+  }
+  first = Curl_hash_pick(&asi->hash, key, klen);
+  if(first) {
+    while(first->next)
+      first = first->next;
+    first->next = as;
+  }
+  else if(!Curl_hash_add(&asi->hash, key, klen, as)) {
+    altsvc_free(as);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  Curl_llist_insert_next(&asi->list, asi->list.tail, as, &as->node);
+  return CURLE_OK;
+}
+
+/* unlink an entry from the hash and the list and free it */
+static void altsvc_remove(struct altsvcinfo *asi, struct altsvc *as)
+{
+  char key[ALTSVC_KEYLEN];
+  size_t klen = altsvc_key(key, as->src.alpnid, as->src.host, as->src.port);
+  struct altsvc *first = Curl_hash_pick(&asi->hash, key, klen);
+
+  if(first == as) {
+    if(as->next)
+      Curl_hash_add(&asi->hash, key, klen, as->next);
+    else
+      Curl_hash_delete(&asi->hash, key, klen);
+  }
+  else if(first) {
+    while(first->next && (first->next != as))
+      first = first->next;
+    first->next = as->next;
+  }
+  Curl_llist_remove(&asi->list, &as->node, NULL);
+  altsvc_free(as);
+}
+
 /* only returns SERIOUS errors */
 static CURLcode altsvc_add(struct altsvcinfo *asi, char *line)
 {
@@ -169,7 +250,9 @@ static CURLcode altsvc_add(struct altsvcinfo *asi, char *line)
       as->expires = expires;
       as->prio = prio;
       as->persist = persist ? 1 : 0;
-      Curl_llist_insert_next(&asi->list, asi->list.tail, as, &as->node);
+      /* a line that cannot be stored is skipped like a malformed one */
+      if(altsvc_insert(asi, as) == CURLE_OUT_OF_MEMORY)
+        return CURLE_OUT_OF_MEMORY;
     }
   }
 
@@ -261,6 +344,8 @@ struct altsvcinfo *Curl_altsvc_init(void)
   if(!asi)
     return NULL;
   Curl_llist_init(&asi->list, NULL);
+  Curl_hash_init(&asi->hash, ALTSVC_SLOTS, Curl_hash_str,
+                 Curl_str_key_compare, altsvc_hash_dtor);
 
   /* set default behavior */
   asi->flags = CURLALTSVC_H1
@@ -313,6 +398,7 @@ void Curl_altsvc_cleanup(struct altsvcinfo **altsvcp)
       n = e->next;
       altsvc_free(as);
     }
+    Curl_hash_destroy(&altsvc->hash);
     free(altsvc->filename);
     free(altsvc);
     *altsvcp = NULL; /* clear the pointer */
@@ -386,37 +472,22 @@ static CURLcode getalnum(const char **ptr, char *alpnbuf, size_t buflen)
   return CURLE_OK;
 }
 
-/* hostcompare() returns true if 'host' matches 'check'. The first host
- * argument may have a trailing dot present that will be ignored.
- */
-static bool hostcompare(const char *host, const char *check)
-{
-  size_t hlen = strlen(host);
-  size_t clen = strlen(check);
-
-  if(hlen && (host[hlen - 1] == '.'))
-    hlen--;
-  if(hlen != clen)
-    /* they can't match if they have different lengths */
-    return FALSE;
-  return strncasecompare(host, check, hlen);
-}
-
 /* altsvc_flush() removes all alternatives for this source origin from the
-   list */
+   cache */
 static void altsvc_flush(struct altsvcinfo *asi, enum alpnid srcalpnid,
                          const char *srchost, unsigned short srcport)
 {
-  struct Curl_llist_element *e;
-  struct Curl_llist_element *n;
-  for(e = asi->list.head; e; e = n) {
-    struct altsvc *as = e->ptr;
-    n = e->next;
-    if((srcalpnid == as->src.alpnid) &&
-       (srcport == as->src.port) &&
-       hostcompare(srchost, as->src.host)) {
-      Curl_llist_remove(&asi->list, e, NULL);
+  char key[ALTSVC_KEYLEN];
+  size_t klen = altsvc_key(key, srcalpnid, srchost, srcport);
+  struct altsvc *as = klen ? Curl_hash_pick(&asi->hash, key, klen) : NULL;
+
+  if(as) {
+    Curl_hash_delete(&asi->hash, key, klen);
+    while(as) {
+      struct altsvc *n = as->next;
+      Curl_llist_remove(&asi->list, &as->node, NULL);
       altsvc_free(as);
+      as = n;
     }
   }
 }
@@ -597,9 +668,16 @@ CURLcode Curl_altsvc_parse(struct Curl_easy *data,
                account. [See RFC 7838 section 3.1] */
             as->expires = maxage + time(NULL);
             as->persist = persist;
-            Curl_llist_insert_next(&asi->list, asi->list.tail, as, &as->node);
-            infof(data, "Added alt-svc: %s:%d over %s", dsthost, dstport,
-                  Curl_alpnid2str(dstalpnid));
+            switch(altsvc_insert(asi, as)) {
+            case CURLE_OK:
+              infof(data, "Added alt-svc: %s:%d over %s", dsthost, dstport,
+                    Curl_alpnid2str(dstalpnid));
+              break;
+            case CURLE_OUT_OF_MEMORY:
+              return CURLE_OUT_OF_MEMORY;
+            default:
+              break;
+            }
           }
         }
       }
@@ -631,30 +709,28 @@ bool Curl_altsvc_lookup(struct altsvcinfo *asi,
                         struct altsvc **dstentry,
                         const int versions) /* one or more bits */
 {
-  struct Curl_llist_element *e;
-  struct Curl_llist_element *n;
+  char key[ALTSVC_KEYLEN];
+  size_t klen;
+  struct altsvc *as;
   time_t now = time(NULL);
   DEBUGASSERT(asi);
   DEBUGASSERT(srchost);
   DEBUGASSERT(dstentry);
 
-  for(e = asi->list.head; e; e = n) {
-    struct altsvc *as = e->ptr;
-    n = e->next;
+  klen = altsvc_key(key, srcalpnid, srchost, (unsigned short)srcport);
+  as = klen ? Curl_hash_pick(&asi->hash, key, klen) : NULL;
+  while(as) {
+    struct altsvc *n = as->next;
     if(as->expires < now) {
       /* an expired entry, remove */
-      Curl_llist_remove(&asi->list, e, NULL);
-      altsvc_free(as);
-      continue;
+      altsvc_remove(asi, as);
     }
-    if((as->src.alpnid == srcalpnid) &&
-       hostcompare(srchost, as->src.host) &&
-       (as->src.port == srcport) &&
-       (versions & as->dst.alpnid)) {
+    else if(versions & as->dst.alpnid) {
       /* match */
       *dstentry = as;
       return TRUE;
     }
+    as = n;
   }
   return FALSE;
 }
@@ -235,27 +235,21 @@ pathmatched:
 }
 
 /*
- * Return the top-level domain, for optimal hashing.
+ * The cookies are hashed on their full domain without a leading dot, so that
+ * a lookup only visits the buckets of the host name and its parent domains.
+ * Cookies without a domain and those for IP addresses share the bucket of
+ * the empty name.
  */
-static const char *get_top_domain(const char * const domain, size_t *outlen)
+static const char *cookie_hashkey(const char *domain, size_t *len)
 {
-  size_t len = 0;
-  const char *first = NULL, *last;
-
-  if(domain) {
-    len = strlen(domain);
-    last = memrchr(domain, '.', len);
-    if(last) {
-      first = memrchr(domain, '.', (last - domain));
-      if(first)
-        len -= (++first - domain);
-    }
+  if(!domain || Curl_host_is_ipnum(domain)) {
+    *len = 0;
+    return "";
   }
-
-  if(outlen)
-    *outlen = len;
-
-  return first? first: domain;
+  if(*domain == '.')
+    domain++;
+  *len = strlen(domain);
+  return domain;
 }
 
 /* Avoid C1001, an "internal error" with MSVC14 */
@@ -276,7 +270,7 @@ static size_t cookie_hash_domain(const char *domain, const size_t len)
     h ^= Curl_raw_toupper(*domain++);
   }
 
-  return (h % COOKIE_HASH_SIZE);
+  return h;
 }
 
 #if defined(_MSC_VER) && (_MSC_VER == 1900)
@@ -286,16 +280,41 @@ static size_t cookie_hash_domain(const char *domain, const size_t len)
 /*
  * Hash this domain.
  */
-static size_t cookiehash(const char * const domain)
+static size_t cookiehash(const struct CookieInfo *c, const char *domain)
 {
-  const char *top;
   size_t len;
+  const char *key = cookie_hashkey(domain, &len);
 
-  if(!domain || Curl_host_is_ipnum(domain))
-    return 0;
+  return cookie_hash_domain(key, len) & (c->hashsize - 1);
+}
 
-  top = get_top_domain(domain, &len);
-  return cookie_hash_domain(top, len);
+/*
+ * Double the number of hash buckets. If that fails, the chains just get
+ * longer.
+ */
+static void cookie_rehash(struct CookieInfo *c)
+{
+  struct Cookie **old = c->cookies;
+  unsigned int oldsize = c->hashsize;
+  unsigned int i;
+
+  c->cookies = calloc(oldsize * 2, sizeof(struct Cookie *));
+  if(!c->cookies) {
+    c->cookies = old;
+    return;
+  }
+  c->hashsize = oldsize * 2;
+  for(i = 0; i < oldsize; i++) {
+    struct Cookie *co = old[i];
+    while(co) {
+      struct Cookie *next = co->next;
+      size_t h = cookiehash(c, co->domain);
+      co->next = c->cookies[h];
+      c->cookies[h] = co;
+      co = next;
+    }
+  }
+  free(old);
 }
 
 /*
@@ -409,7 +428,7 @@ static void remove_expired(struct CookieInfo *cookies)
   else
     cookies->next_expiration = CURL_OFF_T_MAX;
 
-  for(i = 0; i < COOKIE_HASH_SIZE; i++) {
+  for(i = 0; i < cookies->hashsize; i++) {
     struct Cookie *pv = NULL;
     co = cookies->cookies[i];
     while(co) {
@@ -422,7 +441,15 @@ static void remove_expired(struct CookieInfo *cookies)
           pv->next = co->next;
         }
         cookies->numcookies--;
-        freecookie(co);
+        if(co->unsaved && co->injar && cookies->jarfile &&
+           !cookies->jarfull) {
+          /* the jar may have an earlier version of it, which this one
+             needs to be appended after */
+          co->next = cookies->removed;
+          cookies->removed = co;
+        }
+        else
+          freecookie(co);
       }
       else {
         /*
@@ -1025,10 +1052,14 @@ Curl_cookie_add(struct Curl_easy *data,
      c->newsession &&  /* clean session cookies */
      !co->expires) {   /* this is a session cookie since it doesn't expire! */
     freecookie(co);
+    /* the file has more than what's kept */
+    c->jarfull = TRUE;
     return NULL;
   }
 
   co->livecookie = c->running;
+  co->unsaved = c->running;
+  co->injar = !c->running;
   co->creationtime = ++c->lastct;
 
   /*
@@ -1068,7 +1099,7 @@ Curl_cookie_add(struct Curl_easy *data,
 #endif
 
   /* A non-secure cookie may not overlay an existing secure cookie. */
-  myhash = cookiehash(co->domain);
+  myhash = cookiehash(c, co->domain);
   clist = c->cookies[myhash];
   while(clist) {
     if(strcasecompare(clist->name, co->name)) {
@@ -1159,6 +1190,8 @@ Curl_cookie_add(struct Curl_easy *data,
 
     /* when replacing, creationtime is kept from old */
     co->creationtime = clist->creationtime;
+    if(clist->injar)
+      co->injar = TRUE;
 
     /* then free all the old pointers */
     free(clist->name);
@@ -1190,6 +1223,8 @@ Curl_cookie_add(struct Curl_easy *data,
     else
       c->cookies[myhash] = co;
     c->numcookies++; /* one more cookie in the jar */
+    if(c->numcookies > (long)c->hashsize * 2)
+      cookie_rehash(c);
   }
 
   /*
@@ -1234,6 +1269,10 @@ struct CookieInfo *Curl_cookie_init(struct Curl_easy *data,
     c->filename = strdup(file?file:"none"); /* copy the name just in case */
     if(!c->filename)
       goto fail; /* failed to get memory */
+    c->cookies = calloc(COOKIE_HASH_SIZE, sizeof(struct Cookie *));
+    if(!c->cookies)
+      goto fail;
+    c->hashsize = COOKIE_HASH_SIZE;
     /*
      * Initialize the next_expiration time to signal that we don't have enough
      * information yet.
@@ -1264,11 +1303,15 @@ struct CookieInfo *Curl_cookie_init(struct Curl_easy *data,
     if(fp) {
       char *lineptr;
       bool headerline;
+      long lines = 0;
+      /* the jar file can be appended to if it is all there is */
+      bool jar = handle && !c->numcookies && !c->jarfile && !c->jarfull;
 
       line = malloc(MAX_COOKIE_LINE);
       if(!line)
         goto fail;
       while(Curl_get_line(line, MAX_COOKIE_LINE, fp)) {
+        lines++;
         if(checkprefix("Set-Cookie:", line)) {
           /* This is a cookie line, get it! */
           lineptr = &line[11];
@@ -1291,6 +1334,19 @@ struct CookieInfo *Curl_cookie_init(struct Curl_easy *data,
        */
       remove_expired(c);
 
+      if(jar) {
+        struct_stat st;
+        if(!fstat(fileno(handle), &st)) {
+          c->jarfile = strdup(file);
+          c->jarsize = st.st_size;
+          c->jarmtime = st.st_mtime;
+          c->jarlines = lines;
+        }
+      }
+      else
+        /* cookies from more than one file */
+        c->jarfull = TRUE;
+
       if(handle)
         fclose(handle);
     }
@@ -1419,9 +1475,9 @@ struct Cookie *Curl_cookie_getlist(struct Curl_easy *data,
   struct Cookie *mainco = NULL;
   size_t matches = 0;
   bool is_ip;
-  const size_t myhash = cookiehash(host);
+  const char *dom;
 
-  if(!c || !c->cookies[myhash])
+  if(!c || !c->numcookies)
     return NULL; /* no cookie struct or no cookies in the struct */
 
   /* at first, remove expired cookies */
@@ -1430,54 +1486,67 @@ struct Cookie *Curl_cookie_getlist(struct Curl_easy *data,
   /* check if host is an IP(v4|v6) address */
   is_ip = Curl_host_is_ipnum(host);
 
-  co = c->cookies[myhash];
+  /* visit the bucket of the host name and those of its parent domains, or
+     only the one shared by all IP addresses */
+  for(dom = host; dom && (matches < MAX_COOKIE_SEND_AMOUNT);
+      dom = is_ip ? NULL : strchr(dom, '.')) {
+    if(*dom == '.')
+      dom++;
+    for(co = c->cookies[cookiehash(c, is_ip ? NULL : dom)]; co;
+        co = co->next) {
+      if(!is_ip &&
+         (!co->domain ||
+          !strcasecompare(co->domain + (co->domain[0] == '.'), dom)))
+        /* a cookie for another domain in the same bucket, or one for a parent
+           domain that is checked in its own */
+        continue;
 
-  while(co) {
-    /* if the cookie requires we're secure we must only continue if we are! */
-    if(co->secure?secure:TRUE) {
-
-      /* now check if the domain is correct */
-      if(!co->domain ||
-         (co->tailmatch && !is_ip &&
-          tailmatch(co->domain, strlen(co->domain), host)) ||
-         ((!co->tailmatch || is_ip) && strcasecompare(host, co->domain)) ) {
-        /*
-         * the right part of the host matches the domain stuff in the
-         * cookie data
-         */
+      /* if the cookie requires we're secure we must only continue if we
+         are! */
+      if(co->secure?secure:TRUE) {
 
-        /*
-         * now check the left part of the path with the cookies path
-         * requirement
-         */
-        if(!co->spath || pathmatch(co->spath, path) ) {
+        /* now check if the domain is correct */
+        if(!co->domain ||
+           (co->tailmatch && !is_ip &&
+            tailmatch(co->domain, strlen(co->domain), host)) ||
+           ((!co->tailmatch || is_ip) && strcasecompare(host, co->domain)) ) {
+          /*
+           * the right part of the host matches the domain stuff in the
+           * cookie data
+           */
 
           /*
-           * and now, we know this is a match and we should create an
-           * entry for the return-linked-list
+           * now check the left part of the path with the cookies path
+           * requirement
            */
+          if(!co->spath || pathmatch(co->spath, path) ) {
 
-          newco = dup_cookie(co);
-          if(newco) {
-            /* then modify our next */
-            newco->next = mainco;
+            /*
+             * and now, we know this is a match and we should create an
+             * entry for the return-linked-list
+             */
 
-            /* point the main to us */
-            mainco = newco;
+            newco = dup_cookie(co);
+            if(newco) {
+              /* then modify our next */
+              newco->next = mainco;
 
-            matches++;
-            if(matches >= MAX_COOKIE_SEND_AMOUNT) {
-              infof(data, "Included max number of cookies (%zu) in request!",
-                    matches);
-              break;
+              /* point the main to us */
+              mainco = newco;
+
+              matches++;
+              if(matches >= MAX_COOKIE_SEND_AMOUNT) {
+                infof(data, "Included max number of cookies (%zu) in request!",
+                      matches);
+                break;
+              }
             }
+            else
+              goto fail;
           }
-          else
-            goto fail;
         }
       }
     }
-    co = co->next;
   }
 
   if(matches) {
@@ -1529,11 +1598,12 @@ void Curl_cookie_clearall(struct CookieInfo *cookies)
 {
   if(cookies) {
     unsigned int i;
-    for(i = 0; i < COOKIE_HASH_SIZE; i++) {
+    for(i = 0; i < cookies->hashsize; i++) {
       Curl_cookie_freelist(cookies->cookies[i]);
       cookies->cookies[i] = NULL;
     }
     cookies->numcookies = 0;
+    cookies->jarfull = TRUE; /* the jar has to be written all over again */
   }
 }
 
@@ -1565,7 +1635,7 @@ void Curl_cookie_clearsess(struct CookieInfo *cookies)
   if(!cookies)
     return;
 
-  for(i = 0; i < COOKIE_HASH_SIZE; i++) {
+  for(i = 0; i < cookies->hashsize; i++) {
     if(!cookies->cookies[i])
       continue;
 
@@ -1584,6 +1654,7 @@ void Curl_cookie_clearsess(struct CookieInfo *cookies)
 
         freecookie(curr);
         cookies->numcookies--;
+        cookies->jarfull = TRUE;
       }
       else
         prev = curr;
@@ -1603,8 +1674,11 @@ void Curl_cookie_cleanup(struct CookieInfo *c)
   if(c) {
     unsigned int i;
     free(c->filename);
-    for(i = 0; i < COOKIE_HASH_SIZE; i++)
+    free(c->jarfile);
+    for(i = 0; i < c->hashsize; i++)
       Curl_cookie_freelist(c->cookies[i]);
+    free(c->cookies);
+    Curl_cookie_freelist(c->removed);
     free(c); /* free the base struct as well */
   }
 }
@@ -1642,6 +1716,137 @@ static char *get_netscape_format(const struct Cookie *co)
     co->value?co->value:"");
 }
 
+/*
+ * cookie_jar_written()
+ *
+ * Remembers that 'filename' now holds all the cookies with a domain, in
+ * 'lines' lines, so that the next save can append to it.
+ */
+static void cookie_jar_written(struct CookieInfo *c, const char *filename,
+                               long lines)
+{
+  struct Cookie *co;
+  struct_stat st;
+  unsigned int i;
+
+  Curl_cookie_freelist(c->removed);
+  c->removed = NULL;
+  for(i = 0; i < c->hashsize; i++)
+    for(co = c->cookies[i]; co; co = co->next) {
+      co->unsaved = FALSE;
+      if(co->domain)
+        co->injar = TRUE;
+    }
+
+  if(!c->jarfile || strcmp(c->jarfile, filename)) {
+    free(c->jarfile);
+    c->jarfile = strdup(filename);
+  }
+  if(c->jarfile && !stat(filename, &st)) {
+    c->jarsize = st.st_size;
+    c->jarmtime = st.st_mtime;
+    c->jarlines = lines;
+    c->jarfull = FALSE;
+  }
+  else
+    c->jarfull = TRUE;
+}
+
+/*
+ * cookie_append()
+ *
+ * Appends the cookies set or removed since the jar was last written to the
+ * end of it. When the jar is read back, later lines replace earlier ones.
+ *
+ * Returns CURLE_AGAIN when the file instead needs to be written in full.
+ */
+static CURLcode cookie_append(struct CookieInfo *c, const char *filename)
+{
+  struct Cookie **array;
+  struct Cookie *co;
+  struct_stat st;
+  size_t pending = 0;
+  size_t n = 0;
+  unsigned int i;
+  long min = COOKIE_JOURNAL_MIN;
+  FILE *out;
+  CURLcode error = CURLE_OK;
+
+#ifdef DEBUGBUILD
+  {
+    char *p = getenv("CURL_COOKIE_JOURNAL");
+    if(p)
+      min = atol(p);
+  }
+#endif
+
+  if(!c->jarfile || c->jarfull || (c->jarlines < min) ||
+     strcmp(c->jarfile, filename))
+    return CURLE_AGAIN;
+
+  if(stat(filename, &st) || (st.st_size != c->jarsize) ||
+     (st.st_mtime != c->jarmtime))
+    /* modified by someone else */
+    return CURLE_AGAIN;
+
+  for(i = 0; i < c->hashsize; i++)
+    for(co = c->cookies[i]; co; co = co->next)
+      if(co->unsaved && co->domain)
+        pending++;
+  for(co = c->removed; co; co = co->next)
+    pending++;
+
+  if(!pending)
+    /* the jar is up to date */
+    return CURLE_OK;
+
+  if(c->jarlines + (long)pending > 2 * (c->numcookies + 4))
+    /* more than half of it would be outdated, write it all again */
+    return CURLE_AGAIN;
+
+  array = malloc(sizeof(struct Cookie *) * pending);
+  if(!array)
+    return CURLE_OUT_OF_MEMORY;
+
+  for(i = 0; i < c->hashsize; i++)
+    for(co = c->cookies[i]; co; co = co->next)
+      if(co->unsaved && co->domain)
+        array[n++] = co;
+  for(co = c->removed; co; co = co->next)
+    array[n++] = co;
+
+  /* a removed cookie was always created before one that replaces it, so
+     write them oldest first: from the end of the newest first order */
+  qsort(array, n, sizeof(struct Cookie *), cookie_sort_ct);
+
+  out = fopen(filename, FOPEN_APPENDTEXT);
+  if(!out) {
+    free(array);
+    return CURLE_WRITE_ERROR;
+  }
+  while(n--) {
+    char *format_ptr = get_netscape_format(array[n]);
+    if(!format_ptr) {
+      error = CURLE_OUT_OF_MEMORY;
+      break;
+    }
+    fprintf(out, "%s\n", format_ptr);
+    free(format_ptr);
+  }
+  free(array);
+
+  if(fclose(out) && !error)
+    error = CURLE_WRITE_ERROR;
+  if(error) {
+    /* unknown what made it there */
+    c->jarfull = TRUE;
+    return error;
+  }
+
+  cookie_jar_written(c, filename, c->jarlines + (long)pending);
+  return CURLE_OK;
+}
+
 /*
  * cookie_output()
  *
@@ -1658,6 +1863,7 @@ static CURLcode cookie_output(struct Curl_easy *data,
   bool use_stdout = FALSE;
   char *tempstore = NULL;
   CURLcode error = CURLE_OK;
+  size_t nvalid = 0;
 
   if(!c)
     /* no cookie engine alive */
@@ -1672,6 +1878,9 @@ static CURLcode cookie_output(struct Curl_easy *data,
     use_stdout = TRUE;
   }
   else {
+    error = cookie_append(c, filename);
+    if(error != CURLE_AGAIN)
+      return error;
     error = Curl_fopen(data, filename, &out, &tempstore);
     if(error)
       goto error;
@@ -1684,7 +1893,6 @@ static CURLcode cookie_output(struct Curl_easy *data,
 
   if(c->numcookies) {
     unsigned int i;
-    size_t nvalid = 0;
     struct Cookie **array;
 
     array = calloc(1, sizeof(struct Cookie *) * c->numcookies);
@@ -1694,7 +1902,7 @@ static CURLcode cookie_output(struct Curl_easy *data,
     }
 
     /* only sort the cookies with a domain property */
-    for(i = 0; i < COOKIE_HASH_SIZE; i++) {
+    for(i = 0; i < c->hashsize; i++) {
       for(co = c->cookies[i]; co; co = co->next) {
         if(!co->domain)
           continue;
@@ -1726,6 +1934,8 @@ static CURLcode cookie_output(struct Curl_easy *data,
       error = CURLE_WRITE_ERROR;
       goto error;
     }
+    /* the header is four lines */
+    cookie_jar_written(c, filename, (long)nvalid + 4);
   }
 
   /*
@@ -1754,7 +1964,7 @@ static struct curl_slist *cookie_list(struct Curl_easy *data)
   if(!data->cookies || (data->cookies->numcookies == 0))
     return NULL;
 
-  for(i = 0; i < COOKIE_HASH_SIZE; i++) {
+  for(i = 0; i < data->cookies->hashsize; i++) {
     for(c = data->cookies->cookies[i]; c; c = c->next) {
       if(!c->domain)
         continue;
@@ -45,6 +45,8 @@ struct Cookie {
   bool secure;       /* whether the 'secure' keyword was used */
   bool livecookie;   /* updated from a server, not a stored file */
   bool httponly;     /* true if the httponly directive is present */
+  bool unsaved;      /* set or changed since the jar file was written */
+  bool injar;        /* some version of it is in the jar file */
   int creationtime;  /* time when the cookie was written */
   unsigned char prefix; /* bitmap fields indicating which prefix are set */
 };
@@ -56,17 +58,34 @@ struct Cookie {
 #define COOKIE_PREFIX__SECURE (1<<0)
 #define COOKIE_PREFIX__HOST (1<<1)
 
+/* initial number of hash buckets, doubled as the jar grows */
 #define COOKIE_HASH_SIZE 256
 
+/* The jar file is only appended to when it holds at least this many lines,
+   smaller ones are cheap enough to write again as a whole */
+#define COOKIE_JOURNAL_MIN 1000
+
 struct CookieInfo {
-  /* linked list of cookies we know of */
-  struct Cookie *cookies[COOKIE_HASH_SIZE];
+  /* hash of the cookies we know of, on their domain */
+  struct Cookie **cookies;
+  unsigned int hashsize; /* number of buckets in 'cookies', a power of 2 */
   char *filename;  /* file we read from/write to */
   long numcookies; /* number of cookies in the "jar" */
   bool running;    /* state info, for cookie adding information */
   bool newsession; /* new session, discard session cookies on load */
   int lastct;      /* last creation-time used in the jar */
   curl_off_t next_expiration; /* the next time at which expiration happens */
+
+  /* The jar file the cookies were last read from or written to. As long as
+     nobody else changes it, the unsaved cookies can be appended to it: when
+     the file is read, a later line replaces an earlier one for the same
+     cookie. */
+  char *jarfile;
+  curl_off_t jarsize;  /* its size ... */
+  time_t jarmtime;     /* ... and modification time back then */
+  long jarlines;       /* number of lines in it */
+  struct Cookie *removed; /* unsaved cookies since expired, for the jar */
+  bool jarfull;        /* the jar must be written as a whole */
 };
 
 /* The maximum sizes we accept for cookies. RFC 6265 section 6.1 says
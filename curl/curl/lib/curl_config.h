@@ -188,6 +188,9 @@
 /* Define to 1 if you have the connect function. */
 #define HAVE_CONNECT 1
 
+/* Define to 1 if you have the `copy_file_range' function. */
+/* #undef HAVE_COPY_FILE_RANGE */
+
 /* Define to 1 if you have the <crypto.h> header file. */
 /* #undef HAVE_CRYPTO_H */
 
@@ -201,6 +204,9 @@
 /* Define to 1 if you have the <dlfcn.h> header file. */
 #define HAVE_DLFCN_H 1
 
+/* Define to 1 if you have the `epoll_create1' function. */
+/* #undef HAVE_EPOLL_CREATE1 */
+
 /* Define to 1 if you have the <err.h> header file. */
 /* #undef HAVE_ERR_H */
 
@@ -358,6 +364,9 @@
 /* Define to 1 if you have the <io.h> header file. */
 /* #undef HAVE_IO_H */
 
+/* Define to 1 if you have the `kqueue' function. */
+#define HAVE_KQUEUE 1
+
 /* Define to 1 if you have the lber.h header file. */
 // #define HAVE_LBER_H 1
 
@@ -642,6 +651,12 @@
 /* Define to 1 if suseconds_t is an available type. */
 #define HAVE_SUSECONDS_T 1
 
+/* Define to 1 if you have the <sys/epoll.h> header file. */
+/* #undef HAVE_SYS_EPOLL_H */
+
+/* Define to 1 if you have the <sys/event.h> header file. */
+#define HAVE_SYS_EVENT_H 1
+
 /* Define to 1 if you have the <sys/filio.h> header file. */
 #define HAVE_SYS_FILIO_H 1
 
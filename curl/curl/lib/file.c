@@ -22,6 +22,10 @@
  *
  ***************************************************************************/
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for copy_file_range() */
+#endif
+
 #include "curl_setup.h"
 
 #ifndef CURL_DISABLE_FILE
@@ -81,6 +85,11 @@
 #  define open_readonly(p,f) open((p),(f))
 #endif
 
+#ifdef HAVE_COPY_FILE_RANGE
+/* the most to copy in the kernel between two progress updates */
+#define FILE_COPY_CHUNK (1024*1024)
+#endif
+
 /*
  * Forward declarations.
  */
@@ -283,6 +292,52 @@ static CURLcode file_disconnect(struct Curl_easy *data,
 #define DIRSEP '/'
 #endif
 
+#ifdef HAVE_COPY_FILE_RANGE
+/*
+ * file_copy() lets the kernel move up to 'size' bytes, or everything up to
+ * the end of file when 'size' is negative, from 'infd' to 'outfd' without
+ * passing them through our buffer. A NULL offset pointer uses and advances
+ * the file offset of that descriptor. It quietly stops at the first call
+ * that copies nothing or fails, as the regular read and write loop then
+ * continues from where the copy ended and reports any real error.
+ */
+static CURLcode file_copy(struct Curl_easy *data,
+                          int infd, off_t *inoff,
+                          int outfd, off_t *outoff,
+                          curl_off_t size, curl_off_t *bytecount,
+                          bool upload)
+{
+  CURLcode result = CURLE_OK;
+
+  while(!result && size) {
+    size_t len = FILE_COPY_CHUNK;
+    ssize_t ncopy;
+
+    if((size > 0) && (size < FILE_COPY_CHUNK))
+      len = curlx_sotouz(size);
+
+    ncopy = copy_file_range(infd, inoff, outfd, outoff, len, 0);
+    if(ncopy <= 0)
+      break;
+
+    if(size > 0)
+      size -= ncopy;
+    *bytecount += ncopy;
+
+    if(upload)
+      Curl_pgrsSetUploadCounter(data, *bytecount);
+    else
+      Curl_pgrsSetDownloadCounter(data, *bytecount);
+
+    if(Curl_pgrsUpdate(data))
+      result = CURLE_ABORTED_BY_CALLBACK;
+    else
+      result = Curl_speedcheck(data, Curl_now());
+  }
+  return result;
+}
+#endif
+
 static CURLcode file_upload(struct Curl_easy *data)
 {
   struct FILEPROTO *file = data->req.p.file;
@@ -338,6 +393,25 @@ static CURLcode file_upload(struct Curl_easy *data)
     data->state.resume_from = (curl_off_t)file_stat.st_size;
   }
 
+#ifdef HAVE_COPY_FILE_RANGE
+  /* the default read callback reading a plain file can be bypassed */
+  if(!data->state.resume_from && data->state.in &&
+     (data->state.fread_func == (curl_read_callback)fread)) {
+    FILE *in = data->state.in;
+    if(!fstat(fileno(in), &file_stat) && S_ISREG(file_stat.st_mode)) {
+      /* start where the stream is, including what stdio has buffered */
+      off_t inoff = ftello(in);
+      if(inoff >= 0) {
+        result = file_copy(data, fileno(in), &inoff, fd, NULL, -1,
+                           &bytecount, TRUE);
+        /* move the stream past the copied data, dropping its buffer */
+        if(fseeko(in, inoff, SEEK_SET) && !result)
+          result = CURLE_READ_ERROR;
+      }
+    }
+  }
+#endif
+
   while(!result) {
     size_t nread;
     ssize_t nwrite;
@@ -543,6 +617,28 @@ static CURLcode file_do(struct Curl_easy *data, bool *done)
 
   Curl_pgrsTime(data, TIMER_STARTTRANSFER);
 
+#ifdef HAVE_COPY_FILE_RANGE
+  /* the default write callback storing into a plain file can be bypassed */
+  if(size_known && S_ISREG(statbuf.st_mode) && data->set.out &&
+     (data->set.fwrite_func == (curl_write_callback)fwrite) &&
+     !(data->req.keepon & KEEP_RECV_PAUSE)) {
+    FILE *out = data->set.out;
+    struct_stat outstat;
+    if(!fflush(out) && !fstat(fileno(out), &outstat) &&
+       S_ISREG(outstat.st_mode)) {
+      off_t outoff = ftello(out);
+      if(outoff >= 0) {
+        result = file_copy(data, fd, NULL, fileno(out), &outoff,
+                           expected_size, &bytecount, FALSE);
+        expected_size -= bytecount;
+        /* let the stream continue after the copied data */
+        if(fseeko(out, outoff, SEEK_SET) && !result)
+          result = CURLE_WRITE_ERROR;
+      }
+    }
+  }
+#endif
+
   while(!result) {
     ssize_t nread;
     /* Don't fill a whole buffer if we want less than all data */
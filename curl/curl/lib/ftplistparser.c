@@ -55,97 +55,7 @@
 /* The last #include file should be: */
 #include "memdebug.h"
 
-/* allocs buffer which will contain one line of LIST command response */
-#define FTP_BUFFER_ALLOCSIZE 160
-
-typedef enum {
-  PL_UNIX_TOTALSIZE = 0,
-  PL_UNIX_FILETYPE,
-  PL_UNIX_PERMISSION,
-  PL_UNIX_HLINKS,
-  PL_UNIX_USER,
-  PL_UNIX_GROUP,
-  PL_UNIX_SIZE,
-  PL_UNIX_TIME,
-  PL_UNIX_FILENAME,
-  PL_UNIX_SYMLINK
-} pl_unix_mainstate;
-
-typedef union {
-  enum {
-    PL_UNIX_TOTALSIZE_INIT = 0,
-    PL_UNIX_TOTALSIZE_READING
-  } total_dirsize;
-
-  enum {
-    PL_UNIX_HLINKS_PRESPACE = 0,
-    PL_UNIX_HLINKS_NUMBER
-  } hlinks;
-
-  enum {
-    PL_UNIX_USER_PRESPACE = 0,
-    PL_UNIX_USER_PARSING
-  } user;
-
-  enum {
-    PL_UNIX_GROUP_PRESPACE = 0,
-    PL_UNIX_GROUP_NAME
-  } group;
-
-  enum {
-    PL_UNIX_SIZE_PRESPACE = 0,
-    PL_UNIX_SIZE_NUMBER
-  } size;
-
-  enum {
-    PL_UNIX_TIME_PREPART1 = 0,
-    PL_UNIX_TIME_PART1,
-    PL_UNIX_TIME_PREPART2,
-    PL_UNIX_TIME_PART2,
-    PL_UNIX_TIME_PREPART3,
-    PL_UNIX_TIME_PART3
-  } time;
-
-  enum {
-    PL_UNIX_FILENAME_PRESPACE = 0,
-    PL_UNIX_FILENAME_NAME,
-    PL_UNIX_FILENAME_WINDOWSEOL
-  } filename;
-
-  enum {
-    PL_UNIX_SYMLINK_PRESPACE = 0,
-    PL_UNIX_SYMLINK_NAME,
-    PL_UNIX_SYMLINK_PRETARGET1,
-    PL_UNIX_SYMLINK_PRETARGET2,
-    PL_UNIX_SYMLINK_PRETARGET3,
-    PL_UNIX_SYMLINK_PRETARGET4,
-    PL_UNIX_SYMLINK_TARGET,
-    PL_UNIX_SYMLINK_WINDOWSEOL
-  } symlink;
-} pl_unix_substate;
-
-typedef enum {
-  PL_WINNT_DATE = 0,
-  PL_WINNT_TIME,
-  PL_WINNT_DIRORSIZE,
-  PL_WINNT_FILENAME
-} pl_winNT_mainstate;
-
-typedef union {
-  enum {
-    PL_WINNT_TIME_PRESPACE = 0,
-    PL_WINNT_TIME_TIME
-  } time;
-  enum {
-    PL_WINNT_DIRORSIZE_PRESPACE = 0,
-    PL_WINNT_DIRORSIZE_CONTENT
-  } dirorsize;
-  enum {
-    PL_WINNT_FILENAME_PRESPACE = 0,
-    PL_WINNT_FILENAME_CONTENT,
-    PL_WINNT_FILENAME_WINEOL
-  } filename;
-} pl_winNT_substate;
+#define MAX_FTPLIST_BUFFER 10000 /* arbitrarily set */
 
 /* This struct is used in wildcard downloading - for parsing LIST response */
 struct ftp_parselist_data {
@@ -155,22 +65,11 @@ struct ftp_parselist_data {
     OS_TYPE_WIN_NT
   } os_type;
 
-  union {
-    struct {
-      pl_unix_mainstate main;
-      pl_unix_substate sub;
-    } UNIX;
-
-    struct {
-      pl_winNT_mainstate main;
-      pl_winNT_substate sub;
-    } NT;
-  } state;
-
   CURLcode error;
+  /* the line being received, or a spare entry kept from a line that did
+     not match so that the next one can reuse its allocations */
   struct fileinfo *file_data;
-  unsigned int item_length;
-  size_t item_offset;
+  bool firstline_done; /* a UNIX "total" line may only be the first one */
   struct {
     size_t filename;
     size_t user;
@@ -307,6 +206,222 @@ static unsigned int ftp_pl_get_permission(const char *str)
   return permissions;
 }
 
+
+/* skip the space separators, which are never tabs in a UNIX listing */
+static char *ftp_pl_skipspace(char *p)
+{
+  while(*p == ' ')
+    p++;
+  return p;
+}
+
+/*
+ * Parse one complete line of a UNIX style listing, without its line ending,
+ * that is stored in the buffer of 'infop'. The fields are terminated in
+ * place and their positions are stored in the parser offsets.
+ */
+static CURLcode ftp_pl_parse_unix(struct ftp_parselist_data *parser,
+                                  struct fileinfo *infop)
+{
+  struct curl_fileinfo *finfo = &infop->info;
+  char *mem = Curl_dyn_ptr(&infop->buf);
+  char *p;
+  char *endp;
+  unsigned int perm;
+  long int hlinks;
+  curl_off_t fsize;
+  int i;
+
+  switch(mem[0]) {
+  case '-':
+    finfo->filetype = CURLFILETYPE_FILE;
+    break;
+  case 'd':
+    finfo->filetype = CURLFILETYPE_DIRECTORY;
+    break;
+  case 'l':
+    finfo->filetype = CURLFILETYPE_SYMLINK;
+    break;
+  case 'p':
+    finfo->filetype = CURLFILETYPE_NAMEDPIPE;
+    break;
+  case 's':
+    finfo->filetype = CURLFILETYPE_SOCKET;
+    break;
+  case 'c':
+    finfo->filetype = CURLFILETYPE_DEVICE_CHAR;
+    break;
+  case 'b':
+    finfo->filetype = CURLFILETYPE_DEVICE_BLOCK;
+    break;
+  case 'D':
+    finfo->filetype = CURLFILETYPE_DOOR;
+    break;
+  default:
+    return CURLE_FTP_BAD_FILE_LIST;
+  }
+
+  /* nine permission letters followed by a space */
+  for(i = 1; i <= 9; i++) {
+    if(!mem[i] || !strchr("rwx-tTsS", mem[i]))
+      return CURLE_FTP_BAD_FILE_LIST;
+  }
+  if(mem[10] != ' ')
+    return CURLE_FTP_BAD_FILE_LIST;
+  mem[10] = 0; /* terminate permissions */
+  perm = ftp_pl_get_permission(mem + 1);
+  if(perm & FTP_LP_MALFORMATED_PERM)
+    return CURLE_FTP_BAD_FILE_LIST;
+  finfo->flags |= CURLFINFOFLAG_KNOWN_PERM;
+  finfo->perm = perm;
+  parser->offsets.perm = 1;
+
+  /* hard link count */
+  p = ftp_pl_skipspace(mem + 11);
+  if(!ISDIGIT(*p))
+    return CURLE_FTP_BAD_FILE_LIST;
+  hlinks = strtol(p, &endp, 10);
+  if(*endp != ' ')
+    return CURLE_FTP_BAD_FILE_LIST;
+  if(hlinks != LONG_MAX && hlinks != LONG_MIN) {
+    finfo->flags |= CURLFINFOFLAG_KNOWN_HLINKCOUNT;
+    finfo->hardlinks = hlinks;
+  }
+
+  /* user and group are whatever is found up to the next space */
+  p = ftp_pl_skipspace(endp);
+  endp = strchr(p, ' ');
+  if(!*p || !endp)
+    return CURLE_FTP_BAD_FILE_LIST;
+  *endp = 0;
+  parser->offsets.user = p - mem;
+
+  p = ftp_pl_skipspace(endp + 1);
+  endp = strchr(p, ' ');
+  if(!*p || !endp)
+    return CURLE_FTP_BAD_FILE_LIST;
+  *endp = 0;
+  parser->offsets.group = p - mem;
+
+  /* size */
+  p = ftp_pl_skipspace(endp + 1);
+  if(!ISDIGIT(*p) || curlx_strtoofft(p, &endp, 10, &fsize) ||
+     (*endp != ' '))
+    return CURLE_FTP_BAD_FILE_LIST;
+  if(fsize != CURL_OFF_T_MAX && fsize != CURL_OFF_T_MIN) {
+    finfo->flags |= CURLFINFOFLAG_KNOWN_SIZE;
+    finfo->size = fsize;
+  }
+
+  /* the time is kept as a string of three parts, like "Jan 29 23:32" */
+  p = ftp_pl_skipspace(endp);
+  parser->offsets.time = p - mem;
+  for(i = 0; i < 3; i++) {
+    p = ftp_pl_skipspace(p);
+    if(!ISALNUM(*p))
+      return CURLE_FTP_BAD_FILE_LIST;
+    p++;
+    while(ISALNUM(*p) || (*p == '.') || ((i == 2) && (*p == ':')))
+      p++;
+    if(*p != ' ')
+      return CURLE_FTP_BAD_FILE_LIST;
+  }
+  *p = 0;
+
+  p = ftp_pl_skipspace(p + 1);
+  if(!*p)
+    return CURLE_FTP_BAD_FILE_LIST;
+  parser->offsets.filename = p - mem;
+
+  if(finfo->filetype == CURLFILETYPE_SYMLINK) {
+    /* "name -> target", the first " -> " ends the name */
+    char *arrow = NULL;
+    for(endp = p + 1; *endp && (*endp != '\r'); endp++) {
+      if((endp[0] == ' ') && (endp[1] == '-') && (endp[2] == '>') &&
+         (endp[3] == ' ')) {
+        arrow = endp;
+        break;
+      }
+    }
+    if(!arrow || !arrow[4])
+      return CURLE_FTP_BAD_FILE_LIST;
+    *arrow = 0;
+    p = arrow + 4;
+    parser->offsets.symlink_target = p - mem;
+  }
+
+  /* a CR is only allowed as part of the line ending */
+  if(strchr(p, '\r'))
+    return CURLE_FTP_BAD_FILE_LIST;
+
+  return CURLE_OK;
+}
+
+/*
+ * Parse one complete line of a DOS style listing, without its line ending,
+ * that is stored in the buffer of 'infop'.
+ */
+static CURLcode ftp_pl_parse_winnt(struct ftp_parselist_data *parser,
+                                   struct fileinfo *infop)
+{
+  struct curl_fileinfo *finfo = &infop->info;
+  char *mem = Curl_dyn_ptr(&infop->buf);
+  char *p;
+  char *size;
+  int i;
+
+  /* date, like "01-29-97", followed by a space */
+  for(i = 0; i < 8; i++) {
+    if(!mem[i] || !strchr("0123456789-", mem[i]))
+      return CURLE_FTP_BAD_FILE_LIST;
+  }
+  if(mem[8] != ' ')
+    return CURLE_FTP_BAD_FILE_LIST;
+
+  /* the time string holds both the date and the time */
+  p = mem + 9;
+  while(ISBLANK(*p))
+    p++;
+  if(!*p)
+    return CURLE_FTP_BAD_FILE_LIST;
+  for(p++; *p != ' '; p++) {
+    if(!*p || !strchr("APM0123456789:", *p))
+      return CURLE_FTP_BAD_FILE_LIST;
+  }
+  *p = 0;
+  parser->offsets.time = 0;
+
+  /* "<DIR>" or the size */
+  size = ftp_pl_skipspace(p + 1);
+  p = strchr(size, ' ');
+  if(!*size || !p)
+    return CURLE_FTP_BAD_FILE_LIST;
+  *p = 0;
+  if(!strcmp("<DIR>", size)) {
+    finfo->filetype = CURLFILETYPE_DIRECTORY;
+    finfo->size = 0;
+  }
+  else {
+    char *endptr;
+    if(curlx_strtoofft(size, &endptr, 10, &finfo->size))
+      return CURLE_FTP_BAD_FILE_LIST;
+    finfo->filetype = CURLFILETYPE_FILE;
+  }
+  finfo->flags |= CURLFINFOFLAG_KNOWN_SIZE;
+
+  p = ftp_pl_skipspace(p + 1);
+  if(!*p || strchr(p, '\r'))
+    return CURLE_FTP_BAD_FILE_LIST;
+  parser->offsets.filename = p - mem;
+
+  return CURLE_OK;
+}
+
+/*
+ * Hand a parsed entry to the pattern matcher. A matching entry is appended
+ * to the file list, which then owns it. Any other entry is cleared and kept
+ * as the parser's spare for the next line.
+ */
 static CURLcode ftp_pl_insert_finfo(struct Curl_easy *data,
                                     struct fileinfo *infop)
 {
@@ -353,16 +468,60 @@ static CURLcode ftp_pl_insert_finfo(struct Curl_easy *data,
 
   if(add) {
     Curl_llist_insert_next(llist, llist->tail, finfo, &infop->list);
+    parser->file_data = NULL;
   }
   else {
-    Curl_fileinfo_cleanup(infop);
+    memset(finfo, 0, sizeof(*finfo));
+    Curl_dyn_reset(&infop->buf);
   }
 
-  ftpwc->parser->file_data = NULL;
   return CURLE_OK;
 }
 
-#define MAX_FTPLIST_BUFFER 10000 /* arbitrarily set */
+/* Parse the complete line held by the parser's current entry */
+static CURLcode ftp_pl_parse_line(struct Curl_easy *data,
+                                  struct ftp_parselist_data *parser)
+{
+  struct fileinfo *infop = parser->file_data;
+  size_t len = Curl_dyn_len(&infop->buf);
+  char *mem = Curl_dyn_ptr(&infop->buf);
+  CURLcode result;
+
+  /* drop the CR of a CRLF line ending */
+  if(len && (mem[len - 1] == '\r'))
+    Curl_dyn_setlen(&infop->buf, --len);
+  if(!len)
+    return CURLE_FTP_BAD_FILE_LIST;
+
+  memset(&parser->offsets, 0, sizeof(parser->offsets));
+
+  if(parser->os_type == OS_TYPE_UNIX) {
+    if(!parser->firstline_done && (mem[0] == 't')) {
+      char *endptr = mem + 6;
+      parser->firstline_done = TRUE;
+      if(strncmp("total ", mem, 6))
+        return CURLE_FTP_BAD_FILE_LIST;
+      /* here we can deal with directory size, pass the leading
+         whitespace and then the digits */
+      while(ISBLANK(*endptr))
+        endptr++;
+      while(ISDIGIT(*endptr))
+        endptr++;
+      if(*endptr)
+        return CURLE_FTP_BAD_FILE_LIST;
+      Curl_dyn_reset(&infop->buf);
+      return CURLE_OK;
+    }
+    result = ftp_pl_parse_unix(parser, infop);
+  }
+  else
+    result = ftp_pl_parse_winnt(parser, infop);
+  parser->firstline_done = TRUE;
+
+  if(!result)
+    result = ftp_pl_insert_finfo(data, infop);
+  return result;
+}
 
 size_t Curl_ftp_parselist(char *buffer, size_t size, size_t nmemb,
                           void *connptr)
@@ -371,8 +530,6 @@ size_t Curl_ftp_parselist(char *buffer, size_t size, size_t nmemb,
   struct Curl_easy *data = (struct Curl_easy *)connptr;
   struct ftp_wc *ftpwc = data->wildcard->ftpwc;
   struct ftp_parselist_data *parser = ftpwc->parser;
-  size_t i = 0;
-  CURLcode result;
   size_t retsize = bufflen;
 
   if(parser->error) { /* error in previous call */
@@ -390,643 +547,33 @@ size_t Curl_ftp_parselist(char *buffer, size_t size, size_t nmemb,
     parser->os_type = ISDIGIT(buffer[0]) ? OS_TYPE_WIN_NT : OS_TYPE_UNIX;
   }
 
-  while(i < bufflen) { /* FSM */
-    char *mem;
-    size_t len; /* number of bytes of data in the dynbuf */
-    char c = buffer[i];
-    struct fileinfo *infop;
-    struct curl_fileinfo *finfo;
-    if(!parser->file_data) { /* tmp file data is not allocated yet */
+  /* collect the data line by line, parsing each line once it is complete */
+  while(bufflen) {
+    char *eol = memchr(buffer, '\n', bufflen);
+    size_t len = eol ? (size_t)(eol - buffer) : bufflen;
+
+    if(!parser->file_data) { /* no spare entry to reuse */
       parser->file_data = Curl_fileinfo_alloc();
       if(!parser->file_data) {
         parser->error = CURLE_OUT_OF_MEMORY;
         goto fail;
       }
-      parser->item_offset = 0;
-      parser->item_length = 0;
       Curl_dyn_init(&parser->file_data->buf, MAX_FTPLIST_BUFFER);
     }
 
-    infop = parser->file_data;
-    finfo = &infop->info;
-
-    if(Curl_dyn_addn(&infop->buf, &c, 1)) {
+    if(len && Curl_dyn_addn(&parser->file_data->buf, buffer, len)) {
       parser->error = CURLE_OUT_OF_MEMORY;
       goto fail;
     }
-    len = Curl_dyn_len(&infop->buf);
-    mem = Curl_dyn_ptr(&infop->buf);
-
-    switch(parser->os_type) {
-    case OS_TYPE_UNIX:
-      switch(parser->state.UNIX.main) {
-      case PL_UNIX_TOTALSIZE:
-        switch(parser->state.UNIX.sub.total_dirsize) {
-        case PL_UNIX_TOTALSIZE_INIT:
-          if(c == 't') {
-            parser->state.UNIX.sub.total_dirsize = PL_UNIX_TOTALSIZE_READING;
-            parser->item_length++;
-          }
-          else {
-            parser->state.UNIX.main = PL_UNIX_FILETYPE;
-            /* start FSM again not considering size of directory */
-            Curl_dyn_reset(&infop->buf);
-            continue;
-          }
-          break;
-        case PL_UNIX_TOTALSIZE_READING:
-          parser->item_length++;
-          if(c == '\r') {
-            parser->item_length--;
-            Curl_dyn_setlen(&infop->buf, --len);
-          }
-          else if(c == '\n') {
-            mem[parser->item_length - 1] = 0;
-            if(!strncmp("total ", mem, 6)) {
-              char *endptr = mem + 6;
-              /* here we can deal with directory size, pass the leading
-                 whitespace and then the digits */
-              while(ISBLANK(*endptr))
-                endptr++;
-              while(ISDIGIT(*endptr))
-                endptr++;
-              if(*endptr) {
-                parser->error = CURLE_FTP_BAD_FILE_LIST;
-                goto fail;
-              }
-              parser->state.UNIX.main = PL_UNIX_FILETYPE;
-              Curl_dyn_reset(&infop->buf);
-            }
-            else {
-              parser->error = CURLE_FTP_BAD_FILE_LIST;
-              goto fail;
-            }
-          }
-          break;
-        }
-        break;
-      case PL_UNIX_FILETYPE:
-        switch(c) {
-        case '-':
-          finfo->filetype = CURLFILETYPE_FILE;
-          break;
-        case 'd':
-          finfo->filetype = CURLFILETYPE_DIRECTORY;
-          break;
-        case 'l':
-          finfo->filetype = CURLFILETYPE_SYMLINK;
-          break;
-        case 'p':
-          finfo->filetype = CURLFILETYPE_NAMEDPIPE;
-          break;
-        case 's':
-          finfo->filetype = CURLFILETYPE_SOCKET;
-          break;
-        case 'c':
-          finfo->filetype = CURLFILETYPE_DEVICE_CHAR;
-          break;
-        case 'b':
-          finfo->filetype = CURLFILETYPE_DEVICE_BLOCK;
-          break;
-        case 'D':
-          finfo->filetype = CURLFILETYPE_DOOR;
-          break;
-        default:
-          parser->error = CURLE_FTP_BAD_FILE_LIST;
-          goto fail;
-        }
-        parser->state.UNIX.main = PL_UNIX_PERMISSION;
-        parser->item_length = 0;
-        parser->item_offset = 1;
-        break;
-      case PL_UNIX_PERMISSION:
-        parser->item_length++;
-        if(parser->item_length <= 9) {
-          if(!strchr("rwx-tTsS", c)) {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-        }
-        else if(parser->item_length == 10) {
-          unsigned int perm;
-          if(c != ' ') {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          mem[10] = 0; /* terminate permissions */
-          perm = ftp_pl_get_permission(mem + parser->item_offset);
-          if(perm & FTP_LP_MALFORMATED_PERM) {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          parser->file_data->info.flags |= CURLFINFOFLAG_KNOWN_PERM;
-          parser->file_data->info.perm = perm;
-          parser->offsets.perm = parser->item_offset;
-
-          parser->item_length = 0;
-          parser->state.UNIX.main = PL_UNIX_HLINKS;
-          parser->state.UNIX.sub.hlinks = PL_UNIX_HLINKS_PRESPACE;
-        }
-        break;
-      case PL_UNIX_HLINKS:
-        switch(parser->state.UNIX.sub.hlinks) {
-        case PL_UNIX_HLINKS_PRESPACE:
-          if(c != ' ') {
-            if(ISDIGIT(c)) {
-              parser->item_offset = len - 1;
-              parser->item_length = 1;
-              parser->state.UNIX.sub.hlinks = PL_UNIX_HLINKS_NUMBER;
-            }
-            else {
-              parser->error = CURLE_FTP_BAD_FILE_LIST;
-              goto fail;
-            }
-          }
-          break;
-        case PL_UNIX_HLINKS_NUMBER:
-          parser->item_length ++;
-          if(c == ' ') {
-            char *p;
-            long int hlinks;
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            hlinks = strtol(mem + parser->item_offset, &p, 10);
-            if(p[0] == '\0' && hlinks != LONG_MAX && hlinks != LONG_MIN) {
-              parser->file_data->info.flags |= CURLFINFOFLAG_KNOWN_HLINKCOUNT;
-              parser->file_data->info.hardlinks = hlinks;
-            }
-            parser->item_length = 0;
-            parser->item_offset = 0;
-            parser->state.UNIX.main = PL_UNIX_USER;
-            parser->state.UNIX.sub.user = PL_UNIX_USER_PRESPACE;
-          }
-          else if(!ISDIGIT(c)) {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        }
-        break;
-      case PL_UNIX_USER:
-        switch(parser->state.UNIX.sub.user) {
-        case PL_UNIX_USER_PRESPACE:
-          if(c != ' ') {
-            parser->item_offset = len - 1;
-            parser->item_length = 1;
-            parser->state.UNIX.sub.user = PL_UNIX_USER_PARSING;
-          }
-          break;
-        case PL_UNIX_USER_PARSING:
-          parser->item_length++;
-          if(c == ' ') {
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            parser->offsets.user = parser->item_offset;
-            parser->state.UNIX.main = PL_UNIX_GROUP;
-            parser->state.UNIX.sub.group = PL_UNIX_GROUP_PRESPACE;
-            parser->item_offset = 0;
-            parser->item_length = 0;
-          }
-          break;
-        }
-        break;
-      case PL_UNIX_GROUP:
-        switch(parser->state.UNIX.sub.group) {
-        case PL_UNIX_GROUP_PRESPACE:
-          if(c != ' ') {
-            parser->item_offset = len - 1;
-            parser->item_length = 1;
-            parser->state.UNIX.sub.group = PL_UNIX_GROUP_NAME;
-          }
-          break;
-        case PL_UNIX_GROUP_NAME:
-          parser->item_length++;
-          if(c == ' ') {
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            parser->offsets.group = parser->item_offset;
-            parser->state.UNIX.main = PL_UNIX_SIZE;
-            parser->state.UNIX.sub.size = PL_UNIX_SIZE_PRESPACE;
-            parser->item_offset = 0;
-            parser->item_length = 0;
-          }
-          break;
-        }
-        break;
-      case PL_UNIX_SIZE:
-        switch(parser->state.UNIX.sub.size) {
-        case PL_UNIX_SIZE_PRESPACE:
-          if(c != ' ') {
-            if(ISDIGIT(c)) {
-              parser->item_offset = len - 1;
-              parser->item_length = 1;
-              parser->state.UNIX.sub.size = PL_UNIX_SIZE_NUMBER;
-            }
-            else {
-              parser->error = CURLE_FTP_BAD_FILE_LIST;
-              goto fail;
-            }
-          }
-          break;
-        case PL_UNIX_SIZE_NUMBER:
-          parser->item_length++;
-          if(c == ' ') {
-            char *p;
-            curl_off_t fsize;
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            if(!curlx_strtoofft(mem + parser->item_offset,
-                                &p, 10, &fsize)) {
-              if(p[0] == '\0' && fsize != CURL_OFF_T_MAX &&
-                 fsize != CURL_OFF_T_MIN) {
-                parser->file_data->info.flags |= CURLFINFOFLAG_KNOWN_SIZE;
-                parser->file_data->info.size = fsize;
-              }
-              parser->item_length = 0;
-              parser->item_offset = 0;
-              parser->state.UNIX.main = PL_UNIX_TIME;
-              parser->state.UNIX.sub.time = PL_UNIX_TIME_PREPART1;
-            }
-          }
-          else if(!ISDIGIT(c)) {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        }
-        break;
-      case PL_UNIX_TIME:
-        switch(parser->state.UNIX.sub.time) {
-        case PL_UNIX_TIME_PREPART1:
-          if(c != ' ') {
-            if(ISALNUM(c)) {
-              parser->item_offset = len -1;
-              parser->item_length = 1;
-              parser->state.UNIX.sub.time = PL_UNIX_TIME_PART1;
-            }
-            else {
-              parser->error = CURLE_FTP_BAD_FILE_LIST;
-              goto fail;
-            }
-          }
-          break;
-        case PL_UNIX_TIME_PART1:
-          parser->item_length++;
-          if(c == ' ') {
-            parser->state.UNIX.sub.time = PL_UNIX_TIME_PREPART2;
-          }
-          else if(!ISALNUM(c) && c != '.') {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        case PL_UNIX_TIME_PREPART2:
-          parser->item_length++;
-          if(c != ' ') {
-            if(ISALNUM(c)) {
-              parser->state.UNIX.sub.time = PL_UNIX_TIME_PART2;
-            }
-            else {
-              parser->error = CURLE_FTP_BAD_FILE_LIST;
-              goto fail;
-            }
-          }
-          break;
-        case PL_UNIX_TIME_PART2:
-          parser->item_length++;
-          if(c == ' ') {
-            parser->state.UNIX.sub.time = PL_UNIX_TIME_PREPART3;
-          }
-          else if(!ISALNUM(c) && c != '.') {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        case PL_UNIX_TIME_PREPART3:
-          parser->item_length++;
-          if(c != ' ') {
-            if(ISALNUM(c)) {
-              parser->state.UNIX.sub.time = PL_UNIX_TIME_PART3;
-            }
-            else {
-              parser->error = CURLE_FTP_BAD_FILE_LIST;
-              goto fail;
-            }
-          }
-          break;
-        case PL_UNIX_TIME_PART3:
-          parser->item_length++;
-          if(c == ' ') {
-            mem[parser->item_offset + parser->item_length -1] = 0;
-            parser->offsets.time = parser->item_offset;
-            /*
-              if(ftp_pl_gettime(parser, finfo->mem + parser->item_offset)) {
-                parser->file_data->flags |= CURLFINFOFLAG_KNOWN_TIME;
-              }
-            */
-            if(finfo->filetype == CURLFILETYPE_SYMLINK) {
-              parser->state.UNIX.main = PL_UNIX_SYMLINK;
-              parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_PRESPACE;
-            }
-            else {
-              parser->state.UNIX.main = PL_UNIX_FILENAME;
-              parser->state.UNIX.sub.filename = PL_UNIX_FILENAME_PRESPACE;
-            }
-          }
-          else if(!ISALNUM(c) && c != '.' && c != ':') {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        }
-        break;
-      case PL_UNIX_FILENAME:
-        switch(parser->state.UNIX.sub.filename) {
-        case PL_UNIX_FILENAME_PRESPACE:
-          if(c != ' ') {
-            parser->item_offset = len - 1;
-            parser->item_length = 1;
-            parser->state.UNIX.sub.filename = PL_UNIX_FILENAME_NAME;
-          }
-          break;
-        case PL_UNIX_FILENAME_NAME:
-          parser->item_length++;
-          if(c == '\r') {
-            parser->state.UNIX.sub.filename = PL_UNIX_FILENAME_WINDOWSEOL;
-          }
-          else if(c == '\n') {
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            parser->offsets.filename = parser->item_offset;
-            parser->state.UNIX.main = PL_UNIX_FILETYPE;
-            result = ftp_pl_insert_finfo(data, infop);
-            if(result) {
-              parser->error = result;
-              goto fail;
-            }
-          }
-          break;
-        case PL_UNIX_FILENAME_WINDOWSEOL:
-          if(c == '\n') {
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            parser->offsets.filename = parser->item_offset;
-            parser->state.UNIX.main = PL_UNIX_FILETYPE;
-            result = ftp_pl_insert_finfo(data, infop);
-            if(result) {
-              parser->error = result;
-              goto fail;
-            }
-          }
-          else {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        }
-        break;
-      case PL_UNIX_SYMLINK:
-        switch(parser->state.UNIX.sub.symlink) {
-        case PL_UNIX_SYMLINK_PRESPACE:
-          if(c != ' ') {
-            parser->item_offset = len - 1;
-            parser->item_length = 1;
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_NAME;
-          }
-          break;
-        case PL_UNIX_SYMLINK_NAME:
-          parser->item_length++;
-          if(c == ' ') {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_PRETARGET1;
-          }
-          else if(c == '\r' || c == '\n') {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        case PL_UNIX_SYMLINK_PRETARGET1:
-          parser->item_length++;
-          if(c == '-') {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_PRETARGET2;
-          }
-          else if(c == '\r' || c == '\n') {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          else {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_NAME;
-          }
-          break;
-        case PL_UNIX_SYMLINK_PRETARGET2:
-          parser->item_length++;
-          if(c == '>') {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_PRETARGET3;
-          }
-          else if(c == '\r' || c == '\n') {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          else {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_NAME;
-          }
-          break;
-        case PL_UNIX_SYMLINK_PRETARGET3:
-          parser->item_length++;
-          if(c == ' ') {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_PRETARGET4;
-            /* now place where is symlink following */
-            mem[parser->item_offset + parser->item_length - 4] = 0;
-            parser->offsets.filename = parser->item_offset;
-            parser->item_length = 0;
-            parser->item_offset = 0;
-          }
-          else if(c == '\r' || c == '\n') {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          else {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_NAME;
-          }
-          break;
-        case PL_UNIX_SYMLINK_PRETARGET4:
-          if(c != '\r' && c != '\n') {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_TARGET;
-            parser->item_offset = len - 1;
-            parser->item_length = 1;
-          }
-          else {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        case PL_UNIX_SYMLINK_TARGET:
-          parser->item_length++;
-          if(c == '\r') {
-            parser->state.UNIX.sub.symlink = PL_UNIX_SYMLINK_WINDOWSEOL;
-          }
-          else if(c == '\n') {
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            parser->offsets.symlink_target = parser->item_offset;
-            result = ftp_pl_insert_finfo(data, infop);
-            if(result) {
-              parser->error = result;
-              goto fail;
-            }
-            parser->state.UNIX.main = PL_UNIX_FILETYPE;
-          }
-          break;
-        case PL_UNIX_SYMLINK_WINDOWSEOL:
-          if(c == '\n') {
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            parser->offsets.symlink_target = parser->item_offset;
-            result = ftp_pl_insert_finfo(data, infop);
-            if(result) {
-              parser->error = result;
-              goto fail;
-            }
-            parser->state.UNIX.main = PL_UNIX_FILETYPE;
-          }
-          else {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        }
-        break;
-      }
-      break;
-    case OS_TYPE_WIN_NT:
-      switch(parser->state.NT.main) {
-      case PL_WINNT_DATE:
-        parser->item_length++;
-        if(parser->item_length < 9) {
-          if(!strchr("0123456789-", c)) { /* only simple control */
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-        }
-        else if(parser->item_length == 9) {
-          if(c == ' ') {
-            parser->state.NT.main = PL_WINNT_TIME;
-            parser->state.NT.sub.time = PL_WINNT_TIME_PRESPACE;
-          }
-          else {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-        }
-        else {
-          parser->error = CURLE_FTP_BAD_FILE_LIST;
-          goto fail;
-        }
-        break;
-      case PL_WINNT_TIME:
-        parser->item_length++;
-        switch(parser->state.NT.sub.time) {
-        case PL_WINNT_TIME_PRESPACE:
-          if(!ISBLANK(c)) {
-            parser->state.NT.sub.time = PL_WINNT_TIME_TIME;
-          }
-          break;
-        case PL_WINNT_TIME_TIME:
-          if(c == ' ') {
-            parser->offsets.time = parser->item_offset;
-            mem[parser->item_offset + parser->item_length -1] = 0;
-            parser->state.NT.main = PL_WINNT_DIRORSIZE;
-            parser->state.NT.sub.dirorsize = PL_WINNT_DIRORSIZE_PRESPACE;
-            parser->item_length = 0;
-          }
-          else if(!strchr("APM0123456789:", c)) {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        }
-        break;
-      case PL_WINNT_DIRORSIZE:
-        switch(parser->state.NT.sub.dirorsize) {
-        case PL_WINNT_DIRORSIZE_PRESPACE:
-          if(c != ' ') {
-            parser->item_offset = len - 1;
-            parser->item_length = 1;
-            parser->state.NT.sub.dirorsize = PL_WINNT_DIRORSIZE_CONTENT;
-          }
-          break;
-        case PL_WINNT_DIRORSIZE_CONTENT:
-          parser->item_length ++;
-          if(c == ' ') {
-            mem[parser->item_offset + parser->item_length - 1] = 0;
-            if(strcmp("<DIR>", mem + parser->item_offset) == 0) {
-              finfo->filetype = CURLFILETYPE_DIRECTORY;
-              finfo->size = 0;
-            }
-            else {
-              char *endptr;
-              if(curlx_strtoofft(mem +
-                                 parser->item_offset,
-                                 &endptr, 10, &finfo->size)) {
-                parser->error = CURLE_FTP_BAD_FILE_LIST;
-                goto fail;
-              }
-              /* correct file type */
-              parser->file_data->info.filetype = CURLFILETYPE_FILE;
-            }
-
-            parser->file_data->info.flags |= CURLFINFOFLAG_KNOWN_SIZE;
-            parser->item_length = 0;
-            parser->state.NT.main = PL_WINNT_FILENAME;
-            parser->state.NT.sub.filename = PL_WINNT_FILENAME_PRESPACE;
-          }
-          break;
-        }
-        break;
-      case PL_WINNT_FILENAME:
-        switch(parser->state.NT.sub.filename) {
-        case PL_WINNT_FILENAME_PRESPACE:
-          if(c != ' ') {
-            parser->item_offset = len -1;
-            parser->item_length = 1;
-            parser->state.NT.sub.filename = PL_WINNT_FILENAME_CONTENT;
-          }
-          break;
-        case PL_WINNT_FILENAME_CONTENT:
-          parser->item_length++;
-          if(c == '\r') {
-            parser->state.NT.sub.filename = PL_WINNT_FILENAME_WINEOL;
-            mem[len - 1] = 0;
-          }
-          else if(c == '\n') {
-            parser->offsets.filename = parser->item_offset;
-            mem[len - 1] = 0;
-            result = ftp_pl_insert_finfo(data, infop);
-            if(result) {
-              parser->error = result;
-              goto fail;
-            }
-            parser->state.NT.main = PL_WINNT_DATE;
-            parser->state.NT.sub.filename = PL_WINNT_FILENAME_PRESPACE;
-          }
-          break;
-        case PL_WINNT_FILENAME_WINEOL:
-          if(c == '\n') {
-            parser->offsets.filename = parser->item_offset;
-            result = ftp_pl_insert_finfo(data, infop);
-            if(result) {
-              parser->error = result;
-              goto fail;
-            }
-            parser->state.NT.main = PL_WINNT_DATE;
-            parser->state.NT.sub.filename = PL_WINNT_FILENAME_PRESPACE;
-          }
-          else {
-            parser->error = CURLE_FTP_BAD_FILE_LIST;
-            goto fail;
-          }
-          break;
-        }
-        break;
-      }
-      break;
-    default:
-      retsize = bufflen + 1;
-      goto fail;
-    }
+    if(!eol)
+      break; /* the rest of this line comes in a later call */
 
-    i++;
+    buffer = eol + 1;
+    bufflen -= len + 1;
+
+    parser->error = ftp_pl_parse_line(data, parser);
+    if(parser->error)
+      goto fail;
   }
   return retsize;
 
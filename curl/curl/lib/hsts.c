@@ -40,6 +40,7 @@
 #include "fopen.h"
 #include "rename.h"
 #include "share.h"
+#include "strdup.h"
 
 /* The last 3 #include files should be in this order */
 #include "curl_printf.h"
@@ -52,6 +53,8 @@
 #define MAX_HSTS_DATELEN 64
 #define MAX_HSTS_DATELENSTR "64"
 #define UNLIMITED "unlimited"
+#define HSTS_SLOTS 63 /* to start with, grows with the number of entries */
+#define HSTS_SLOTS_MAX 65535
 
 #ifdef DEBUGBUILD
 /* to play well with debug builds, we can *set* a fixed time this will
@@ -73,11 +76,19 @@ static time_t debugtime(void *unused)
 #define time(x) debugtime(x)
 #endif
 
+/* the entries are owned by the list, the hash only points to them */
+static void hsts_hash_dtor(void *p)
+{
+  (void)p;
+}
+
 struct hsts *Curl_hsts_init(void)
 {
   struct hsts *h = calloc(sizeof(struct hsts), 1);
   if(h) {
     Curl_llist_init(&h->list, NULL);
+    Curl_hash_init(&h->hash, HSTS_SLOTS, Curl_hash_str,
+                   Curl_str_key_compare, hsts_hash_dtor);
   }
   return h;
 }
@@ -99,15 +110,64 @@ void Curl_hsts_cleanup(struct hsts **hp)
       n = e->next;
       hsts_free(sts);
     }
+    Curl_hash_destroy(&h->hash);
     free(h->filename);
     free(h);
     *hp = NULL;
   }
 }
 
-static struct stsentry *hsts_entry(void)
+/*
+ * Store the hash key for 'hostname' in 'key': lower-cased and without a
+ * trailing dot. Returns the key length, 0 if the name is empty or too long.
+ */
+static size_t hsts_key(char *key, const char *hostname)
 {
-  return calloc(sizeof(struct stsentry), 1);
+  size_t hlen = strlen(hostname);
+  if(hlen && (hostname[hlen - 1] == '.'))
+    hlen--;
+  if(!hlen || (hlen > MAX_HSTS_HOSTLEN))
+    return 0;
+  Curl_strntolower(key, hostname, hlen);
+  key[hlen] = 0;
+  return hlen;
+}
+
+/*
+ * Make the hash four times bigger when it has four entries per slot, so that
+ * large preloaded caches still get short chains. If that runs out of memory,
+ * the old one is just kept.
+ */
+static void hsts_rehash(struct hsts *h)
+{
+  struct Curl_llist_element *e;
+  struct Curl_hash bigger;
+  int slots = h->hash.slots;
+
+  if((h->hash.size < (size_t)slots * 4) || (slots >= HSTS_SLOTS_MAX))
+    return;
+  Curl_hash_init(&bigger, slots * 4 + 3, Curl_hash_str,
+                 Curl_str_key_compare, hsts_hash_dtor);
+  for(e = h->list.head; e; e = e->next) {
+    struct stsentry *sts = e->ptr;
+    char key[MAX_HSTS_HOSTLEN + 1];
+    size_t klen = hsts_key(key, sts->host);
+    if(!Curl_hash_add(&bigger, key, klen, sts)) {
+      Curl_hash_destroy(&bigger);
+      return;
+    }
+  }
+  Curl_hash_destroy(&h->hash);
+  h->hash = bigger;
+}
+
+static void hsts_remove(struct hsts *h, struct stsentry *sts)
+{
+  char key[MAX_HSTS_HOSTLEN + 1];
+  size_t klen = hsts_key(key, sts->host);
+  Curl_hash_delete(&h->hash, key, klen);
+  Curl_llist_remove(&h->list, &sts->node, NULL);
+  hsts_free(sts);
 }
 
 static CURLcode hsts_create(struct hsts *h,
@@ -115,27 +175,42 @@ static CURLcode hsts_create(struct hsts *h,
                             bool subdomains,
                             curl_off_t expires)
 {
-  struct stsentry *sts = hsts_entry();
+  struct stsentry *sts;
   char *duphost;
-  size_t hlen;
+  char key[MAX_HSTS_HOSTLEN + 1];
+  size_t hlen = hsts_key(key, hostname);
+  if(!hlen)
+    return CURLE_OK; /* ignore */
+
+  sts = Curl_hash_pick(&h->hash, key, hlen);
+  if(sts) {
+    /* the same host name again, update it */
+    sts->expires = expires;
+    sts->includeSubDomains = subdomains;
+    return CURLE_OK;
+  }
+
+  sts = calloc(sizeof(struct stsentry), 1);
   if(!sts)
     return CURLE_OUT_OF_MEMORY;
 
-  duphost = strdup(hostname);
+  /* strip off trailing any dot */
+  duphost = Curl_memdup(hostname, hlen + 1);
   if(!duphost) {
     free(sts);
     return CURLE_OUT_OF_MEMORY;
   }
-
-  hlen = strlen(duphost);
-  if(duphost[hlen - 1] == '.')
-    /* strip off trailing any dot */
-    duphost[--hlen] = 0;
+  duphost[hlen] = 0;
 
   sts->host = duphost;
   sts->expires = expires;
   sts->includeSubDomains = subdomains;
+  if(!Curl_hash_add(&h->hash, key, hlen, sts)) {
+    hsts_free(sts);
+    return CURLE_OUT_OF_MEMORY;
+  }
   Curl_llist_insert_next(&h->list, h->list.tail, sts, &sts->node);
+  hsts_rehash(h);
   return CURLE_OK;
 }
 
@@ -213,10 +288,8 @@ CURLcode Curl_hsts_parse(struct hsts *h, const char *hostname,
   if(!expires) {
     /* remove the entry if present verbatim (without subdomain match) */
     sts = Curl_hsts(h, hostname, FALSE);
-    if(sts) {
-      Curl_llist_remove(&h->list, &sts->node, NULL);
-      hsts_free(sts);
-    }
+    if(sts)
+      hsts_remove(h, sts);
     return CURLE_OK;
   }
 
@@ -251,44 +324,52 @@ struct stsentry *Curl_hsts(struct hsts *h, const char *hostname,
   if(h) {
     char buffer[MAX_HSTS_HOSTLEN + 1];
     time_t now = time(NULL);
-    size_t hlen = strlen(hostname);
-    struct Curl_llist_element *e;
-    struct Curl_llist_element *n;
+    size_t hlen = hsts_key(buffer, hostname);
+    const char *p;
 
-    if((hlen > MAX_HSTS_HOSTLEN) || !hlen)
+    if(!hlen)
       return NULL;
-    memcpy(buffer, hostname, hlen);
-    if(hostname[hlen-1] == '.')
-      /* remove the trailing dot */
-      --hlen;
-    buffer[hlen] = 0;
-    hostname = buffer;
 
-    for(e = h->list.head; e; e = n) {
-      struct stsentry *sts = e->ptr;
-      n = e->next;
-      if(sts->expires <= now) {
-        /* remove expired entries */
-        Curl_llist_remove(&h->list, &sts->node, NULL);
-        hsts_free(sts);
-        continue;
+    /* the widest parent domain first, the name itself last */
+    p = subdomain ? &buffer[hlen] : buffer;
+    for(;;) {
+      struct stsentry *sts;
+      if(p > buffer) {
+        /* back up to the start of the next longer name */
+        p--;
+        while((p > buffer) && (p[-1] != '.'))
+          p--;
       }
-      if(subdomain && sts->includeSubDomains) {
-        size_t ntail = strlen(sts->host);
-        if(ntail < hlen) {
-          size_t offs = hlen - ntail;
-          if((hostname[offs-1] == '.') &&
-             strncasecompare(&hostname[offs], sts->host, ntail))
-            return sts;
-        }
+      sts = Curl_hash_pick(&h->hash, (void *)p, hlen - (p - buffer));
+      if(sts) {
+        if(sts->expires <= now)
+          /* remove expired entries */
+          hsts_remove(h, sts);
+        else if((p == buffer) || sts->includeSubDomains)
+          return sts;
       }
-      if(strcasecompare(hostname, sts->host))
-        return sts;
+      if(p == buffer)
+        break;
     }
   }
   return NULL; /* no match */
 }
 
+/* remove all expired entries */
+static void hsts_expire(struct hsts *h)
+{
+  struct Curl_llist_element *e;
+  struct Curl_llist_element *n;
+  time_t now = time(NULL);
+
+  for(e = h->list.head; e; e = n) {
+    struct stsentry *sts = e->ptr;
+    n = e->next;
+    if(sts->expires <= now)
+      hsts_remove(h, sts);
+  }
+}
+
 /*
  * Send this HSTS entry to the write callback.
  */
@@ -362,6 +443,8 @@ CURLcode Curl_hsts_save(struct Curl_easy *data, struct hsts *h,
     /* no cache activated */
     return CURLE_OK;
 
+  hsts_expire(h);
+
   /* if no new name is given, use the one we stored from the load */
   if(!file && h->filename)
     file = h->filename;
@@ -3478,6 +3478,14 @@ checkprotoprefix(struct Curl_easy *data, struct connectdata *conn,
   return checkhttpprefix(data, s, len);
 }
 
+/*
+ * HD_IS() is true if the header line 'hd', with a name 'hdlen' bytes long,
+ * is the header 'name' given with its colon. Comparing the lengths first
+ * leaves at most a few candidates to compare the names of.
+ */
+#define HD_IS(hd, hdlen, name) \
+  (((hdlen) == sizeof(name) - 2) && strncasecompare(hd, name, hdlen))
+
 /*
  * Curl_http_header() parses a single response header.
  */
@@ -3486,9 +3494,12 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
 {
   CURLcode result;
   struct SingleRequest *k = &data->req;
+  /* the length of the header name, none for a folded line */
+  const char *colon = ISBLANK(*headp) ? NULL : strchr(headp, ':');
+  size_t namelen = colon ? (size_t)(colon - headp) : 0;
   /* Check for Content-Length: header lines to get size */
   if(!k->http_bodyless &&
-     !data->set.ignorecl && checkprefix("Content-Length:", headp)) {
+     !data->set.ignorecl && HD_IS(headp, namelen, "Content-Length:")) {
     curl_off_t contentlength;
     CURLofft offt = curlx_strtoofft(headp + strlen("Content-Length:"),
                                     NULL, 10, &contentlength);
@@ -3513,7 +3524,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
     }
   }
   /* check for Content-Type: header lines to get the MIME-type */
-  else if(checkprefix("Content-Type:", headp)) {
+  else if(HD_IS(headp, namelen, "Content-Type:")) {
     char *contenttype = Curl_copy_header_value(headp);
     if(!contenttype)
       return CURLE_OUT_OF_MEMORY;
@@ -3528,6 +3539,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
 #ifndef CURL_DISABLE_PROXY
   else if((conn->httpversion == 10) &&
           conn->bits.httpproxy &&
+          HD_IS(headp, namelen, "Proxy-Connection:") &&
           Curl_compareheader(headp,
                              STRCONST("Proxy-Connection:"),
                              STRCONST("keep-alive"))) {
@@ -3542,6 +3554,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
   }
   else if((conn->httpversion == 11) &&
           conn->bits.httpproxy &&
+          HD_IS(headp, namelen, "Proxy-Connection:") &&
           Curl_compareheader(headp,
                              STRCONST("Proxy-Connection:"),
                              STRCONST("close"))) {
@@ -3554,6 +3567,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
   }
 #endif
   else if((conn->httpversion == 10) &&
+          HD_IS(headp, namelen, "Connection:") &&
           Curl_compareheader(headp,
                              STRCONST("Connection:"),
                              STRCONST("keep-alive"))) {
@@ -3566,7 +3580,8 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
     connkeep(conn, "Connection keep-alive");
     infof(data, "HTTP/1.0 connection set to keep alive");
   }
-  else if(Curl_compareheader(headp,
+  else if(HD_IS(headp, namelen, "Connection:") &&
+          Curl_compareheader(headp,
                              STRCONST("Connection:"), STRCONST("close"))) {
     /*
      * [RFC 2616, section 8.1.2.1]
@@ -3576,7 +3591,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
      */
     streamclose(conn, "Connection: close used");
   }
-  else if(!k->http_bodyless && checkprefix("Transfer-Encoding:", headp)) {
+  else if(!k->http_bodyless && HD_IS(headp, namelen, "Transfer-Encoding:")) {
     /* One or more encodings. We check for chunked and/or a compression
        algorithm. */
     /*
@@ -3600,7 +3615,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
       k->ignore_cl = TRUE;
     }
   }
-  else if(!k->http_bodyless && checkprefix("Content-Encoding:", headp) &&
+  else if(!k->http_bodyless && HD_IS(headp, namelen, "Content-Encoding:") &&
           data->set.str[STRING_ENCODING]) {
     /*
      * Process Content-Encoding. Look for the values: identity,
@@ -3615,7 +3630,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
     if(result)
       return result;
   }
-  else if(checkprefix("Retry-After:", headp)) {
+  else if(HD_IS(headp, namelen, "Retry-After:")) {
     /* Retry-After = HTTP-date / delay-seconds */
     curl_off_t retry_after = 0; /* zero for unknown or "now" */
     /* Try it as a decimal number, if it works it is not a date */
@@ -3629,7 +3644,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
     }
     data->info.retry_after = retry_after; /* store it */
   }
-  else if(!k->http_bodyless && checkprefix("Content-Range:", headp)) {
+  else if(!k->http_bodyless && HD_IS(headp, namelen, "Content-Range:")) {
     /* Content-Range: bytes [num]-
        Content-Range: bytes: [num]-
        Content-Range: [num]-
@@ -3660,7 +3675,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
   }
 #if !defined(CURL_DISABLE_COOKIES)
   else if(data->cookies && data->state.cookie_engine &&
-          checkprefix("Set-Cookie:", headp)) {
+          HD_IS(headp, namelen, "Set-Cookie:")) {
     /* If there is a custom-set Host: name, use it here, or else use real peer
        host name. */
     const char *host = data->state.aptr.cookiehost?
@@ -3679,15 +3694,15 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
     Curl_share_unlock(data, CURL_LOCK_DATA_COOKIE);
   }
 #endif
-  else if(!k->http_bodyless && checkprefix("Last-Modified:", headp) &&
+  else if(!k->http_bodyless && HD_IS(headp, namelen, "Last-Modified:") &&
           (data->set.timecondition || data->set.get_filetime) ) {
     k->timeofdoc = Curl_getdate_capped(headp + strlen("Last-Modified:"));
     if(data->set.get_filetime)
       data->info.filetime = k->timeofdoc;
   }
-  else if((checkprefix("WWW-Authenticate:", headp) &&
+  else if((HD_IS(headp, namelen, "WWW-Authenticate:") &&
            (401 == k->httpcode)) ||
-          (checkprefix("Proxy-authenticate:", headp) &&
+          (HD_IS(headp, namelen, "Proxy-authenticate:") &&
            (407 == k->httpcode))) {
 
     bool proxy = (k->httpcode == 407) ? TRUE : FALSE;
@@ -3703,7 +3718,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
       return result;
   }
 #ifdef USE_SPNEGO
-  else if(checkprefix("Persistent-Auth:", headp)) {
+  else if(HD_IS(headp, namelen, "Persistent-Auth:")) {
     struct negotiatedata *negdata = &conn->negotiate;
     struct auth *authp = &data->state.authhost;
     if(authp->picked == CURLAUTH_NEGOTIATE) {
@@ -3720,7 +3735,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
   }
 #endif
   else if((k->httpcode >= 300 && k->httpcode < 400) &&
-          checkprefix("Location:", headp) &&
+          HD_IS(headp, namelen, "Location:") &&
           !data->req.location) {
     /* this is the URL that the server advises us to use instead */
     char *location = Curl_copy_header_value(headp);
@@ -3752,7 +3767,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
 
 #ifndef CURL_DISABLE_HSTS
   /* If enabled, the header is incoming and this is over HTTPS */
-  else if(data->hsts && checkprefix("Strict-Transport-Security:", headp) &&
+  else if(data->hsts && HD_IS(headp, namelen, "Strict-Transport-Security:") &&
           ((conn->handler->flags & PROTOPT_SSL) ||
 #ifdef CURLDEBUG
            /* allow debug builds to circumvent the HTTPS restriction */
@@ -3775,7 +3790,7 @@ CURLcode Curl_http_header(struct Curl_easy *data, struct connectdata *conn,
 #endif
 #ifndef CURL_DISABLE_ALTSVC
   /* If enabled, the header is incoming and this is over HTTPS */
-  else if(data->asi && checkprefix("Alt-Svc:", headp) &&
+  else if(data->asi && HD_IS(headp, namelen, "Alt-Svc:") &&
           ((conn->handler->flags & PROTOPT_SSL) ||
 #ifdef CURLDEBUG
            /* allow debug builds to circumvent the HTTPS restriction */
@@ -26,6 +26,12 @@
 
 #include <curl/curl.h>
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1)
+#include <sys/epoll.h>
+#elif defined(HAVE_SYS_EVENT_H) && defined(HAVE_KQUEUE)
+#include <sys/event.h>
+#endif
+
 #include "urldata.h"
 #include "transfer.h"
 #include "url.h"
@@ -235,6 +241,9 @@ struct Curl_sh_entry {
   void *socketp; /* settable by users with curl_multi_assign() */
   unsigned int readers; /* this many transfers want to read */
   unsigned int writers; /* this many transfers want to write */
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+  unsigned int evaction; /* what 'evfd' of the multi waits for */
+#endif
 };
 /* bits for 'action' having no bits means this socket is not expecting any
    action */
@@ -444,6 +453,9 @@ struct Curl_multi *Curl_multi_handle(int hashsize, /* socket hash */
     multi->wakeup_pair[1] = CURL_SOCKET_BAD;
   }
 #endif
+#endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+  multi->evfd = -1; /* created by curl_multi_wait() when worth it */
 #endif
 
   return multi;
@@ -1146,6 +1158,326 @@ static void reset_socket_fdwrite(curl_socket_t s)
 
 #define NUM_POLLS_ON_STACK 10
 
+#if defined(ENABLE_WAKEUP) && !defined(USE_WINSOCK)
+static void wakeup_drain(curl_socket_t s)
+{
+  char buf[64];
+  ssize_t nread;
+  while(1) {
+    /* the reading socket is non-blocking, try to read
+       data from it until it receives an error (except EINTR).
+       In normal cases it will get EAGAIN or EWOULDBLOCK
+       when there is no more data, breaking the loop. */
+    nread = wakeup_read(s, buf, sizeof(buf));
+    if(nread <= 0) {
+      if(nread < 0 && EINTR == SOCKERRNO)
+        continue;
+      break;
+    }
+  }
+}
+#endif
+
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+/*
+ * With many transfers, curl_multi_wait() does not build a pollfd array from
+ * all of them for every call. It keeps the sockets of the sockhash, and what
+ * they wait for, registered in an epoll or kqueue descriptor that
+ * singlesocket() keeps up to date, so a wait only costs what is ready.
+ */
+
+/* the number of transfers from which on the event backend is used */
+#define MULTI_EV_MIN 16
+
+#ifdef USE_EPOLL
+#define MULTI_EV_T struct epoll_event
+#else
+#define MULTI_EV_T struct kevent
+#endif
+
+static void multi_ev_close(struct Curl_multi *multi)
+{
+  if(multi->evfd != -1) {
+    close(multi->evfd);
+    multi->evfd = -1;
+  }
+  Curl_safefree(multi->evlist);
+  multi->evsize = 0;
+  multi->evcount = 0;
+}
+
+/* make 'evfd' wait for what the transfers of the socket wait for, or for
+   nothing when the socket is 'gone' from the sockhash */
+static void multi_ev_sync(struct Curl_multi *multi, curl_socket_t s,
+                          struct Curl_sh_entry *entry, bool gone)
+{
+  unsigned int action = 0;
+  unsigned int prev = entry->evaction;
+  int rc = 0;
+
+  if(!gone)
+    action = (entry->readers ? CURL_POLL_IN : 0) |
+      (entry->writers ? CURL_POLL_OUT : 0);
+  if((multi->evfd == -1) || (action == prev))
+    return;
+
+#ifdef USE_EPOLL
+  {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = s;
+    if(action & CURL_POLL_IN)
+      ev.events |= EPOLLIN;
+    if(action & CURL_POLL_OUT)
+      ev.events |= EPOLLOUT;
+    if(!action)
+      /* fails harmlessly for a socket that is already closed */
+      (void)epoll_ctl(multi->evfd, EPOLL_CTL_DEL, s, &ev);
+    else {
+      rc = epoll_ctl(multi->evfd, prev ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                     s, &ev);
+      /* a closed and reused socket number is not where we think it is */
+      if(rc && prev && (errno == ENOENT))
+        rc = epoll_ctl(multi->evfd, EPOLL_CTL_ADD, s, &ev);
+      else if(rc && !prev && (errno == EEXIST))
+        rc = epoll_ctl(multi->evfd, EPOLL_CTL_MOD, s, &ev);
+    }
+  }
+#else
+  {
+    struct kevent kev;
+    if((action ^ prev) & CURL_POLL_IN) {
+      EV_SET(&kev, s, EVFILT_READ,
+             (action & CURL_POLL_IN) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+      if(kevent(multi->evfd, &kev, 1, NULL, 0, NULL) &&
+         (action & CURL_POLL_IN))
+        rc = -1;
+    }
+    if((action ^ prev) & CURL_POLL_OUT) {
+      EV_SET(&kev, s, EVFILT_WRITE,
+             (action & CURL_POLL_OUT) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+      if(kevent(multi->evfd, &kev, 1, NULL, 0, NULL) &&
+         (action & CURL_POLL_OUT))
+        rc = -1;
+    }
+  }
+#endif
+
+  if(rc) {
+    /* give up on it, curl_multi_wait() goes back to poll() */
+    multi_ev_close(multi);
+    multi->evfailed = TRUE;
+    return;
+  }
+  entry->evaction = action;
+  if(!prev)
+    multi->evcount++;
+  else if(!action)
+    multi->evcount--;
+}
+
+/* start the event backend, FALSE if it cannot be used */
+static bool multi_ev_init(struct Curl_multi *multi)
+{
+  struct Curl_hash_iterator iter;
+  struct Curl_hash_element *he;
+  struct Curl_easy *data;
+
+#ifdef USE_EPOLL
+  multi->evfd = epoll_create1(EPOLL_CLOEXEC);
+#else
+  multi->evfd = kqueue();
+#endif
+  if(multi->evfd == -1) {
+    multi->evfailed = TRUE;
+    return FALSE;
+  }
+
+  /* register the sockets the sockhash has now... */
+  Curl_hash_start_iterate(&multi->sockhash, &iter);
+  he = Curl_hash_next_element(&iter);
+  while(he && (multi->evfd != -1)) {
+    curl_socket_t s;
+    memcpy(&s, he->key, sizeof(s));
+    multi_ev_sync(multi, s, he->ptr, FALSE);
+    he = Curl_hash_next_element(&iter);
+  }
+
+  /* ... and bring it up to date with what the transfers wait for, as
+     curl_multi_perform() only does that once this is running */
+  for(data = multi->easyp; data && (multi->evfd != -1); data = data->next) {
+    if(singlesocket(multi, data)) {
+      multi_ev_close(multi);
+      multi->evfailed = TRUE;
+    }
+  }
+  return multi->evfd != -1;
+}
+
+static bool multi_ev_wanted(struct Curl_multi *multi)
+{
+  int min = MULTI_EV_MIN;
+#ifdef DEBUGBUILD
+  /* allow the test suite to run through the event backend */
+  char *p = getenv("CURL_MULTI_EVENTS");
+  if(p)
+    min = atoi(p);
+#endif
+  if(multi->evfd != -1)
+    return TRUE;
+  if(multi->evfailed || (multi->num_easy < min))
+    return FALSE;
+  return multi_ev_init(multi);
+}
+
+/* wait for events in 'evfd', return how many there are or -1 on error */
+static int multi_ev_collect(struct Curl_multi *multi, int timeout_ms)
+{
+  int rc;
+#ifdef USE_EPOLL
+  rc = epoll_wait(multi->evfd, multi->evlist, (int)multi->evsize,
+                  timeout_ms);
+#else
+  struct timespec ts;
+  ts.tv_sec = timeout_ms / 1000;
+  ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+  rc = kevent(multi->evfd, NULL, 0, multi->evlist, (int)multi->evsize, &ts);
+#endif
+  if((rc == -1) && (SOCKERRNO == EINTR))
+    /* signal interrupted, nothing is ready */
+    rc = 0;
+  return rc;
+}
+
+/* multi_wait() for when the event backend is running */
+static CURLMcode multi_ev_wait(struct Curl_multi *multi,
+                               struct curl_waitfd extra_fds[],
+                               unsigned int extra_nfds,
+                               int timeout_ms,
+                               int *ret,
+                               bool extrawait,
+                               bool use_wakeup)
+{
+  struct pollfd a_few_on_stack[NUM_POLLS_ON_STACK];
+  struct pollfd *ufds = &a_few_on_stack[0];
+  unsigned int nfds;
+  unsigned int wakeup = 0;
+  unsigned int i;
+  long timeout_internal;
+  int retcode = 0;
+  int evready = 0;
+
+#ifdef ENABLE_WAKEUP
+  if(use_wakeup && multi->wakeup_pair[0] != CURL_SOCKET_BAD)
+    wakeup = 1;
+#else
+  (void)use_wakeup;
+#endif
+
+  (void)multi_timeout(multi, &timeout_internal);
+  if((timeout_internal >= 0) && (timeout_internal < (long)timeout_ms))
+    timeout_ms = (int)timeout_internal;
+
+  if(multi->evsize < multi->evcount || !multi->evsize) {
+    unsigned int size = multi->evsize ? multi->evsize : 16;
+    void *list;
+    while(size < multi->evcount)
+      size *= 2;
+    list = realloc(multi->evlist, size * sizeof(MULTI_EV_T));
+    if(!list)
+      return CURLM_OUT_OF_MEMORY;
+    multi->evlist = list;
+    multi->evsize = size;
+  }
+
+  nfds = multi->evcount + extra_nfds + wakeup;
+  if(nfds && !extra_nfds && !wakeup) {
+    /* only our own sockets, wait for them directly */
+    evready = multi_ev_collect(multi, timeout_ms);
+    if(evready < 0)
+      return CURLM_UNRECOVERABLE_POLL;
+  }
+  else if(nfds) {
+    int pollrc;
+    /* poll the event descriptor along with the other ones */
+    if(extra_nfds + wakeup + 1 > NUM_POLLS_ON_STACK) {
+      ufds = malloc((extra_nfds + wakeup + 1) * sizeof(struct pollfd));
+      if(!ufds)
+        return CURLM_OUT_OF_MEMORY;
+    }
+    ufds[0].fd = multi->evfd;
+    ufds[0].events = POLLIN;
+    for(i = 0; i < extra_nfds; i++) {
+      ufds[i + 1].fd = extra_fds[i].fd;
+      ufds[i + 1].events = 0;
+      if(extra_fds[i].events & CURL_WAIT_POLLIN)
+        ufds[i + 1].events |= POLLIN;
+      if(extra_fds[i].events & CURL_WAIT_POLLPRI)
+        ufds[i + 1].events |= POLLPRI;
+      if(extra_fds[i].events & CURL_WAIT_POLLOUT)
+        ufds[i + 1].events |= POLLOUT;
+    }
+#ifdef ENABLE_WAKEUP
+    if(wakeup) {
+      ufds[extra_nfds + 1].fd = multi->wakeup_pair[0];
+      ufds[extra_nfds + 1].events = POLLIN;
+    }
+#endif
+
+    pollrc = Curl_poll(ufds, extra_nfds + wakeup + 1, timeout_ms);
+    if(pollrc > 0) {
+      retcode = pollrc;
+      if(ufds[0].revents) {
+        /* the event descriptor is not counted, what it holds is */
+        retcode--;
+        evready = multi_ev_collect(multi, 0);
+      }
+      for(i = 0; i < extra_nfds; i++) {
+        unsigned r = ufds[i + 1].revents;
+        unsigned short mask = 0;
+        if(r & POLLIN)
+          mask |= CURL_WAIT_POLLIN;
+        if(r & POLLOUT)
+          mask |= CURL_WAIT_POLLOUT;
+        if(r & POLLPRI)
+          mask |= CURL_WAIT_POLLPRI;
+        extra_fds[i].revents = mask;
+      }
+#ifdef ENABLE_WAKEUP
+      if(wakeup && (ufds[extra_nfds + 1].revents & POLLIN)) {
+        wakeup_drain(multi->wakeup_pair[0]);
+        /* do not count the wakeup socket into the returned value */
+        retcode--;
+      }
+#endif
+    }
+    if(ufds != &a_few_on_stack[0])
+      free(ufds);
+    if((pollrc < 0) || (evready < 0))
+      return CURLM_UNRECOVERABLE_POLL;
+  }
+
+  if(ret)
+    *ret = retcode + evready;
+  if(extrawait && !nfds) {
+    long sleep_ms = 0;
+
+    /* Avoid busy-looping when there's nothing particular to wait for */
+    if(!curl_multi_timeout(multi, &sleep_ms) && sleep_ms) {
+      if(sleep_ms > timeout_ms)
+        sleep_ms = timeout_ms;
+      else if(sleep_ms < 0)
+        sleep_ms = timeout_ms;
+      Curl_wait_ms(sleep_ms);
+    }
+  }
+
+  return CURLM_OK;
+}
+#else
+#define multi_ev_sync(a,b,c,d) Curl_nop_stmt
+#endif /* USE_EPOLL || USE_KQUEUE */
+
 static CURLMcode multi_wait(struct Curl_multi *multi,
                             struct curl_waitfd extra_fds[],
                             unsigned int extra_nfds,
@@ -1182,6 +1514,12 @@ static CURLMcode multi_wait(struct Curl_multi *multi,
   if(timeout_ms < 0)
     return CURLM_BAD_FUNCTION_ARGUMENT;
 
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+  if(multi_ev_wanted(multi))
+    return multi_ev_wait(multi, extra_fds, extra_nfds, timeout_ms, ret,
+                         extrawait, use_wakeup);
+#endif
+
   /* Count up how many fds we have from the multi handle */
   data = multi->easyp;
   while(data) {
@@ -1422,20 +1760,7 @@ static CURLMcode multi_wait(struct Curl_multi *multi,
 #ifdef ENABLE_WAKEUP
       if(use_wakeup && multi->wakeup_pair[0] != CURL_SOCKET_BAD) {
         if(ufds[curlfds + extra_nfds].revents & POLLIN) {
-          char buf[64];
-          ssize_t nread;
-          while(1) {
-            /* the reading socket is non-blocking, try to read
-               data from it until it receives an error (except EINTR).
-               In normal cases it will get EAGAIN or EWOULDBLOCK
-               when there is no more data, breaking the loop. */
-            nread = wakeup_read(multi->wakeup_pair[0], buf, sizeof(buf));
-            if(nread <= 0) {
-              if(nread < 0 && EINTR == SOCKERRNO)
-                continue;
-              break;
-            }
-          }
+          wakeup_drain(multi->wakeup_pair[0]);
           /* do not count the wakeup socket into the returned value */
           retcode--;
         }
@@ -2743,6 +3068,11 @@ CURLMcode curl_multi_perform(struct Curl_multi *multi, int *running_handles)
         nosig = data->set.no_signal;
       }
       result = multi_runsingle(multi, &now, data);
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+      if(!result && (multi->evfd != -1))
+        /* keep the sockets curl_multi_wait() waits for current */
+        result = singlesocket(multi, data);
+#endif
       if(result)
         returncode = result;
       data = datanext; /* operate on next handle */
@@ -2843,6 +3173,9 @@ CURLMcode curl_multi_cleanup(struct Curl_multi *multi)
     wakeup_close(multi->wakeup_pair[1]);
 #endif
 #endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    multi_ev_close(multi);
+#endif
 
 #ifdef USE_SSL
     Curl_free_multi_ssl_backend_data(multi->ssl_backend_data);
@@ -2987,6 +3320,7 @@ static CURLMcode singlesocket(struct Curl_multi *multi,
 
     comboaction = (entry->writers? CURL_POLL_OUT : 0) |
                    (entry->readers ? CURL_POLL_IN : 0);
+    multi_ev_sync(multi, s, entry, FALSE);
 
     /* socket existed before and has the same action set as before */
     if(sincebefore && ((int)entry->action == comboaction))
@@ -3036,6 +3370,7 @@ static CURLMcode singlesocket(struct Curl_multi *multi,
         entry->writers--;
       if(oldactions & CURL_POLL_IN)
         entry->readers--;
+      multi_ev_sync(multi, s, entry, !entry->users);
       if(!entry->users) {
         if(multi->socket_cb) {
           set_in_callback(multi, TRUE);
@@ -3095,6 +3430,7 @@ void Curl_multi_closed(struct Curl_easy *data, curl_socket_t s)
 
       if(entry) {
         int rc = 0;
+        multi_ev_sync(multi, s, entry, TRUE);
         if(multi->socket_cb) {
           set_in_callback(multi, TRUE);
           rc = multi->socket_cb(data, s, CURL_POLL_REMOVE,
@@ -76,6 +76,15 @@ typedef enum {
 #define ENABLE_WAKEUP
 #endif
 
+/* curl_multi_wait() can keep the sockets registered with the kernel */
+#ifndef USE_WINSOCK
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1)
+#define USE_EPOLL
+#elif defined(HAVE_SYS_EVENT_H) && defined(HAVE_KQUEUE)
+#define USE_KQUEUE
+#endif
+#endif
+
 /* value for MAXIMUM CONCURRENT STREAMS upper limit */
 #define INITIAL_MAX_CONCURRENT_STREAMS ((1U << 31) - 1)
 
@@ -160,6 +169,13 @@ struct Curl_multi {
                                    0 is used for read, 1 is used for write */
 #endif
 #endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+  int evfd; /* epoll or kqueue descriptor holding the sockets of 'sockhash'
+               and what they wait for, -1 while curl_multi_wait() polls */
+  void *evlist; /* room for the events one wait returns */
+  unsigned int evsize; /* number of events that fit in 'evlist' */
+  unsigned int evcount; /* number of sockets registered in 'evfd' */
+#endif
 #define IPV6_UNKNOWN 0
 #define IPV6_DEAD    1
 #define IPV6_WORKS   2
@@ -172,6 +188,9 @@ struct Curl_multi {
 #endif
   BIT(dead); /* a callback returned error, everything needs to crash and
                 burn */
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+  BIT(evfailed); /* the event backend failed, stick to poll() */
+#endif
 #ifdef DEBUGBUILD
   BIT(warned);                 /* true after user warned of DEBUGBUILD */
 #endif
@@ -80,6 +80,10 @@ size_t tool_header_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
   if(!per->config)
     return CURL_WRITEFUNC_ERROR;
 
+  if(per->segprobe)
+    /* the --segments probe is not what the user asked for */
+    return cb;
+
 #ifdef DEBUGBUILD
   if(size * nmemb > (size_t)CURL_MAX_HTTP_HEADER) {
     warnf(per->config->global, "Header data exceeds single call write "
@@ -30,6 +30,10 @@
 
 #include <sys/stat.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #define ENABLE_CURLX_PRINTF
 /* use our own printf() functions */
 #include "curlx.h"
@@ -147,6 +151,534 @@ bool tool_create_output_file(struct OutStruct *outs,
   return TRUE;
 }
 
+/*
+ * Create the output file of a --segments download. It is opened just once,
+ * truncated and then extended to the full size, all segments write into it
+ * with pwrite() through the descriptor kept in the SegGroup.
+ */
+bool tool_create_segment_file(struct SegGroup *seg,
+                              struct OutStruct *outs,
+                              struct OperationConfig *config)
+{
+  int fd;
+  do {
+    fd = open(outs->filename, O_CREAT | O_WRONLY | O_TRUNC | O_BINARY,
+              OPENMODE);
+  } while(fd == -1 && errno == EINTR);
+  if(fd == -1) {
+    warnf(config->global, "Failed to open the file %s: %s\n",
+          outs->filename, strerror(errno));
+    return FALSE;
+  }
+#ifdef HAVE_FTRUNCATE
+  /* reserve the size up front, segments may finish in any order */
+  (void)ftruncate(fd, seg->size);
+#endif
+  seg->fd = fd;
+  return TRUE;
+}
+
+static ssize_t segment_pwrite(int fd, const char *buffer, size_t len,
+                              curl_off_t offset)
+{
+#ifdef WIN32
+  /* the tool is single-threaded, seeking first is as good as pwrite */
+  if(_lseeki64(fd, offset, SEEK_SET) == -1)
+    return -1;
+  return write(fd, buffer, (unsigned int)len);
+#else
+  return pwrite(fd, buffer, len, (off_t)offset);
+#endif
+}
+
+/*
+ * Check the first response of a segment: 206 must carry the range that was
+ * asked for. Anything else means the server ignored Range, then the first
+ * segment takes over the whole download and the others either step aside or,
+ * when the first one already got its range, pick their part out of the full
+ * body.
+ */
+static bool segment_check(struct per_transfer *per)
+{
+  struct SegGroup *seg = per->seg;
+  long code = 0;
+
+  per->segchecked = TRUE;
+  curl_easy_getinfo(per->curl, CURLINFO_RESPONSE_CODE, &code);
+  if(code == 206) {
+    struct curl_header *h;
+    curl_off_t first;
+    char *endp;
+    if(curl_easy_header(per->curl, "Content-Range", 0, CURLH_HEADER, -1, &h))
+      return FALSE;
+    /* bytes <first>-<last>/<complete-length> */
+    if(!curl_strnequal(h->value, "bytes ", 6) ||
+       curlx_strtoofft(&h->value[6], &endp, 10, &first) ||
+       (first != per->segstart)) {
+      warnf(per->config->global, "Unexpected Content-Range: %s\n",
+            h->value);
+      return FALSE;
+    }
+  }
+  else if(code != 200)
+    /* an error page is no part of the file, see segment_close() */
+    per->segskip = CURL_OFF_T_MAX;
+  else if(!per->segstart) {
+    seg->norange = TRUE;
+    per->segend = -1;
+  }
+  else if(!seg->norange)
+    per->segskip = per->segstart;
+  return TRUE;
+}
+
+/* the write callback for a --segments transfer */
+static size_t segment_write(struct per_transfer *per, char *buffer,
+                            size_t bytes)
+{
+  struct SegGroup *seg = per->seg;
+  struct OutStruct *outs = &per->outs;
+  curl_off_t pos;
+  size_t len = bytes;
+
+  if(!per->segchecked && !segment_check(per))
+    return CURL_WRITEFUNC_ERROR;
+
+  if(seg->norange && per->segstart) {
+    /* the first segment gets it all */
+    per->segdone = TRUE;
+    return CURL_WRITEFUNC_ERROR;
+  }
+
+  if(per->segskip) {
+    if((curl_off_t)len <= per->segskip) {
+      per->segskip -= len;
+      return bytes;
+    }
+    buffer += per->segskip;
+    len -= (size_t)per->segskip;
+    per->segskip = 0;
+  }
+
+  pos = per->segstart + outs->bytes;
+  if((per->segend >= 0) && ((curl_off_t)len > per->segend + 1 - pos)) {
+    /* more than this segment wants, keep our part and stop */
+    len = (size_t)(per->segend + 1 - pos);
+    per->segdone = TRUE;
+  }
+
+  while(len) {
+    ssize_t rc = segment_pwrite(seg->fd, buffer, len, pos);
+    if(rc < 0) {
+      if(errno == EINTR)
+        continue;
+      per->segdone = FALSE;
+      return CURL_WRITEFUNC_ERROR;
+    }
+    buffer += rc;
+    len -= (size_t)rc;
+    pos += rc;
+    outs->bytes += rc;
+  }
+  if(pos > seg->written)
+    seg->written = pos;
+
+  return per->segdone ? CURL_WRITEFUNC_ERROR : bytes;
+}
+
+#ifdef USE_WRITE_THREAD
+/*
+ * --write-queue: the write callback copies the data into large buffers that
+ * a few threads of their own write to the files, so a slow disk does not hold
+ * up the transfers. The buffers of one transfer are written in order by one
+ * thread at a time. A transfer that gets too far ahead of its file is paused,
+ * or has to wait when there is no multi handle to wake up.
+ */
+
+#define WRITE_CHUNK (256*1024) /* the size of the writes */
+#define WRITE_SPARES 8         /* written buffers kept for reuse */
+#define WRITE_THREADS 4        /* for parallel transfers, serial ones get 1 */
+
+struct WriteBuf {
+  struct WriteBuf *next;
+  struct WriteQueue *wq;
+  size_t len;
+  char data[WRITE_CHUNK];
+};
+
+struct WriteQueue {
+  struct WriteThread *wt;
+  struct WriteQueue *next; /* in the list of paused queues */
+  CURL *curl;
+  int fd;
+  struct WriteBuf *fill;   /* being filled, not queued yet */
+  size_t room;             /* queue 'fill' when it holds this much */
+  size_t queued;           /* bytes queued and not yet written */
+  int error;               /* errno of a failed write */
+  bool paused;
+  bool busy;               /* a thread is writing one of its buffers */
+};
+
+struct WriteThread {
+  pthread_t thread[WRITE_THREADS];
+  int nthreads;
+  pthread_mutex_t lock;
+  pthread_cond_t work;     /* a buffer was queued or the thread should stop */
+  pthread_cond_t done;     /* a buffer was written */
+  struct WriteBuf *head;   /* buffers to write, oldest first */
+  struct WriteBuf *tail;
+  struct WriteBuf *spare;
+  int nspare;
+  struct WriteQueue *paused;
+  CURLM *multi;            /* to wake up when paused transfers may go on */
+  size_t limit;            /* bytes a transfer may have queued */
+  bool stop;
+};
+
+static void *writer_thread(void *arg)
+{
+  struct WriteThread *wt = arg;
+
+  pthread_mutex_lock(&wt->lock);
+  for(;;) {
+    struct WriteBuf *prev = NULL;
+    struct WriteBuf *buf;
+    struct WriteQueue *wq;
+    const char *p;
+    size_t len;
+    int error;
+
+    /* the oldest buffer of a file no other thread is writing to */
+    for(buf = wt->head; buf && buf->wq->busy; buf = buf->next)
+      prev = buf;
+    if(!buf) {
+      if(wt->stop && !wt->head)
+        break;
+      pthread_cond_wait(&wt->work, &wt->lock);
+      continue;
+    }
+    if(prev)
+      prev->next = buf->next;
+    else
+      wt->head = buf->next;
+    if(wt->tail == buf)
+      wt->tail = prev;
+    wq = buf->wq;
+    wq->busy = TRUE;
+    error = wq->error;
+    pthread_mutex_unlock(&wt->lock);
+
+    /* after a failed write the rest of the file is not written */
+    p = buf->data;
+    len = buf->len;
+    while(len && !error) {
+      ssize_t rc = write(wq->fd, p, len);
+      if(rc > 0) {
+        p += rc;
+        len -= (size_t)rc;
+      }
+      else if(!rc)
+        error = EIO;
+      else if(errno != EINTR)
+        error = errno;
+    }
+
+    pthread_mutex_lock(&wt->lock);
+    if(error)
+      wq->error = error;
+    wq->busy = FALSE;
+    wq->queued -= buf->len;
+    if(wq->paused && wt->multi &&
+       (wq->error || (wq->queued <= wt->limit / 2)))
+      curl_multi_wakeup(wt->multi);
+    if(wt->nspare < WRITE_SPARES) {
+      buf->next = wt->spare;
+      wt->spare = buf;
+      wt->nspare++;
+    }
+    else
+      free(buf);
+    pthread_cond_broadcast(&wt->done);
+    if(wt->stop)
+      /* the others may be waiting for this one to end */
+      pthread_cond_broadcast(&wt->work);
+    else if(wq->queued)
+      /* its next buffer may be waiting for a thread */
+      pthread_cond_signal(&wt->work);
+  }
+  pthread_mutex_unlock(&wt->lock);
+  return NULL;
+}
+
+bool tool_writer_start(struct GlobalConfig *global, CURLM *multi)
+{
+  struct WriteThread *wt = calloc(1, sizeof(*wt));
+  if(!wt)
+    return FALSE;
+  wt->multi = multi;
+  /* two buffers at least, so that one can be filled while one is written */
+  if(global->write_queue < 2 * WRITE_CHUNK)
+    wt->limit = 2 * WRITE_CHUNK;
+  else if(global->write_queue > (curl_off_t)(SIZE_T_MAX / 2))
+    wt->limit = SIZE_T_MAX / 2;
+  else
+    wt->limit = (size_t)global->write_queue;
+  pthread_mutex_init(&wt->lock, NULL);
+  pthread_cond_init(&wt->work, NULL);
+  pthread_cond_init(&wt->done, NULL);
+  global->writer = wt;
+  while(wt->nthreads < (multi ? WRITE_THREADS : 1)) {
+    if(pthread_create(&wt->thread[wt->nthreads], NULL, writer_thread, wt))
+      break;
+    wt->nthreads++;
+  }
+  if(!wt->nthreads) {
+    tool_writer_stop(global);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void tool_writer_stop(struct GlobalConfig *global)
+{
+  struct WriteThread *wt = global->writer;
+  if(wt) {
+    int i;
+    /* the threads write what is left before they end */
+    pthread_mutex_lock(&wt->lock);
+    wt->stop = TRUE;
+    pthread_cond_broadcast(&wt->work);
+    pthread_mutex_unlock(&wt->lock);
+    for(i = 0; i < wt->nthreads; i++)
+      pthread_join(wt->thread[i], NULL);
+    while(wt->spare) {
+      struct WriteBuf *buf = wt->spare;
+      wt->spare = buf->next;
+      free(buf);
+    }
+    pthread_cond_destroy(&wt->done);
+    pthread_cond_destroy(&wt->work);
+    pthread_mutex_destroy(&wt->lock);
+    free(wt);
+    global->writer = NULL;
+  }
+}
+
+void tool_writer_resume(struct GlobalConfig *global)
+{
+  struct WriteThread *wt = global->writer;
+  struct WriteQueue **pp;
+  struct WriteQueue *wq;
+  struct WriteQueue *go = NULL;
+
+  if(!wt)
+    return;
+  pthread_mutex_lock(&wt->lock);
+  for(pp = &wt->paused; *pp;) {
+    wq = *pp;
+    if(wq->error || (wq->queued <= wt->limit / 2)) {
+      *pp = wq->next;
+      wq->paused = FALSE;
+      wq->next = go;
+      go = wq;
+    }
+    else
+      pp = &wq->next;
+  }
+  pthread_mutex_unlock(&wt->lock);
+
+  while(go) {
+    wq = go;
+    go = wq->next;
+    /* this may call the write callback, which may pause it again */
+    curl_easy_pause(wq->curl, CURLPAUSE_CONT);
+  }
+}
+
+/* hand over the buffer being filled, or drop it when empty */
+static void write_queue_push(struct WriteQueue *wq)
+{
+  struct WriteThread *wt = wq->wt;
+  struct WriteBuf *buf = wq->fill;
+
+  wq->fill = NULL;
+  pthread_mutex_lock(&wt->lock);
+  if(buf->len) {
+    buf->wq = wq;
+    buf->next = NULL;
+    if(wt->tail)
+      wt->tail->next = buf;
+    else
+      wt->head = buf;
+    wt->tail = buf;
+    wq->queued += buf->len;
+    pthread_cond_signal(&wt->work);
+  }
+  else if(wt->nspare < WRITE_SPARES) {
+    buf->next = wt->spare;
+    wt->spare = buf;
+    wt->nspare++;
+  }
+  else
+    free(buf);
+  pthread_mutex_unlock(&wt->lock);
+}
+
+/*
+ * Preallocate the rest of the file when its size is known, so that it gets
+ * laid out in one piece. The file size is left alone, a transfer that fails
+ * leaves a file no longer than what it got.
+ */
+static void write_queue_preallocate(struct per_transfer *per, int fd,
+                                    curl_off_t offset)
+{
+  curl_off_t size = -1;
+  curl_easy_getinfo(per->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+  if(size <= 0)
+    return;
+#if defined(F_PREALLOCATE)
+  {
+    fstore_t fst;
+    fst.fst_flags = F_ALLOCATEALL;
+    fst.fst_posmode = F_PEOFPOSMODE;
+    fst.fst_offset = 0;
+    fst.fst_length = (off_t)size;
+    fst.fst_bytesalloc = 0;
+    (void)fcntl(fd, F_PREALLOCATE, &fst);
+    (void)offset;
+  }
+#elif defined(FALLOC_FL_KEEP_SIZE)
+  (void)fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)size);
+#else
+  (void)fd;
+  (void)offset;
+#endif
+}
+
+/* route the data of this transfer through the writer threads */
+static bool write_queue_start(struct per_transfer *per)
+{
+  struct OutStruct *outs = &per->outs;
+  struct WriteQueue *wq;
+  struct_stat fileinfo;
+  curl_off_t offset = 0;
+  int fd;
+
+  if(fflush(outs->stream))
+    return FALSE;
+  wq = calloc(1, sizeof(*wq));
+  if(!wq)
+    return FALSE;
+  fd = fileno(outs->stream);
+  if(!fstat(fd, &fileinfo) && S_ISREG(fileinfo.st_mode)) {
+    offset = fileinfo.st_size;
+    write_queue_preallocate(per, fd, offset);
+  }
+  wq->wt = per->config->global->writer;
+  wq->curl = per->curl;
+  wq->fd = fd;
+  /* the first buffer fills up to the next WRITE_CHUNK boundary of the file,
+     then all writes are aligned */
+  wq->room = WRITE_CHUNK - (size_t)(offset % WRITE_CHUNK);
+  per->wq = wq;
+  return TRUE;
+}
+
+/* the write callback for a --write-queue transfer */
+static size_t write_queue_add(struct per_transfer *per, const char *buffer,
+                              size_t bytes)
+{
+  struct WriteQueue *wq = per->wq;
+  struct WriteThread *wt = wq->wt;
+  struct OperationConfig *config = per->config;
+  size_t left = bytes;
+  int error;
+
+  pthread_mutex_lock(&wt->lock);
+  while(!wq->error && wq->queued && (wq->queued + bytes > wt->limit)) {
+    if(wt->multi) {
+      /* let the file catch up, tool_writer_resume() continues this one */
+      if(!wq->paused) {
+        wq->paused = TRUE;
+        wq->next = wt->paused;
+        wt->paused = wq;
+      }
+      pthread_mutex_unlock(&wt->lock);
+      return CURL_WRITEFUNC_PAUSE;
+    }
+    pthread_cond_wait(&wt->done, &wt->lock);
+  }
+  error = wq->error;
+  pthread_mutex_unlock(&wt->lock);
+  if(error)
+    return CURL_WRITEFUNC_ERROR;
+
+  while(left) {
+    size_t n;
+    if(!wq->fill) {
+      pthread_mutex_lock(&wt->lock);
+      wq->fill = wt->spare;
+      if(wq->fill) {
+        wt->spare = wq->fill->next;
+        wt->nspare--;
+      }
+      pthread_mutex_unlock(&wt->lock);
+      if(!wq->fill) {
+        wq->fill = malloc(sizeof(struct WriteBuf));
+        if(!wq->fill)
+          return CURL_WRITEFUNC_ERROR;
+      }
+      wq->fill->len = 0;
+    }
+    n = wq->room - wq->fill->len;
+    if(n > left)
+      n = left;
+    memcpy(&wq->fill->data[wq->fill->len], buffer, n);
+    wq->fill->len += n;
+    buffer += n;
+    left -= n;
+    if(wq->fill->len == wq->room) {
+      write_queue_push(wq);
+      wq->room = WRITE_CHUNK;
+    }
+  }
+  per->outs.bytes += bytes;
+
+  if(config->readbusy) {
+    config->readbusy = FALSE;
+    curl_easy_pause(per->curl, CURLPAUSE_CONT);
+  }
+  return bytes;
+}
+
+int tool_write_queue_done(struct per_transfer *per)
+{
+  struct WriteQueue *wq = per->wq;
+  struct WriteThread *wt;
+  int error;
+
+  if(!wq)
+    return 0;
+  wt = wq->wt;
+  if(wq->fill)
+    write_queue_push(wq);
+  pthread_mutex_lock(&wt->lock);
+  if(wq->paused) {
+    struct WriteQueue **pp = &wt->paused;
+    while(*pp != wq)
+      pp = &(*pp)->next;
+    *pp = wq->next;
+  }
+  while(wq->queued)
+    pthread_cond_wait(&wt->done, &wt->lock);
+  error = wq->error;
+  pthread_mutex_unlock(&wt->lock);
+  free(wq);
+  per->wq = NULL;
+  return error;
+}
+#endif /* USE_WRITE_THREAD */
+
 /*
 ** callback for CURLOPT_WRITEFUNCTION
 */
@@ -164,6 +696,9 @@ size_t tool_write_cb(char *buffer, size_t sz, size_t nmemb, void *userdata)
   intptr_t fhnd;
 #endif
 
+  if(per->seg)
+    return segment_write(per, buffer, bytes);
+
 #ifdef DEBUGBUILD
   {
     char *tty = curlx_getenv("CURL_ISATTY");
@@ -220,6 +755,15 @@ size_t tool_write_cb(char *buffer, size_t sz, size_t nmemb, void *userdata)
   if(!outs->stream && !tool_create_output_file(outs, per->config))
     return CURL_WRITEFUNC_ERROR;
 
+#ifdef USE_WRITE_THREAD
+  if(!per->wq && config->global->writer && outs->fopened &&
+     !config->nobuffer && !config->show_headers &&
+     !write_queue_start(per))
+    return CURL_WRITEFUNC_ERROR;
+  if(per->wq)
+    return write_queue_add(per, buffer, bytes);
+#endif
+
   if(is_tty && (outs->bytes < 2000) && !config->terminal_binary_ok) {
     /* binary output to terminal? */
     if(memchr(buffer, 0, bytes)) {
@@ -35,4 +35,34 @@ size_t tool_write_cb(char *buffer, size_t sz, size_t nmemb, void *userdata);
 bool tool_create_output_file(struct OutStruct *outs,
                              struct OperationConfig *config);
 
+struct SegGroup;
+
+/* create the shared output file of a --segments download */
+bool tool_create_segment_file(struct SegGroup *seg,
+                              struct OutStruct *outs,
+                              struct OperationConfig *config);
+
+#if defined(HAVE_PTHREAD_H) && !defined(WIN32)
+#define USE_WRITE_THREAD
+#endif
+
+#ifdef USE_WRITE_THREAD
+struct per_transfer;
+
+/* start the --write-queue threads, 'multi' is NULL for serial transfers */
+bool tool_writer_start(struct GlobalConfig *global, CURLM *multi);
+void tool_writer_stop(struct GlobalConfig *global);
+
+/* continue the paused transfers the writer threads have caught up with */
+void tool_writer_resume(struct GlobalConfig *global);
+
+/* wait until all data of this transfer is written, return errno on failure */
+int tool_write_queue_done(struct per_transfer *per);
+#else
+#define tool_writer_start(x,y) TRUE
+#define tool_writer_stop(x) Curl_nop_stmt
+#define tool_writer_resume(x) Curl_nop_stmt
+#define tool_write_queue_done(x) 0
+#endif
+
 #endif /* HEADER_CURL_TOOL_CB_WRT_H */
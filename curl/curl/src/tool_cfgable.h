@@ -37,11 +37,8 @@ struct State {
   char *outfiles;
   char *httpgetfields;
   char *uploadfile;
-  unsigned long infilenum; /* number of files to upload */
   unsigned long up;  /* upload file counter within a single upload glob */
-  unsigned long urlnum; /* how many iterations this single URL has with ranges
-                           etc */
-  unsigned long li;
+  unsigned long li;  /* URL counter within a single URL glob */
 };
 
 struct OperationConfig {
@@ -231,6 +228,7 @@ struct OperationConfig {
   bool retry_connrefused;   /* set connection refused as a transient error */
   long retry_delay;         /* delay between retries (in seconds) */
   long retry_maxtime;       /* maximum time to keep retrying */
+  long segments;            /* split each download in this many ranges */
 
   char *ftp_account;        /* for ACCT */
   char *ftp_alternative_to_user;  /* send command if USER/PASS fails */
@@ -319,6 +317,9 @@ struct GlobalConfig {
   bool parallel;
   long parallel_max;
   bool parallel_connect;
+  curl_off_t write_queue;         /* bytes a transfer may have waiting for the
+                                     writer threads, 0 writes directly */
+  struct WriteThread *writer;     /* the writer threads for --write-queue */
   char *help_category;            /* The help category, if set */
   struct OperationConfig *first;
   struct OperationConfig *current;
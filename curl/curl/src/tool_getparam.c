@@ -32,6 +32,7 @@
 #include "tool_binmode.h"
 #include "tool_cfgable.h"
 #include "tool_cb_prg.h"
+#include "tool_cb_wrt.h"
 #include "tool_filetime.h"
 #include "tool_formparse.h"
 #include "tool_getparam.h"
@@ -355,6 +356,8 @@ static const struct LongShort aliases[]= {
   {"Z",  "parallel",                 ARG_BOOL},
   {"Zb", "parallel-max",             ARG_STRING},
   {"Zc", "parallel-immediate",       ARG_BOOL},
+  {"Zd", "segments",                 ARG_STRING},
+  {"Ze", "write-queue",              ARG_STRING},
   {"#",  "progress-bar",             ARG_BOOL},
   {"#m", "progress-meter",           ARG_BOOL},
   {":",  "next",                     ARG_NONE},
@@ -2428,6 +2431,30 @@ ParameterError getparameter(const char *flag, /* f or -long-flag */
       case 'c':   /* --parallel-connect */
         global->parallel_connect = toggle;
         break;
+      case 'd':   /* --segments */
+        err = str2unum(&config->segments, nextarg);
+        if(err)
+          return err;
+        if(config->segments > MAX_PARALLEL)
+          config->segments = MAX_PARALLEL;
+        if(config->segments > 1)
+          /* the segments are transferred side by side */
+          global->parallel = TRUE;
+        break;
+      case 'e':   /* --write-queue */
+        {
+          curl_off_t value;
+          ParameterError pe =
+            GetSizeParameter(global, nextarg, "write-queue", &value);
+
+          if(pe != PARAM_OK)
+            return pe;
+#ifndef USE_WRITE_THREAD
+          warnf(global, "--write-queue is not supported in this build\n");
+#endif
+          global->write_queue = value;
+        }
+        break;
       }
       break;
     case 'z': /* time condition coming up */
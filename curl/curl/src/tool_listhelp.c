@@ -621,6 +621,9 @@ const struct helptxt helptext[] = {
   {"    --sasl-ir",
    "Enable initial response in SASL authentication",
    CURLHELP_AUTH},
+  {"    --segments <num>",
+   "Download in this many ranges in parallel",
+   CURLHELP_HTTP},
   {"    --service-name <name>",
    "SPNEGO service name",
    CURLHELP_MISC},
@@ -783,6 +786,9 @@ const struct helptxt helptext[] = {
   {"-w, --write-out <format>",
    "Use output FORMAT after completion",
    CURLHELP_VERBOSE},
+  {"    --write-queue <size>",
+   "Queue SIZE bytes per transfer for writer threads",
+   CURLHELP_OUTPUT},
   {"    --xattr",
    "Store metadata in extended file attributes",
    CURLHELP_MISC},
@@ -49,6 +49,7 @@
 #include <TargetConditionals.h>
 #if TARGET_OS_IPHONE || TARGET_OS_WATCH || TARGET_OS_TV || TARGET_OS_MACCATALYST
 #include "ios_error.h"
+#include <pthread.h>
 #undef stdin
 #define stdin thread_stdin
 #undef stderr
@@ -388,6 +389,64 @@ void single_transfer_cleanup(struct OperationConfig *config)
   }
 }
 
+/*
+ * A --segments transfer is done for good. The last segment out closes the
+ * file, when any of them failed the download as a whole has failed.
+ */
+static CURLcode segment_close(struct GlobalConfig *global,
+                              struct per_transfer *per,
+                              CURLcode result)
+{
+  struct SegGroup *seg = per->seg;
+  struct OutStruct *outs = &per->outs;
+  int rc;
+
+  per->seg = NULL;
+  if(!result && !seg->norange && !per->segdone &&
+     (outs->bytes != per->segend + 1 - per->segstart)) {
+    long code = 0;
+    curl_easy_getinfo(per->curl, CURLINFO_RESPONSE_CODE, &code);
+    if(code / 100 != 2) {
+      result = CURLE_HTTP_RETURNED_ERROR;
+      if(!global->silent || global->showerror)
+        fprintf(stderr, "curl: (%d) The requested URL returned error: %ld\n",
+                result, code);
+    }
+    else {
+      result = CURLE_PARTIAL_FILE;
+      if(!global->silent || global->showerror)
+        fprintf(stderr, "curl: (%d) Got %" CURL_FORMAT_CURL_OFF_T
+                " bytes of segment %" CURL_FORMAT_CURL_OFF_T "-%"
+                CURL_FORMAT_CURL_OFF_T "\n", result, outs->bytes,
+                per->segstart, per->segend);
+    }
+  }
+  if(result && !seg->result)
+    seg->result = result;
+  if(--seg->refs)
+    return result;
+
+  rc = 0;
+#ifdef HAVE_FTRUNCATE
+  /* the body that came instead of the ranges may be shorter than told */
+  if(seg->norange && !seg->result)
+    rc = ftruncate(seg->fd, seg->written);
+#endif
+  if(close(seg->fd))
+    rc = -1;
+  if(rc && !seg->result) {
+    seg->result = result = CURLE_WRITE_ERROR;
+    if(!global->silent || global->showerror)
+      fprintf(stderr, "curl: (%d) Failed writing body\n", result);
+  }
+  if(seg->result && per->config->rm_partial) {
+    notef(global, "Removing output file: %s\n", outs->filename);
+    unlink(outs->filename);
+  }
+  free(seg);
+  return result;
+}
+
 /*
  * Call this after a transfer has completed.
  */
@@ -407,6 +466,21 @@ static CURLcode post_per_transfer(struct GlobalConfig *global,
   *retryp = FALSE;
   *delay = 0; /* for no retry, keep it zero */
 
+  if(per->segdone && (result == CURLE_WRITE_ERROR))
+    /* the segment stopped on purpose, see segment_write() */
+    result = CURLE_OK;
+
+  if(per->wq) {
+    /* the data queued for the writer threads must be in the file first */
+    int error = tool_write_queue_done(per);
+    if(error && (!result || (result == CURLE_WRITE_ERROR))) {
+      result = CURLE_WRITE_ERROR;
+      if(per->errorbuffer)
+        msnprintf(per->errorbuffer, CURL_ERROR_SIZE,
+                  "Failed writing body: %s", strerror(error));
+    }
+  }
+
   if(per->infdopen)
     close(per->infd);
 
@@ -446,7 +520,7 @@ static CURLcode post_per_transfer(struct GlobalConfig *global,
             outs->filename, strerror(errno));
   }
 
-  if(!result && !outs->stream && !outs->bytes) {
+  if(!result && !outs->stream && !outs->bytes && !per->seg) {
     /* we have received no data despite the transfer was successful
        ==> force creation of an empty output file (if an output file
        was specified) */
@@ -635,6 +709,15 @@ static CURLcode post_per_transfer(struct GlobalConfig *global,
         }
         outs->bytes = 0; /* clear for next round */
       }
+      else if(per->seg) {
+        /* the segment is written into its place again */
+        outs->bytes = 0;
+        per->segskip = 0;
+        per->segchecked = FALSE;
+        if(per->seg->norange && !per->segstart)
+          /* it has the whole download to itself now */
+          (void)curl_easy_setopt(curl, CURLOPT_RANGE, NULL);
+      }
       *retryp = TRUE;
       *delay = sleeptime;
       return CURLE_OK;
@@ -662,6 +745,8 @@ noretry:
       unlink(outs->filename);
     }
   }
+  else if(per->seg)
+    result = segment_close(global, per, result);
 
   AmigaSetComment(per, result);
 
@@ -772,7 +857,6 @@ static CURLcode single_transfer(struct GlobalConfig *global,
   if(!state->urlnode) {
     /* first time caller, setup things */
     state->urlnode = config->url_list;
-    state->infilenum = 1;
   }
 
   while(config->state.urlnode) {
@@ -813,7 +897,7 @@ static CURLcode single_transfer(struct GlobalConfig *global,
 
     if(!config->globoff && infiles && !inglob) {
       /* Unless explicitly shut off */
-      result = glob_url(&inglob, infiles, &state->infilenum,
+      result = glob_url(&inglob, infiles,
                         (!global->silent || global->showerror)?
                         stderr:NULL);
       if(result)
@@ -822,8 +906,6 @@ static CURLcode single_transfer(struct GlobalConfig *global,
     }
 
     {
-      unsigned long urlnum;
-
       if(!state->up && !infiles)
         Curl_nop_stmt;
       else {
@@ -845,24 +927,19 @@ static CURLcode single_transfer(struct GlobalConfig *global,
           break;
       }
 
-      if(!state->urlnum) {
-        if(!config->globoff) {
-          /* Unless explicitly shut off, we expand '{...}' and '[...]'
-             expressions and return total number of URLs in pattern set */
-          result = glob_url(&state->urls, urlnode->url, &state->urlnum,
-                            (!global->silent || global->showerror)?
-                            stderr:NULL);
-          if(result)
-            break;
-          urlnum = state->urlnum;
-        }
-        else
-          urlnum = 1; /* without globbing, this is a single URL */
+      if(!state->urls && !config->globoff) {
+        /* Unless explicitly shut off, we expand '{...}' and '[...]'
+           expressions. The URLs are generated one at a time as transfers
+           are set up, never counted or listed up front. */
+        result = glob_url(&state->urls, urlnode->url,
+                          (!global->silent || global->showerror)?
+                          stderr:NULL);
+        if(result)
+          break;
       }
-      else
-        urlnum = state->urlnum;
 
-      if(state->up < state->infilenum) {
+      /* with an upload glob, there's one more file until it runs out */
+      if(state->uploadfile || (!infiles && !state->up)) {
         struct per_transfer *per = NULL;
         struct OutStruct *outs;
         struct InStruct *input;
@@ -931,6 +1008,7 @@ static CURLcode single_transfer(struct GlobalConfig *global,
                     "Skip this transfer\n", config->etag_save_file);
               Curl_safefree(state->outfiles);
               glob_cleanup(state->urls);
+              state->urls = NULL;
               return CURLE_OK;
             }
             else {
@@ -2182,6 +2260,25 @@ static CURLcode single_transfer(struct GlobalConfig *global,
         if(config->hsts)
           my_setopt_str(curl, CURLOPT_HSTS, config->hsts);
 
+        if((config->segments > 1) && global->parallel &&
+           ((use_proto == proto_http) || (use_proto == proto_https)) &&
+           outs->filename && !per->uploadfile && !config->range &&
+           !config->resume_from && !config->resume_from_current &&
+           !config->show_headers && !config->no_body &&
+           !config->customrequest && !config->encoding &&
+           !hdrcbdata->honor_cd_filename &&
+           (config->file_clobber_mode != CLOBBER_NEVER) &&
+           ((config->httpreq == HTTPREQ_UNSPEC) ||
+            (config->httpreq == HTTPREQ_GET))) {
+          /* --segments: first ask for the size and range support with a
+             HEAD request, segments_start() takes it from there. Avoid
+             having this setopt added to the --libcurl source output. */
+          result = curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+          if(result)
+            break;
+          per->segprobe = TRUE;
+        }
+
         /* initialize retry vars for loop below */
         per->retry_sleep_default = (config->retry_delay) ?
           config->retry_delay*1000L : RETRY_SLEEP_DEFAULT; /* ms */
@@ -2191,9 +2288,9 @@ static CURLcode single_transfer(struct GlobalConfig *global,
 
         state->li++;
         /* Here's looping around each globbed URL */
-        if(state->li >= urlnum) {
+        if(!state->urls || glob_last(state->urls)) {
           state->li = 0;
-          state->urlnum = 0; /* forced reglob of URLs */
+          /* forced reglob of URLs */
           glob_cleanup(state->urls);
           state->urls = NULL;
           state->up++;
@@ -2208,7 +2305,6 @@ static CURLcode single_transfer(struct GlobalConfig *global,
         urlnode->flags = 0;
         glob_cleanup(state->urls);
         state->urls = NULL;
-        state->urlnum = 0;
 
         Curl_safefree(state->outfiles);
         Curl_safefree(state->uploadfile);
@@ -2235,6 +2331,155 @@ static CURLcode single_transfer(struct GlobalConfig *global,
 
 static long all_added; /* number of easy handles currently added */
 
+/* a segment smaller than this is not worth its own request */
+#define SEGMENT_MIN (64*1024)
+
+/* add a transfer for the range start-end of the download that 'leader' is
+   the first segment of */
+static CURLcode add_segment(struct per_transfer *leader,
+                            curl_off_t start, curl_off_t end)
+{
+  struct per_transfer *per;
+  char range[48]; /* two curl_off_t numbers */
+  char *filename;
+  char *url;
+  CURL *curl;
+  CURLcode result;
+
+  filename = strdup(leader->outs.filename);
+  url = strdup(leader->this_url);
+  curl = (filename && url) ? curl_easy_duphandle(leader->curl) : NULL;
+  if(!curl) {
+    free(filename);
+    free(url);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  result = add_per_transfer(&per);
+  if(result) {
+    curl_easy_cleanup(curl);
+    free(filename);
+    free(url);
+    return result;
+  }
+  per->config = leader->config;
+  per->curl = curl;
+  per->urlnum = leader->urlnum;
+  per->noprogress = leader->noprogress;
+  per->infd = STDIN_FILENO;
+  per->retry_numretries = leader->retry_numretries;
+  per->retry_sleep_default = leader->retry_sleep_default;
+  per->retry_sleep = leader->retry_sleep_default;
+  per->retrystart = tvnow();
+  per->seg = leader->seg;
+  per->seg->refs++;
+  per->segstart = start;
+  per->segend = end;
+
+  per->outs.s_isreg = TRUE;
+  per->outs.alloc_filename = TRUE;
+  per->outs.filename = filename;
+  per->this_url = url;
+
+  /* headers are only saved from the first segment */
+  per->hdrcbdata = leader->hdrcbdata;
+  per->hdrcbdata.outs = &per->outs;
+  per->hdrcbdata.heads = &per->heads;
+  per->hdrcbdata.etag_save = &per->etag_save;
+  per->input.config = per->config;
+  per->input.per = per;
+
+  msnprintf(range, sizeof(range), "%" CURL_FORMAT_CURL_OFF_T "-%"
+            CURL_FORMAT_CURL_OFF_T, start, end);
+  (void)curl_easy_setopt(curl, CURLOPT_RANGE, range);
+  (void)curl_easy_setopt(curl, CURLOPT_WRITEDATA, per);
+  (void)curl_easy_setopt(curl, CURLOPT_INTERLEAVEDATA, per);
+  (void)curl_easy_setopt(curl, CURLOPT_HEADERDATA, per);
+  (void)curl_easy_setopt(curl, CURLOPT_READDATA, &per->input);
+  (void)curl_easy_setopt(curl, CURLOPT_SEEKDATA, &per->input);
+  return CURLE_OK;
+}
+
+/* remove the segments add_segment() queued for 'leader' before they were
+   started */
+static void segments_drop(struct per_transfer *leader)
+{
+  struct per_transfer *per = transfers;
+  while(per) {
+    if((per != leader) && (per->seg == leader->seg)) {
+      curl_easy_cleanup(per->curl);
+      free(per->outs.filename);
+      free(per->this_url);
+      per->seg->refs--;
+      per = del_per_transfer(per);
+    }
+    else
+      per = per->next;
+  }
+}
+
+/*
+ * The --segments probe of 'per' is done. Unless the server told the size and
+ * that it takes byte ranges, 'per' goes on as a normal download. Otherwise it
+ * gets the first range and a transfer is added for each of the others, all
+ * of them are started by add_parallel_transfers().
+ */
+static CURLcode segments_start(struct per_transfer *per)
+{
+  struct OperationConfig *config = per->config;
+  struct curl_header *h;
+  curl_off_t size = -1;
+  long code = 0;
+  long n = config->segments;
+  CURLcode result = CURLE_OK;
+
+  per->segprobe = FALSE;
+  (void)curl_easy_setopt(per->curl, CURLOPT_NOBODY, 0L);
+  curl_easy_getinfo(per->curl, CURLINFO_RESPONSE_CODE, &code);
+  curl_easy_getinfo(per->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+  if((code != 200) || (size < 2 * SEGMENT_MIN) ||
+     curl_easy_header(per->curl, "Accept-Ranges", 0, CURLH_HEADER, -1, &h) ||
+     !curl_strequal(h->value, "bytes"))
+    n = 1;
+  else if(size / n < SEGMENT_MIN)
+    n = (long)(size / SEGMENT_MIN);
+
+  /* the probe's error buffer goes, neither the handle nor the copies made of
+     it for the segments may point to it */
+  (void)curl_easy_setopt(per->curl, CURLOPT_ERRORBUFFER, NULL);
+  Curl_safefree(per->errorbuffer);
+
+  if(n > 1) {
+    curl_off_t chunk = size / n;
+    char range[32];
+    long i;
+    struct SegGroup *seg = calloc(1, sizeof(struct SegGroup));
+    if(!seg)
+      return CURLE_OUT_OF_MEMORY;
+    seg->size = size;
+    if(!tool_create_segment_file(seg, &per->outs, config)) {
+      free(seg);
+      return CURLE_WRITE_ERROR;
+    }
+    seg->refs = 1;
+    per->seg = seg;
+    per->segstart = 0;
+    per->segend = chunk - 1;
+    msnprintf(range, sizeof(range), "0-%" CURL_FORMAT_CURL_OFF_T, chunk - 1);
+    (void)curl_easy_setopt(per->curl, CURLOPT_RANGE, range);
+    for(i = 1; !result && (i < n); i++)
+      result = add_segment(per, i * chunk,
+                           (i == n - 1) ? size - 1 : (i + 1) * chunk - 1);
+    if(result)
+      segments_drop(per);
+  }
+
+  /* have it added again, the probe does not count for the progress meter */
+  per->added = FALSE;
+  per->dltotal = per->dlnow = 0;
+  per->dltotal_added = FALSE;
+  return result;
+}
+
 /*
  * add_parallel_transfers() sets 'morep' to TRUE if there are more transfers
  * to add even after this call returns. sets 'addedp' to TRUE if one or more
@@ -2331,9 +2576,13 @@ static CURLcode parallel_transfers(struct GlobalConfig *global,
   if(!multi)
     return CURLE_OUT_OF_MEMORY;
 
+  if(global->write_queue && !tool_writer_start(global, multi))
+    warnf(global, "Failed to start the writer threads\n");
+
   result = add_parallel_transfers(global, multi, share,
                                   &more_transfers, &added_transfers);
   if(result) {
+    tool_writer_stop(global);
     curl_multi_cleanup(multi);
     return result;
   }
@@ -2355,8 +2604,11 @@ static CURLcode parallel_transfers(struct GlobalConfig *global,
     }
 
     mcode = curl_multi_poll(multi, NULL, 0, 1000, NULL);
-    if(!mcode)
+    if(!mcode) {
+      /* continue transfers paused by --write-queue */
+      tool_writer_resume(global);
       mcode = curl_multi_perform(multi, &still_running);
+    }
 
     progress_meter(global, &start, FALSE);
 
@@ -2381,6 +2633,15 @@ static CURLcode parallel_transfers(struct GlobalConfig *global,
                       "Transfer aborted due to critical error "
                       "in another transfer");
           }
+          if(ended->segprobe && !tres) {
+            /* the --segments probe is done, now get the data */
+            tres = segments_start(ended);
+            if(!tres) {
+              all_added--;
+              checkmore = TRUE;
+              continue;
+            }
+          }
           tres = post_per_transfer(global, ended, tres, &retry, &delay);
           progress_finalize(ended); /* before it goes away */
           all_added--; /* one fewer added */
@@ -2440,6 +2701,7 @@ static CURLcode parallel_transfers(struct GlobalConfig *global,
       CURLE_BAD_FUNCTION_ARGUMENT;
   }
 
+  tool_writer_stop(global);
   curl_multi_cleanup(multi);
 
   return result;
@@ -2460,6 +2722,8 @@ static CURLcode serial_transfers(struct GlobalConfig *global,
     errorf(global, "no transfer performed\n");
     return CURLE_READ_ERROR;
   }
+  if(global->write_queue && !tool_writer_start(global, NULL))
+    warnf(global, "Failed to start the writer threads\n");
   for(per = transfers; per;) {
     bool retry;
     long delay_ms;
@@ -2521,6 +2785,8 @@ static CURLcode serial_transfers(struct GlobalConfig *global,
     /* returncode errors have priority */
     result = returncode;
 
+  tool_writer_stop(global);
+
   if(result)
     single_transfer_cleanup(global->current);
 
@@ -2696,6 +2962,98 @@ static CURLcode run_all_transfers(struct GlobalConfig *global,
   return result;
 }
 
+#if TARGET_OS_IPHONE || TARGET_OS_WATCH || TARGET_OS_TV || TARGET_OS_MACCATALYST
+/*
+ * ios_system runs curl as a function in a process that stays around, so the
+ * share handle of a finished command is kept for the next one: commands in
+ * a script then reuse the resolved names, TLS sessions and open connections
+ * of those before them. A kept handle is only ever used by one command at a
+ * time, which is why it needs no lock callbacks.
+ */
+#define SHARE_POOL
+#define SHARE_POOL_MAX 4 /* idle share handles to keep */
+static pthread_mutex_t share_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static CURLSH *share_pool[SHARE_POOL_MAX];
+static int share_pool_count;
+static bool share_pool_inited; /* libcurl stays initialized for the pool */
+#endif
+
+/*
+ * Get the share handle for the transfers of this command line.
+ */
+static CURLSH *share_get(void)
+{
+  CURLSH *share = NULL;
+
+#ifdef SHARE_POOL
+  pthread_mutex_lock(&share_pool_lock);
+  if(share_pool_count)
+    share = share_pool[--share_pool_count];
+  pthread_mutex_unlock(&share_pool_lock);
+  if(share)
+    return share;
+#endif
+
+  share = curl_share_init();
+  if(share) {
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_PSL);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_HSTS);
+  }
+  return share;
+}
+
+/*
+ * Done with the share handle of this command line, all its easy handles are
+ * gone.
+ */
+static void share_put(struct GlobalConfig *global, CURLSH *share)
+{
+#ifdef SHARE_POOL
+  struct OperationConfig *config;
+  bool keep = TRUE;
+
+  /* names given with --resolve would stay in the DNS cache for good */
+  for(config = global->first; config; config = config->next)
+    if(config->resolve)
+      keep = FALSE;
+
+  /* the next command starts without the cookies and HSTS entries of this
+     one */
+  curl_share_setopt(share, CURLSHOPT_UNSHARE, CURL_LOCK_DATA_COOKIE);
+  if(curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE) ==
+     CURLSHE_NOMEM)
+    keep = FALSE;
+  curl_share_setopt(share, CURLSHOPT_UNSHARE, CURL_LOCK_DATA_HSTS);
+  if(curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_HSTS) ==
+     CURLSHE_NOMEM)
+    keep = FALSE;
+
+  if(keep) {
+    pthread_mutex_lock(&share_pool_lock);
+    if(share_pool_count < SHARE_POOL_MAX) {
+      /* the command's own curl_global_cleanup() must not take down what
+         the kept handles use */
+      if(!share_pool_inited && !curl_global_init(CURL_GLOBAL_DEFAULT))
+        share_pool_inited = TRUE;
+      if(share_pool_inited) {
+        share_pool[share_pool_count++] = share;
+        share = NULL;
+      }
+    }
+    pthread_mutex_unlock(&share_pool_lock);
+  }
+#else
+  (void)global;
+#endif
+
+  if(share)
+    curl_share_cleanup(share);
+}
+
 CURLcode operate(struct GlobalConfig *global, int argc, argv_item_t argv[])
 {
   CURLcode result = CURLE_OK;
@@ -2757,7 +3115,7 @@ CURLcode operate(struct GlobalConfig *global, int argc, argv_item_t argv[])
       if(!result) {
         size_t count = 0;
         struct OperationConfig *operation = global->first;
-        CURLSH *share = curl_share_init();
+        CURLSH *share = share_get();
         if(!share) {
           if(global->libcurl) {
             /* Cleanup the libcurl source output */
@@ -2766,13 +3124,6 @@ CURLcode operate(struct GlobalConfig *global, int argc, argv_item_t argv[])
           return CURLE_OUT_OF_MEMORY;
         }
 
-        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
-        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
-        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
-        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
-        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_PSL);
-        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_HSTS);
-
         /* Get the required arguments for each operation */
         do {
           result = get_args(operation, count++);
@@ -2786,7 +3137,7 @@ CURLcode operate(struct GlobalConfig *global, int argc, argv_item_t argv[])
         /* now run! */
         result = run_all_transfers(global, share, result);
 
-        curl_share_cleanup(share);
+        share_put(global, share);
         if(global->libcurl) {
           /* Cleanup the libcurl source output */
           easysrc_cleanup();
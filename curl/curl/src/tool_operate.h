@@ -28,6 +28,19 @@
 #include "tool_cb_prg.h"
 #include "tool_sdecls.h"
 
+/*
+ * A download split up with --segments. All segments write into the same
+ * file descriptor at their own offsets.
+ */
+struct SegGroup {
+  int fd;              /* shared output file */
+  curl_off_t size;     /* size of the resource, as told by the probe */
+  curl_off_t written;  /* highest offset written so far */
+  long refs;           /* segments not yet done */
+  bool norange;        /* Range was ignored, the first segment does it all */
+  CURLcode result;     /* first error seen in any segment */
+};
+
 struct per_transfer {
   /* double linked */
   struct per_transfer *next;
@@ -71,6 +84,17 @@ struct per_transfer {
   bool dltotal_added; /* if the total has been added from this */
   bool ultotal_added;
 
+  /* --segments */
+  struct SegGroup *seg;
+  curl_off_t segstart; /* first byte of this segment */
+  curl_off_t segend;   /* last byte of this segment, -1 for the rest */
+  curl_off_t segskip;  /* response bytes to drop before segstart */
+  bool segprobe;       /* HEAD request to learn size and range support */
+  bool segchecked;     /* the response code has been looked at */
+  bool segdone;        /* stopped on purpose, the error is not real */
+
+  struct WriteQueue *wq; /* --write-queue, NULL when writing directly */
+
   /* NULL or malloced */
   char *uploadfile;
   char *errorbuffer; /* alloced and assigned while this is used for a
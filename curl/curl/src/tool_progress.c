@@ -95,6 +95,9 @@ int xferinfo_cb(void *clientp,
 {
   struct per_transfer *per = clientp;
   struct OperationConfig *config = per->config;
+  if(per->segprobe)
+    /* a --segments probe has no body to account for */
+    return per->abort ? 1 : 0;
   per->dltotal = dltotal;
   per->dlnow = dlnow;
   per->ultotal = ultotal;
@@ -68,26 +68,8 @@ static CURLcode glob_fixed(struct URLGlob *glob, char *fixed, size_t len)
   return CURLE_OK;
 }
 
-/* multiply
- *
- * Multiplies and checks for overflow.
- */
-static int multiply(unsigned long *amount, long with)
-{
-  unsigned long sum = *amount * with;
-  if(!with) {
-    *amount = 0;
-    return 0;
-  }
-  if(sum/with != *amount)
-    return 1; /* didn't fit, bail out */
-  *amount = sum;
-  return 0;
-}
-
 static CURLcode glob_set(struct URLGlob *glob, char **patternp,
-                         size_t *posp, unsigned long *amount,
-                         int globindex)
+                         size_t *posp, int globindex)
 {
   /* processes a set expression with the point behind the opening '{'
      ','-separated elements are collected until the next closing '}'
@@ -121,10 +103,6 @@ static CURLcode glob_set(struct URLGlob *glob, char **patternp,
         return GLOBERROR("empty string within braces", *posp,
                          CURLE_URL_MALFORMAT);
 
-      /* add 1 to size since it'll be incremented below */
-      if(multiply(amount, pat->content.Set.size + 1))
-        return GLOBERROR("range overflow", 0, CURLE_URL_MALFORMAT);
-
       /* FALLTHROUGH */
     case ',':
 
@@ -180,8 +158,7 @@ static CURLcode glob_set(struct URLGlob *glob, char **patternp,
 }
 
 static CURLcode glob_range(struct URLGlob *glob, char **patternp,
-                           size_t *posp, unsigned long *amount,
-                           int globindex)
+                           size_t *posp, int globindex)
 {
   /* processes a range expression with the point behind the opening '['
      - char range: e.g. "a-z]", "B-Q]"
@@ -239,11 +216,6 @@ static CURLcode glob_range(struct URLGlob *glob, char **patternp,
     pat->content.CharRange.step = (int)step;
     pat->content.CharRange.ptr_c = pat->content.CharRange.min_c = min_c;
     pat->content.CharRange.max_c = max_c;
-
-    if(multiply(amount, ((pat->content.CharRange.max_c -
-                          pat->content.CharRange.min_c) /
-                         pat->content.CharRange.step + 1)))
-      return GLOBERROR("range overflow", *posp, CURLE_URL_MALFORMAT);
   }
   else if(ISDIGIT(*pattern)) {
     /* numeric range detected */
@@ -317,11 +289,6 @@ fail:
     pat->content.NumRange.ptr_n = pat->content.NumRange.min_n = min_n;
     pat->content.NumRange.max_n = max_n;
     pat->content.NumRange.step = step_n;
-
-    if(multiply(amount, ((pat->content.NumRange.max_n -
-                          pat->content.NumRange.min_n) /
-                         pat->content.NumRange.step + 1)))
-      return GLOBERROR("range overflow", *posp, CURLE_URL_MALFORMAT);
   }
   else
     return GLOBERROR("bad range specification", *posp, CURLE_URL_MALFORMAT);
@@ -368,7 +335,7 @@ static bool peek_ipv6(const char *str, size_t *skip)
 }
 
 static CURLcode glob_parse(struct URLGlob *glob, char *pattern,
-                           size_t pos, unsigned long *amount)
+                           size_t pos)
 {
   /* processes a literal string component of a URL
      special characters '{' and '[' branch to set/range processing functions
@@ -376,8 +343,6 @@ static CURLcode glob_parse(struct URLGlob *glob, char *pattern,
   CURLcode res = CURLE_OK;
   int globindex = 0; /* count "actual" globs */
 
-  *amount = 1;
-
   while(*pattern && !res) {
     char *buf = glob->glob_buffer;
     size_t sublen = 0;
@@ -427,14 +392,14 @@ static CURLcode glob_parse(struct URLGlob *glob, char *pattern,
         /* process set pattern */
         pattern++;
         pos++;
-        res = glob_set(glob, &pattern, &pos, amount, globindex++);
+        res = glob_set(glob, &pattern, &pos, globindex++);
         break;
 
       case '[':
         /* process range pattern */
         pattern++;
         pos++;
-        res = glob_range(glob, &pattern, &pos, amount, globindex++);
+        res = glob_range(glob, &pattern, &pos, globindex++);
         break;
       }
     }
@@ -445,15 +410,13 @@ static CURLcode glob_parse(struct URLGlob *glob, char *pattern,
   return res;
 }
 
-CURLcode glob_url(struct URLGlob **glob, char *url, unsigned long *urlnum,
-                  FILE *error)
+CURLcode glob_url(struct URLGlob **glob, char *url, FILE *error)
 {
   /*
    * We can deal with any-size, just make a buffer with the same length
    * as the specified URL!
    */
   struct URLGlob *glob_expand;
-  unsigned long amount = 0;
   char *glob_buffer;
   CURLcode res;
 
@@ -472,10 +435,8 @@ CURLcode glob_url(struct URLGlob **glob, char *url, unsigned long *urlnum,
   glob_expand->urllen = strlen(url);
   glob_expand->glob_buffer = glob_buffer;
 
-  res = glob_parse(glob_expand, url, 1, &amount);
-  if(!res)
-    *urlnum = amount;
-  else {
+  res = glob_parse(glob_expand, url, 1);
+  if(res) {
     if(error && glob_expand->error) {
       char text[512];
       const char *t;
@@ -493,7 +454,6 @@ CURLcode glob_url(struct URLGlob **glob, char *url, unsigned long *urlnum,
     }
     /* it failed, we cleanup */
     glob_cleanup(glob_expand);
-    *urlnum = 1;
     return res;
   }
 
@@ -529,8 +489,9 @@ CURLcode glob_next_url(char **globbed, struct URLGlob *glob)
   struct URLPattern *pat;
   size_t i;
   size_t len;
-  size_t buflen = glob->urllen + 1;
-  char *buf = glob->glob_buffer;
+  size_t first = 0; /* leftmost pattern that changed */
+  size_t buflen;
+  char *buf;
 
   *globbed = NULL;
 
@@ -542,6 +503,7 @@ CURLcode glob_next_url(char **globbed, struct URLGlob *glob)
     /* implement a counter over the index ranges of all patterns, starting
        with the rightmost pattern */
     for(i = 0; carry && (i < glob->size); i++) {
+      int c;
       carry = FALSE;
       pat = &glob->pattern[glob->size - 1 - i];
       switch(pat->type) {
@@ -553,20 +515,23 @@ CURLcode glob_next_url(char **globbed, struct URLGlob *glob)
         }
         break;
       case UPTCharRange:
-        pat->content.CharRange.ptr_c =
-          (char)(pat->content.CharRange.step +
-                 (int)((unsigned char)pat->content.CharRange.ptr_c));
-        if(pat->content.CharRange.ptr_c > pat->content.CharRange.max_c) {
+        c = pat->content.CharRange.step +
+          (int)((unsigned char)pat->content.CharRange.ptr_c);
+        if(c > (int)((unsigned char)pat->content.CharRange.max_c)) {
           pat->content.CharRange.ptr_c = pat->content.CharRange.min_c;
           carry = TRUE;
         }
+        else
+          pat->content.CharRange.ptr_c = (char)c;
         break;
       case UPTNumRange:
-        pat->content.NumRange.ptr_n += pat->content.NumRange.step;
-        if(pat->content.NumRange.ptr_n > pat->content.NumRange.max_n) {
+        if(pat->content.NumRange.max_n - pat->content.NumRange.ptr_n <
+           pat->content.NumRange.step) {
           pat->content.NumRange.ptr_n = pat->content.NumRange.min_n;
           carry = TRUE;
         }
+        else
+          pat->content.NumRange.ptr_n += pat->content.NumRange.step;
         break;
       default:
         printf("internal error: invalid pattern type (%d)\n", (int)pat->type);
@@ -576,10 +541,18 @@ CURLcode glob_next_url(char **globbed, struct URLGlob *glob)
     if(carry) {         /* first pattern ptr has run into overflow, done! */
       return CURLE_OK;
     }
+    first = glob->size - i;
   }
 
-  for(i = 0; i < glob->size; ++i) {
+  /* the text before the leftmost changed pattern is still in the buffer
+     from the previous URL, only the rest is written again */
+  buf = glob->glob_buffer;
+  if(first)
+    buf += glob->pattern[first].offset;
+  buflen = glob->urllen + 1 - (buf - glob->glob_buffer);
+  for(i = first; i < glob->size; ++i) {
     pat = &glob->pattern[i];
+    pat->offset = buf - glob->glob_buffer;
     switch(pat->type) {
     case UPTSet:
       if(pat->content.Set.elements) {
@@ -618,6 +591,42 @@ CURLcode glob_next_url(char **globbed, struct URLGlob *glob)
   return CURLE_OK;
 }
 
+/*
+ * Returns TRUE when the URL glob_next_url() returned last is the final one,
+ * so that the next call would run out. Nothing is counted up front, the
+ * glob can be of any size.
+ */
+bool glob_last(struct URLGlob *glob)
+{
+  size_t i;
+
+  if(!glob->beenhere)
+    return FALSE;
+  for(i = 0; i < glob->size; i++) {
+    struct URLPattern *pat = &glob->pattern[i];
+    switch(pat->type) {
+    case UPTSet:
+      if(pat->content.Set.ptr_s + 1 < pat->content.Set.size)
+        return FALSE;
+      break;
+    case UPTCharRange:
+      if(pat->content.CharRange.step +
+         (int)((unsigned char)pat->content.CharRange.ptr_c) <=
+         (int)((unsigned char)pat->content.CharRange.max_c))
+        return FALSE;
+      break;
+    case UPTNumRange:
+      if(pat->content.NumRange.max_n - pat->content.NumRange.ptr_n >=
+         pat->content.NumRange.step)
+        return FALSE;
+      break;
+    default:
+      break;
+    }
+  }
+  return TRUE;
+}
+
 #define MAX_OUTPUT_GLOB_LENGTH (10*1024)
 
 CURLcode glob_match_url(char **result, char *filename, struct URLGlob *glob)
@@ -35,6 +35,7 @@ struct URLPattern {
   URLPatternType type;
   int globindex; /* the number of this particular glob or -1 if not used
                     within {} or [] */
+  size_t offset; /* where its text starts in the glob buffer */
   union {
     struct {
       char **elements;
@@ -70,8 +71,9 @@ struct URLGlob {
   size_t pos;        /* column position of error or 0 */
 };
 
-CURLcode glob_url(struct URLGlob**, char *, unsigned long *, FILE *);
+CURLcode glob_url(struct URLGlob**, char *, FILE *);
 CURLcode glob_next_url(char **, struct URLGlob *);
+bool glob_last(struct URLGlob *);
 CURLcode glob_match_url(char **, char *, struct URLGlob *);
 void glob_cleanup(struct URLGlob *glob);
 
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ * SPDX-License-Identifier: curl
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Download a file:// URL into a FILE * with the default write callback and
+ * upload the result with the default read callback, while stdio holds
+ * buffered data on both streams around the transfers.
+ */
+int test(char *URL)
+{
+  CURLcode res = CURLE_OK;
+  CURL *curl = NULL;
+  FILE *out = NULL;
+  FILE *in = NULL;
+
+  if(!libtest_arg2 || !libtest_arg3) {
+    fprintf(stderr, "Usage: <url> <file> <upload url>\n");
+    return TEST_ERR_USAGE;
+  }
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+
+  out = fopen(libtest_arg2, "wb");
+  if(!out) {
+    fprintf(stderr, "fopen failed\n");
+    res = TEST_ERR_FOPEN;
+    goto test_cleanup;
+  }
+  fputs("before\n", out);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_WRITEDATA, out);
+
+  res = curl_easy_perform(curl);
+  if(res)
+    goto test_cleanup;
+
+  fputs("after\n", out);
+  fclose(out);
+  out = NULL;
+
+  in = fopen(libtest_arg2, "rb");
+  if(!in) {
+    fprintf(stderr, "fopen failed\n");
+    res = TEST_ERR_FOPEN;
+    goto test_cleanup;
+  }
+  /* leave the rest of the first line buffered in the stream */
+  if(fgetc(in) == EOF) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  easy_setopt(curl, CURLOPT_URL, libtest_arg3);
+  easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+  easy_setopt(curl, CURLOPT_READDATA, in);
+
+  res = curl_easy_perform(curl);
+
+test_cleanup:
+
+  if(out)
+    fclose(out);
+  if(in)
+    fclose(in);
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return (int)res;
+}
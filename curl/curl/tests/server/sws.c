@@ -112,6 +112,8 @@ struct httprequest {
   size_t cl;      /* Content-Length of the incoming request */
   bool digest;    /* Authorization digest header found */
   bool ntlm;      /* Authorization ntlm header found */
+  bool rangeparts; /* reply part follows the Range: header */
+  bool range;     /* Range: header found */
   int writedelay; /* if non-zero, delay this number of milliseconds between
                      writes in the response */
   int skip;       /* if non-zero, the server is instructed to not read this
@@ -193,6 +195,9 @@ const char *cmdfile = DEFAULT_CMDFILE;
 /* deny Expect: requests */
 #define CMD_NOEXPECT "no-expect"
 
+/* pick the reply part by the start of the requested byte range */
+#define CMD_RANGEPARTS "range-parts"
+
 #define END_OF_HEADERS "\r\n\r\n"
 
 enum {
@@ -328,6 +333,10 @@ static int parse_servercmd(struct httprequest *req)
         logmsg("instructed to reject Expect: 100-continue");
         req->noexpect = TRUE;
       }
+      else if(!strncmp(CMD_RANGEPARTS, cmd, strlen(CMD_RANGEPARTS))) {
+        logmsg("instructed to reply by the requested range");
+        req->rangeparts = TRUE;
+      }
       else if(1 == sscanf(cmd, "writedelay: %d", &num)) {
         logmsg("instructed to delay %d msecs between packets", num);
         req->writedelay = num;
@@ -741,6 +750,16 @@ static int ProcessRequest(struct httprequest *req)
     req->partno += 1;
     logmsg("Received Basic request, sending back data %ld", req->partno);
   }
+  if(req->rangeparts && !req->range) {
+    char *range = strstr(req->reqbuf, "\r\nRange: bytes=");
+    if(range) {
+      /* a request for bytes N- gets the reply part N + 1, leaving part 0 to
+         the requests without a range */
+      req->partno += strtol(range + 15, NULL, 10) + 1;
+      req->range = TRUE;
+      logmsg("Received Range request, sending back data %ld", req->partno);
+    }
+  }
   if(strstr(req->reqbuf, "Connection: close"))
     req->open = FALSE; /* close connection after this request */
 
@@ -851,6 +870,8 @@ static void init_httprequest(struct httprequest *req)
   req->cl = 0;
   req->digest = FALSE;
   req->ntlm = FALSE;
+  req->rangeparts = FALSE;
+  req->range = FALSE;
   req->skip = 0;
   req->skipall = FALSE;
   req->noexpect = FALSE;
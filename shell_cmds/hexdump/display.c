@@ -58,6 +58,43 @@ static off_t eaddress;			/* end address */
 
 static __inline void print(PR *, u_char *);
 
+/*
+ * Formats made only of text, unsigned integer and address conversions
+ * and %_p, which covers the canned hexdump formats and od's integer
+ * types, are compiled into a list of operations on a whole block.
+ * Full blocks are then formatted straight into a buffer with lookup
+ * tables instead of a printf call per conversion; anything else, and
+ * the last partial block, goes through print().
+ */
+#define	OP_TEXT		0		/* literal text */
+#define	OP_UINT		1		/* %[ouxX] */
+#define	OP_ADDR		2		/* %_a[dox] */
+#define	OP_P		3		/* %_p */
+
+typedef struct {
+	int op;
+	int off;			/* offset of the data in the block */
+	int bcnt;			/* bytes of data */
+	int base;			/* 8, 10 or 16 */
+	int upper;			/* %X */
+	int hex2;			/* a byte as exactly two hex digits */
+	int left, zero;			/* '-' and '0' flags */
+	int width, prec;		/* field width, precision or -1 */
+	const char *text;		/* text before the conversion */
+	size_t tlen;
+} OP;
+
+static OP *ops;
+static int nops;
+static char *obuf;
+static size_t obuflen;
+static char ptab[256];			/* %_p output for each byte */
+static char hextab[2][256][2];		/* bytes as two hex digits */
+
+static int compile(void);
+static int compilepr(PR *, int, int, int);
+static void fastblock(u_char *);
+
 void
 display(void)
 {
@@ -68,8 +105,13 @@ display(void)
 	u_char *bp;
 	off_t saveaddress;
 	u_char savech=0, *savebp;
+	int fast;
 
+	fast = compile();
 	while ((bp = get()))
+	    if (fast && !eaddress)
+		fastblock(bp);
+	    else
 	    for (fs = fshead, savebp = bp, saveaddress = address; fs;
 		fs = fs->nextfs, bp = savebp, address = saveaddress)
 		    for (fu = fs->nextfu; fu; fu = fu->nextfu) {
@@ -115,6 +157,246 @@ display(void)
 	}
 }
 
+/*
+ * Compile the format strings for fastblock(); returns 0 if they use
+ * anything it does not handle.
+ */
+static int
+compile(void)
+{
+	FS *fs;
+	FU *fu;
+	PR *pr;
+	int c, cnt, off;
+	size_t len;
+
+	nops = 0;
+	for (fs = fshead; fs; fs = fs->nextfs)
+		for (off = 0, fu = fs->nextfu; fu; fu = fu->nextfu) {
+			if (fu->flags&F_IGNORE)
+				break;
+			for (cnt = fu->reps; cnt; --cnt)
+				for (pr = fu->nextpr; pr; off += pr->bcnt,
+				    pr = pr->nextpr)
+					if (!compilepr(pr, off, cnt == 1,
+					    blocksize))
+						return (0);
+		}
+	if (nops == 0)
+		return (0);
+
+	for (c = 0; c < 256; c++) {
+		ptab[c] = isprint(c) && isascii(c) ? c : '.';
+		hextab[0][c][0] = "0123456789abcdef"[c >> 4];
+		hextab[0][c][1] = "0123456789abcdef"[c & 15];
+		hextab[1][c][0] = "0123456789ABCDEF"[c >> 4];
+		hextab[1][c][1] = "0123456789ABCDEF"[c & 15];
+	}
+
+	/* Bound the output of one block. */
+	for (len = 0, c = 0; c < nops; c++)
+		len += ops[c].tlen + MAX(ops[c].width, 24) +
+		    MAX(ops[c].prec, 0);
+	if ((obuf = malloc(len)) == NULL)
+		err(1, NULL);
+	obuflen = len;
+	if (!isatty(STDOUT_FILENO))
+		(void)setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+	return (1);
+}
+
+/*
+ * Add the operations for one print unit; "last" is set on the last
+ * repetition of its format unit, where trailing white space is dropped.
+ */
+static int
+compilepr(PR *pr, int off, int last, int bsize)
+{
+	static int nalloc;
+	OP *op;
+	char *p;
+
+	if (nops + 2 > nalloc) {
+		nalloc = nalloc ? nalloc * 2 : 64;
+		if ((ops = realloc(ops, nalloc * sizeof(OP))) == NULL)
+			err(1, NULL);
+	}
+	op = &ops[nops];
+	memset(op, 0, sizeof(*op));
+	op->off = off;
+	op->bcnt = pr->bcnt;
+	op->prec = -1;
+	op->text = pr->fmt;
+	if (off + pr->bcnt > bsize)
+		return (0);
+
+	switch (pr->flags) {
+	case F_TEXT:
+		op->op = OP_TEXT;
+		op->tlen = last && pr->nospace ? pr->nospace - pr->fmt :
+		    strlen(pr->fmt);
+		nops++;
+		return (1);
+	case F_ADDRESS:
+		op->op = OP_ADDR;
+		break;
+	case F_P:
+		op->op = OP_P;
+		break;
+	case F_UINT:
+		op->op = OP_UINT;
+		if (pr->bcnt != 1 && pr->bcnt != 2 && pr->bcnt != 4 &&
+		    pr->bcnt != 8)
+			return (0);
+		break;
+	default:
+		return (0);
+	}
+
+	/* Only a trailing text unit can lose its white space. */
+	if (last && pr->nospace)
+		return (0);
+	if ((p = strchr(pr->fmt, '%')) == NULL)
+		return (0);
+	op->tlen = p - pr->fmt;
+	for (++p; *p == '-' || *p == '0'; ++p)
+		if (*p == '-')
+			op->left = 1;
+		else
+			op->zero = 1;
+	for (; isdigit((unsigned char)*p); ++p)
+		op->width = op->width * 10 + *p - '0';
+	if (*p == '.')
+		for (op->prec = 0, ++p; isdigit((unsigned char)*p); ++p)
+			op->prec = op->prec * 10 + *p - '0';
+	if (op->op == OP_P) {
+		if (strcmp(p, "c") != 0 || op->width > 1 || op->prec >= 0)
+			return (0);
+	} else {
+		if (*p++ != 'l' || p[0] == '\0' || p[1] != '\0')
+			return (0);
+		switch (*p) {
+		case 'd':
+			if (op->op != OP_ADDR)
+				return (0);
+			op->base = 10;
+			break;
+		case 'u':
+			op->base = 10;
+			break;
+		case 'o':
+			op->base = 8;
+			break;
+		case 'X':
+			op->upper = 1;
+			/* FALLTHROUGH */
+		case 'x':
+			op->base = 16;
+			break;
+		default:
+			return (0);
+		}
+		op->hex2 = op->op == OP_UINT && op->base == 16 &&
+		    op->bcnt == 1 && op->width <= 2 && (op->prec == 2 ||
+		    (op->prec < 0 && op->zero && !op->left && op->width == 2));
+	}
+	nops++;
+	return (1);
+}
+
+/*
+ * Format a number as printf would with the op's flags, width and
+ * precision.
+ */
+static __inline char *
+putnum(char *p, OP *op, u_int64_t v)
+{
+	const char *digits = op->upper ? "0123456789ABCDEF" :
+	    "0123456789abcdef";
+	char buf[24], *d;
+	int n, pad, zeros;
+
+	d = buf + sizeof(buf);
+	if (v != 0 || op->prec != 0)
+		switch (op->base) {
+		case 16:
+			do { *--d = digits[v & 15]; } while (v >>= 4);
+			break;
+		case 8:
+			do { *--d = '0' + (v & 7); } while (v >>= 3);
+			break;
+		default:
+			do { *--d = '0' + v % 10; } while (v /= 10);
+			break;
+		}
+	n = buf + sizeof(buf) - d;
+	zeros = op->prec > n ? op->prec - n : 0;
+	pad = op->width > n + zeros ? op->width - n - zeros : 0;
+	if (op->zero && !op->left && op->prec < 0) {
+		zeros += pad;
+		pad = 0;
+	}
+	if (!op->left)
+		for (; pad > 0; pad--)
+			*p++ = ' ';
+	for (; zeros > 0; zeros--)
+		*p++ = '0';
+	memcpy(p, d, n);
+	p += n;
+	for (; pad > 0; pad--)
+		*p++ = ' ';
+	return (p);
+}
+
+static void
+fastblock(u_char *bp)
+{
+	OP *op, *eop;
+	u_int16_t u2;
+	u_int32_t u4;
+	u_int64_t u8;
+	char *p;
+
+	for (p = obuf, op = ops, eop = ops + nops; op < eop; op++) {
+		memcpy(p, op->text, op->tlen);
+		p += op->tlen;
+		switch (op->op) {
+		case OP_ADDR:
+			p = putnum(p, op, (u_int64_t)(address + op->off));
+			break;
+		case OP_P:
+			*p++ = ptab[bp[op->off]];
+			break;
+		case OP_UINT:
+			if (op->hex2) {
+				memcpy(p, hextab[op->upper][bp[op->off]], 2);
+				p += 2;
+				break;
+			}
+			switch (op->bcnt) {
+			case 1:
+				p = putnum(p, op, bp[op->off]);
+				break;
+			case 2:
+				bcopy(bp + op->off, &u2, sizeof(u2));
+				p = putnum(p, op, u2);
+				break;
+			case 4:
+				bcopy(bp + op->off, &u4, sizeof(u4));
+				p = putnum(p, op, u4);
+				break;
+			case 8:
+				bcopy(bp + op->off, &u8, sizeof(u8));
+				p = putnum(p, op, u8);
+				break;
+			}
+			break;
+		}
+	}
+	if (fwrite(obuf, 1, p - obuf, stdout) != (size_t)(p - obuf))
+		err(1, "stdout");
+}
+
 static __inline void
 print(PR *pr, u_char *bp)
 {
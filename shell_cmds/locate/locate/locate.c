@@ -114,6 +114,7 @@ int f_stdin;            /* read database from stdin */
 int f_statistic;        /* print statistic */
 int f_silent;           /* suppress output, show only count of matches */
 int f_limit;            /* limit number of output lines, 0 == infinite */
+int f_index;            /* build trigram index */
 u_int counter;          /* counter for matches [-c] */
 char separator='\n';	/* line separator */
 #ifdef __APPLE__
@@ -138,6 +139,9 @@ extern int      getwf(FILE *);
 extern u_char   *tolower_word(u_char *);
 extern int	check_bigram_char(int);
 extern char 	*patprep(char *);
+extern int	tri_search(char *, char **);
+extern void	tri_build(char *);
+extern void	scan(char *, char *, char *, char **);
 
 int
 main(argc, argv)
@@ -147,19 +151,29 @@ main(argc, argv)
         register int ch;
         char **dbv = NULL;
 	char *path_fcodes;      /* locate database */
+	char *dircache = NULL, *prunepaths = NULL, *filesystems = NULL;
 #ifdef MMAP
         f_mmap = 1;		/* mmap is default */
 #endif
 	(void) setlocale(LC_ALL, "");
 
-        while ((ch = getopt(argc, argv, "0Scd:il:ms")) != -1)
+        while ((ch = getopt(argc, argv, "0F:P:STcd:il:msu:")) != -1)
                 switch(ch) {
                 case '0':	/* 'find -print0' style */
 			separator = '\0';
 			break;
+                case 'F':	/* file systems to list with -u */
+                        filesystems = optarg;
+                        break;
+                case 'P':	/* paths to prune with -u */
+                        prunepaths = optarg;
+                        break;
                 case 'S':	/* statistic lines */   
                         f_statistic = 1;
                         break;
+                case 'T':	/* build trigram index */
+                        f_index = 1;
+                        break;
                 case 'l': /* limit number of output lines, 0 == infinite */
                         f_limit = atoi(optarg);
                         break;
@@ -182,14 +196,25 @@ main(argc, argv)
                 case 'c': /* suppress output, show only count of matches */
                         f_silent = 1;
                         break;
+                case 'u':	/* list files, updating directory cache */
+                        dircache = optarg;
+                        break;
                 default:
                         usage();
                 }
         argv += optind;
         argc -= optind;
 
+        /* file list for locate.updatedb */
+        if (dircache != NULL) {
+                if (argc < 1)
+                        usage();
+                scan(dircache, prunepaths, filesystems, argv);
+                exit(0);
+        }
+
         /* to few arguments */
-        if (argc < 1 && !(f_statistic))
+        if (argc < 1 && !(f_statistic || f_index))
                 usage();
 
         /* no (valid) database as argument */
@@ -219,7 +244,14 @@ main(argc, argv)
 #ifndef MMAP
 		f_mmap = 0;	/* be paranoid */
 #endif
-                if (!f_mmap || f_stdin || f_statistic) 
+                if (f_index) {
+                        if (f_stdin)
+                                errx(1, "cannot index the standard input");
+                        tri_build(path_fcodes);
+                } else if (!f_stdin && !f_statistic &&
+                    tri_search(path_fcodes, argv))
+                        continue;
+                else if (!f_mmap || f_stdin || f_statistic) 
 			search_fopen(path_fcodes, argv);
                 else 
 			search_mmap(path_fcodes, argv);
@@ -359,7 +391,9 @@ void
 usage ()
 {
         (void)fprintf(stderr,
-	"usage: locate [-0Scims] [-l limit] [-d database] pattern ...\n\n");
+	"usage: locate [-0Scims] [-l limit] [-d database] pattern ...\n"
+	"       locate -T [-d database]\n"
+	"       locate -u dircache [-F filesystems] [-P prunepaths] path ...\n\n");
         (void)fprintf(stderr,
 	"default database: `%s' or $LOCATE_PATH\n", _PATH_FCODES);
         exit(1);
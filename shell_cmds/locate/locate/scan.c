@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 1995 Wolfram Schneider <wosch@FreeBSD.org>. Berlin.
+ * Copyright (c) 1989, 1993
+ *	The Regents of the University of California.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Incremental file list for locate.updatedb.
+ *
+ * Prints the names under the search paths in the order of ``find -s'',
+ * leaving out what the find(1) expression of updatedb prunes: the
+ * PRUNEPATHS patterns and file systems not in FILESYSTEMS.  A cache
+ * file keeps the inode, modification time and entries of every
+ * directory seen.  Creating, removing or renaming an entry changes the
+ * modification time of its directory, so a directory that is unchanged
+ * since the last run is not read again; its entries come from the cache
+ * and only its subdirectories are examined.  The list is the same as
+ * the one of a full walk, for one lstat(2) per directory.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifndef __linux__
+#include <sys/mount.h>
+#endif
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define	SCAN_MAGIC	"LOCDIR01"
+
+/*
+ * A cache record is a struct dirrec, the path of the directory and
+ * its entries, each a type byte, 'd' for directories and 'f' for
+ * anything else, and the NUL terminated name.
+ */
+struct dirrec {
+	u_int64_t	ino;
+	int64_t		sec, nsec;	/* modification time */
+	u_int32_t	pathlen;	/* with the NUL */
+	u_int32_t	entlen;		/* bytes of entries */
+};
+
+struct ent {
+	char	*name;
+	int	dir;
+};
+
+static u_char	*cache;			/* old cache */
+static size_t	cachelen;
+static u_int64_t *ctab;			/* record offset + 1, by path */
+static size_t	ctabsize;
+static FILE	*ncache;		/* new cache */
+static char	**prune;		/* PRUNEPATHS */
+static char	**fstypes;		/* FILESYSTEMS */
+
+void	scan(char *, char *, char *, char **);
+
+#ifdef __APPLE__
+#define	st_mtim	st_mtimespec
+#endif
+
+static u_int32_t
+pathhash(const char *p, size_t len)
+{
+	u_int32_t h;
+
+	for (h = 2166136261U; len > 0; len--)
+		h = (h ^ (u_char)*p++) * 16777619U;
+	return (h);
+}
+
+static void
+cacheload(char *name)
+{
+	struct dirrec rec;
+	struct stat sb;
+	u_char *p, *end;
+	size_t n, i;
+	int fd;
+
+	if ((fd = open(name, O_RDONLY)) == -1) {
+		if (errno != ENOENT)
+			warn("%s", name);
+		return;
+	}
+	if (fstat(fd, &sb) == -1 || sb.st_size < (off_t)sizeof(SCAN_MAGIC) ||
+	    (cache = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd,
+	    0)) == MAP_FAILED) {
+		cache = NULL;
+		(void)close(fd);
+		return;
+	}
+	(void)close(fd);
+	cachelen = sb.st_size;
+	if (memcmp(cache, SCAN_MAGIC, sizeof(SCAN_MAGIC) - 1) != 0) {
+		warnx("%s: not a directory cache, ignored", name);
+		goto bad;
+	}
+
+	/* count the records, then hash them */
+	end = cache + cachelen;
+	for (n = 0, p = cache + sizeof(SCAN_MAGIC) - 1; p < end; n++) {
+		if (end - p < (ssize_t)sizeof(rec))
+			goto corrupt;
+		memcpy(&rec, p, sizeof(rec));
+		p += sizeof(rec);
+		if (rec.pathlen == 0 || (size_t)(end - p) < rec.pathlen ||
+		    (size_t)(end - p) - rec.pathlen < rec.entlen ||
+		    p[rec.pathlen - 1] != '\0' ||
+		    (rec.entlen > 0 && p[rec.pathlen + rec.entlen - 1] != '\0'))
+			goto corrupt;
+		p += rec.pathlen + rec.entlen;
+	}
+	for (ctabsize = 64; ctabsize < n * 2; ctabsize *= 2)
+		;
+	if ((ctab = calloc(ctabsize, sizeof(*ctab))) == NULL)
+		err(1, NULL);
+	for (p = cache + sizeof(SCAN_MAGIC) - 1; p < end;) {
+		memcpy(&rec, p, sizeof(rec));
+		for (i = pathhash((char *)p + sizeof(rec), rec.pathlen - 1) &
+		    (ctabsize - 1); ctab[i] != 0; i = (i + 1) & (ctabsize - 1))
+			;
+		ctab[i] = p - cache + 1;
+		p += sizeof(rec) + rec.pathlen + rec.entlen;
+	}
+	return;
+
+corrupt:
+	warnx("%s: directory cache corrupt, ignored", name);
+bad:
+	(void)munmap(cache, cachelen);
+	cache = NULL;
+}
+
+/* Return the cached entries of an unchanged directory. */
+static u_char *
+cachefind(char *path, size_t len, struct stat *sb, size_t *entlen)
+{
+	struct dirrec rec;
+	u_char *p;
+	size_t i;
+
+	if (cache == NULL)
+		return (NULL);
+	for (i = pathhash(path, len) & (ctabsize - 1); ctab[i] != 0;
+	    i = (i + 1) & (ctabsize - 1)) {
+		p = cache + ctab[i] - 1;
+		memcpy(&rec, p, sizeof(rec));
+		p += sizeof(rec);
+		if (rec.pathlen != len + 1 || memcmp(p, path, len) != 0)
+			continue;
+		if (rec.ino != (u_int64_t)sb->st_ino ||
+		    rec.sec != (int64_t)sb->st_mtim.tv_sec ||
+		    rec.nsec != (int64_t)sb->st_mtim.tv_nsec)
+			return (NULL);
+		*entlen = rec.entlen;
+		return (p + rec.pathlen);
+	}
+	return (NULL);
+}
+
+static char **
+words(char *s)
+{
+	char **v, *w;
+	int n;
+
+	if ((s = strdup(s)) == NULL)
+		err(1, NULL);
+	for (n = 0, v = NULL; (w = strsep(&s, " \t\n")) != NULL;) {
+		if (*w == '\0')
+			continue;
+		if ((v = realloc(v, (n + 2) * sizeof(*v))) == NULL)
+			err(1, NULL);
+		v[n++] = w;
+		v[n] = NULL;
+	}
+	return (v);
+}
+
+static int
+pruned(char *path)
+{
+	char **p;
+
+	for (p = prune; p != NULL && *p != NULL; p++)
+		if (fnmatch(*p, path, 0) == 0)
+			return (1);
+	return (0);
+}
+
+/* Is path on one of the file systems to list? */
+static int
+fsok(char *path)
+{
+#ifdef MFSNAMELEN
+	struct statfs sf;
+	char **p;
+
+	if (fstypes == NULL || statfs(path, &sf) == -1)
+		return (1);
+	for (p = fstypes; *p != NULL; p++)
+		if (strcmp(*p, sf.f_fstypename) == 0)
+			return (1);
+	return (0);
+#else
+	return (1);
+#endif
+}
+
+static int
+entcmp(const void *a, const void *b)
+{
+	return (strcmp(((const struct ent *)a)->name,
+	    ((const struct ent *)b)->name));
+}
+
+static void
+putpath(char *path)
+{
+	if (printf("%s\n", path) < 0)
+		err(1, "stdout");
+}
+
+static void
+walk(char *path, size_t len, struct stat *sb)
+{
+	struct dirrec rec;
+	struct stat csb;
+	struct dirent *dp;
+	struct ent *ents;
+	DIR *dirp;
+	u_char *cached, *p, *end;
+	size_t entlen, n, size, i, clen;
+
+	ents = NULL;
+	n = 0;
+	if ((cached = cachefind(path, len, sb, &entlen)) != NULL) {
+		for (p = cached, end = p + entlen; p < end; n++)
+			p += strlen((char *)p + 1) + 2;
+		if ((ents = malloc((n + 1) * sizeof(*ents))) == NULL)
+			err(1, NULL);
+		for (n = 0, p = cached; p < end; n++) {
+			ents[n].dir = *p == 'd';
+			ents[n].name = (char *)p + 1;
+			p += strlen((char *)p + 1) + 2;
+		}
+	} else {
+		if ((dirp = opendir(path)) == NULL) {
+			warn("%s", path);
+			return;
+		}
+		size = 0;
+		while ((dp = readdir(dirp)) != NULL) {
+			if (dp->d_name[0] == '.' && (dp->d_name[1] == '\0' ||
+			    (dp->d_name[1] == '.' && dp->d_name[2] == '\0')))
+				continue;
+			if (n == size) {
+				size = size ? size * 2 : 64;
+				if ((ents = realloc(ents,
+				    size * sizeof(*ents))) == NULL)
+					err(1, NULL);
+			}
+			if ((ents[n].name = strdup(dp->d_name)) == NULL)
+				err(1, NULL);
+#ifdef DT_DIR
+			if (dp->d_type != DT_UNKNOWN)
+				ents[n].dir = dp->d_type == DT_DIR;
+			else
+#endif
+			{
+				(void)snprintf(path + len, MAXPATHLEN - len,
+				    "%s%s", len > 0 && path[len - 1] == '/' ?
+				    "" : "/", dp->d_name);
+				ents[n].dir = lstat(path, &csb) == 0 &&
+				    S_ISDIR(csb.st_mode);
+				path[len] = '\0';
+			}
+			n++;
+		}
+		(void)closedir(dirp);
+		if (n > 1)
+			qsort(ents, n, sizeof(*ents), entcmp);
+	}
+
+	/* remember the directory for the next run */
+	for (entlen = 0, i = 0; i < n; i++)
+		entlen += strlen(ents[i].name) + 2;
+	memset(&rec, 0, sizeof(rec));
+	rec.ino = sb->st_ino;
+	rec.sec = sb->st_mtim.tv_sec;
+	rec.nsec = sb->st_mtim.tv_nsec;
+	rec.pathlen = len + 1;
+	rec.entlen = entlen;
+	(void)fwrite(&rec, sizeof(rec), 1, ncache);
+	(void)fwrite(path, len + 1, 1, ncache);
+	for (i = 0; i < n; i++) {
+		(void)putc(ents[i].dir ? 'd' : 'f', ncache);
+		(void)fwrite(ents[i].name, strlen(ents[i].name) + 1, 1, ncache);
+	}
+
+	for (i = 0; i < n; i++) {
+		clen = len + (len > 0 && path[len - 1] == '/' ? 0 : 1) +
+		    strlen(ents[i].name);
+		if (clen >= MAXPATHLEN) {
+			warnx("%s/%s: %s", path, ents[i].name,
+			    strerror(ENAMETOOLONG));
+			continue;
+		}
+		(void)snprintf(path + len, MAXPATHLEN - len, "%s%s",
+		    len > 0 && path[len - 1] == '/' ? "" : "/", ents[i].name);
+		if (!pruned(path)) {
+			if (!ents[i].dir)
+				putpath(path);
+			else if (lstat(path, &csb) == -1)
+				warn("%s", path);
+			else if (!S_ISDIR(csb.st_mode))
+				putpath(path);
+			else if (csb.st_dev == sb->st_dev || fsok(path)) {
+				putpath(path);
+				walk(path, clen, &csb);
+			}
+		}
+		path[len] = '\0';
+	}
+
+	if (cached == NULL)
+		for (i = 0; i < n; i++)
+			free(ents[i].name);
+	free(ents);
+}
+
+/*
+ * List the search paths, reading and replacing the directory cache.
+ * prunepaths and filesystems are lists separated by white space, as
+ * PRUNEPATHS and FILESYSTEMS in locate.rc; NULL for no restriction.
+ */
+void
+scan(char *cachefile, char *prunepaths, char *filesystems, char **paths)
+{
+	struct stat sb;
+	char path[MAXPATHLEN], *tmp;
+	int fd;
+
+	prune = prunepaths != NULL ? words(prunepaths) : NULL;
+	fstypes = filesystems != NULL ? words(filesystems) : NULL;
+	cacheload(cachefile);
+
+	if (asprintf(&tmp, "%s.XXXXXX", cachefile) == -1)
+		err(1, NULL);
+	if ((fd = mkstemp(tmp)) == -1 || (ncache = fdopen(fd, "w")) == NULL)
+		err(1, "%s", tmp);
+	(void)fputs(SCAN_MAGIC, ncache);
+
+	for (; *paths != NULL; paths++) {
+		if (strlcpy(path, *paths, sizeof(path)) >= sizeof(path)) {
+			warnx("%s: %s", *paths, strerror(ENAMETOOLONG));
+			continue;
+		}
+		if (lstat(path, &sb) == -1) {
+			warn("%s", path);
+			continue;
+		}
+		if (pruned(path) || !fsok(path))
+			continue;
+		putpath(path);
+		if (S_ISDIR(sb.st_mode))
+			walk(path, strlen(path), &sb);
+	}
+
+	if (fflush(stdout) != 0 || ferror(stdout))
+		err(1, "stdout");
+	if (fclose(ncache) == EOF) {
+		(void)unlink(tmp);
+		err(1, "%s", tmp);
+	}
+	if (rename(tmp, cachefile) == -1) {
+		(void)unlink(tmp);
+		err(1, "%s", cachefile);
+	}
+	free(tmp);
+	if (cache != NULL)
+		(void)munmap(cache, cachelen);
+}
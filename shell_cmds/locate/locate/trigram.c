@@ -0,0 +1,877 @@
+/*
+ * Copyright (c) 1995 Wolfram Schneider <wosch@FreeBSD.org>. Berlin.
+ * Copyright (c) 1989, 1993
+ *	The Regents of the University of California.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed by the University of
+ *	California, Berkeley and its contributors.
+ * 4. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Trigram index for a locate database.
+ *
+ * The database is cut into blocks of TRI_BSIZE paths.  For every block
+ * the index keeps the offset of its first entry and the path decoded
+ * just before it, so the front compressed list can be decoded starting
+ * at any block, and every trigram of the paths (with ASCII letters
+ * folded to lower case) has a posting list of the blocks it occurs in.
+ * The database itself is not changed and fastfind() still reads it.
+ *
+ * A search intersects the posting lists of the trigrams in the literal
+ * parts of the pattern and decodes only the candidate blocks; a pattern
+ * without a usable trigram has every block as a candidate.  Either way
+ * the blocks are matched by several threads and the matches printed in
+ * database order.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "locate.h"
+
+#define	TRI_MAGIC	"LOCTRI01"
+#define	TRI_SUFFIX	".tri"
+#define	TRI_BSIZE	512		/* paths per block */
+#define	TRI_BATCH	64		/* blocks per thread and round */
+#define	TRI_THREADS	8
+
+struct trihdr {
+	char		magic[8];
+	u_int64_t	dbsize;		/* database the index was built from */
+	int64_t		dbmtime;
+	u_int32_t	nblocks;
+	u_int32_t	ntri;
+	u_int64_t	boff;		/* struct triblk[nblocks] */
+	u_int64_t	toff;		/* struct tri[ntri], sorted by key */
+	u_int64_t	poff;		/* posting lists */
+	u_int64_t	soff;		/* paths preceding the blocks */
+	u_int64_t	size;		/* of the index */
+};
+
+struct triblk {
+	u_int64_t	dboff;		/* first entry of the block */
+	u_int32_t	count;		/* front compression count before it */
+	u_int32_t	path;		/* preceding path, offset from soff */
+};
+
+struct tri {
+	u_int32_t	key;
+	u_int32_t	len;		/* bytes of postings */
+	u_int64_t	off;		/* from poff */
+};
+
+/* front compressed database decoder */
+struct dbstate {
+	u_char	*p, *end;
+	int	count;
+	u_char	*bigram1, *bigram2;
+	u_char	path[MAXPATHLEN];
+};
+
+/* a search of one pattern */
+struct trisearch {
+	u_char	*db, *index;
+	size_t	dblen;
+	struct trihdr *hdr;
+	u_char	bigram1[NBG], bigram2[NBG];
+	char	*pat;		/* pattern, lower case with -i */
+	char	*sub;		/* last glob free part, see patprep() */
+	size_t	sublen;
+	int	glob;
+};
+
+struct triwork {
+	pthread_t thread;
+	struct trisearch *ts;
+	u_int32_t *blk;		/* blocks to match */
+	size_t	nblk;
+	char	*out;		/* matching paths, NUL terminated */
+	size_t	outlen, outsize;
+};
+
+extern char	separator;
+extern int	f_icase, f_silent, f_limit;
+extern u_int	counter;
+
+extern int	getwm(caddr_t);
+extern int	check_bigram_char(int);
+extern char	*patprep(char *);
+extern u_char	*tolower_word(u_char *);
+
+int	tri_search(char *, char **);
+void	tri_build(char *);
+
+#define	FOLD(c)		((c) >= 'A' && (c) <= 'Z' ? (c) - 'A' + 'a' : (c))
+#define	TRIKEY(p)	((u_int32_t)FOLD((p)[0]) << 16 | \
+			    (u_int32_t)FOLD((p)[1]) << 8 | FOLD((p)[2]))
+
+static char *
+triname(char *db)
+{
+	char *name;
+
+	if (asprintf(&name, "%s%s", db, TRI_SUFFIX) == -1)
+		err(1, NULL);
+	return (name);
+}
+
+static void
+dbinit(struct dbstate *d, u_char *db, size_t len, u_char *bigram1,
+    u_char *bigram2, char *database)
+{
+	int c;
+
+	if (len < 2 * NBG)
+		errx(1, "database too small: %s", database);
+	for (c = 0; c < NBG; c++) {
+		bigram1[c] = check_bigram_char(db[2 * c]);
+		bigram2[c] = check_bigram_char(db[2 * c + 1]);
+	}
+	d->p = db + 2 * NBG;
+	d->end = db + len;
+	d->count = 0;
+	d->bigram1 = bigram1;
+	d->bigram2 = bigram2;
+	d->path[0] = '\0';
+}
+
+/*
+ * Decode the next path of the database into d->path; returns its
+ * length, or -1 at the end.
+ */
+static int
+nextpath(struct dbstate *d)
+{
+	u_char *p, *lim;
+	int c;
+
+	if (d->p >= d->end)
+		return (-1);
+	if ((c = *d->p++) == SWITCH) {
+		if (d->end - d->p < (ssize_t)INTSIZE)
+			goto corrupt;
+		d->count += getwm((caddr_t)d->p) - OFFSET;
+		d->p += INTSIZE;
+	} else
+		d->count += c - OFFSET;
+	if (d->count < 0 || d->count >= MAXPATHLEN)
+		goto corrupt;
+
+	p = d->path + d->count;
+	lim = d->path + sizeof(d->path) - 2;
+	while (d->p < d->end) {
+		c = *d->p;
+		if (c < UMLAUT)		/* count of the next path */
+			break;
+		d->p++;
+		if (p >= lim)
+			goto corrupt;
+		if (c < PARITY) {
+			if (c == UMLAUT) {
+				if (d->p >= d->end)
+					break;
+				c = *d->p++;
+			}
+			*p++ = c;
+		} else {
+			TO7BIT(c);
+			*p++ = d->bigram1[c];
+			*p++ = d->bigram2[c];
+		}
+	}
+	*p = '\0';
+	return (p - d->path);
+
+corrupt:
+	errx(1, "locate database corrupt, run locate.updatedb");
+}
+
+static void *
+mapfile(char *name, int fd, size_t *len)
+{
+	struct stat sb;
+	void *p;
+
+	if (fstat(fd, &sb) == -1)
+		err(1, "%s", name);
+	if ((*len = sb.st_size) == 0)
+		return (NULL);
+	if ((p = mmap(NULL, *len, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		err(1, "mmap %s", name);
+	return (p);
+}
+
+/*
+ * Index building.
+ */
+
+struct tacc {
+	u_int32_t key;
+	u_int32_t last;		/* last block + 1, 0 if unused */
+	u_char	*buf;
+	size_t	len, size;
+};
+
+struct buf {
+	u_char	*p;
+	size_t	len, size;
+};
+
+static void
+bufadd(struct buf *b, const void *p, size_t len)
+{
+	if (b->len + len > b->size) {
+		b->size = MAX(b->size * 2, b->len + len + 4096);
+		if ((b->p = realloc(b->p, b->size)) == NULL)
+			err(1, NULL);
+	}
+	memcpy(b->p + b->len, p, len);
+	b->len += len;
+}
+
+static struct tacc *
+tacclookup(struct tacc **tab, size_t *size, size_t *used, u_int32_t key)
+{
+	struct tacc *t, *ntab;
+	size_t i, n;
+
+	for (;;) {
+		for (i = (key * 2654435761U) & (*size - 1);; i = (i + 1) &
+		    (*size - 1)) {
+			t = &(*tab)[i];
+			if (t->last == 0 || t->key == key)
+				break;
+		}
+		if (t->last != 0)
+			return (t);
+		if (*used * 2 < *size) {
+			(*used)++;
+			t->key = key;
+			return (t);
+		}
+		/* grow and retry */
+		n = *size * 2;
+		if ((ntab = calloc(n, sizeof(*ntab))) == NULL)
+			err(1, NULL);
+		for (i = 0; i < *size; i++) {
+			struct tacc *o = &(*tab)[i], *q;
+			size_t j;
+
+			if (o->last == 0)
+				continue;
+			for (j = (o->key * 2654435761U) & (n - 1);
+			    ntab[j].last != 0; j = (j + 1) & (n - 1))
+				;
+			q = &ntab[j];
+			*q = *o;
+		}
+		free(*tab);
+		*tab = ntab;
+		*size = n;
+	}
+}
+
+static void
+taccadd(struct tacc *t, u_int32_t blk)
+{
+	u_int32_t delta;
+
+	if (t->last == blk + 1)
+		return;
+	delta = blk + 1 - t->last;
+	t->last = blk + 1;
+	if (t->len + 5 > t->size) {
+		t->size = t->size ? t->size * 2 : 8;
+		if ((t->buf = realloc(t->buf, t->size)) == NULL)
+			err(1, NULL);
+	}
+	while (delta >= 0x80) {
+		t->buf[t->len++] = delta | 0x80;
+		delta >>= 7;
+	}
+	t->buf[t->len++] = delta;
+}
+
+static int
+tacccmp(const void *a, const void *b)
+{
+	const struct tacc *x = *(struct tacc * const *)a;
+	const struct tacc *y = *(struct tacc * const *)b;
+
+	return (x->key < y->key ? -1 : x->key > y->key);
+}
+
+static void
+writeall(int fd, const void *p, size_t len, char *name)
+{
+	const char *s = p;
+	ssize_t n;
+
+	for (; len > 0; s += n, len -= n)
+		if ((n = write(fd, s, len)) == -1)
+			err(1, "%s", name);
+}
+
+/* Build the trigram index of a database, replacing an old one. */
+void
+tri_build(char *database)
+{
+	struct dbstate *d;
+	struct trihdr hdr;
+	struct triblk blk;
+	struct tri tri;
+	struct tacc *tab, **sorted;
+	struct buf blocks, paths;
+	struct stat sb;
+	u_char bigram1[NBG], bigram2[NBG];
+	u_char *db, *p;
+	size_t dblen, size, used, i;
+	u_int32_t nblk, npath;
+	int fd, len, prevlen;
+	char *name, *tmp;
+	off_t off;
+
+	if ((fd = open(database, O_RDONLY)) == -1 || fstat(fd, &sb) == -1)
+		err(1, "`%s'", database);
+	if ((db = mapfile(database, fd, &dblen)) == NULL)
+		errx(1, "database too small: %s", database);
+	(void)close(fd);
+
+	if ((d = malloc(sizeof(*d))) == NULL)
+		err(1, NULL);
+	dbinit(d, db, dblen, bigram1, bigram2, database);
+
+	size = 1 << 16;
+	used = 0;
+	if ((tab = calloc(size, sizeof(*tab))) == NULL)
+		err(1, NULL);
+	memset(&blocks, 0, sizeof(blocks));
+	memset(&paths, 0, sizeof(paths));
+
+	nblk = npath = 0;
+	prevlen = 0;
+	for (;;) {
+		if (npath % TRI_BSIZE == 0) {
+			if (d->p >= d->end)
+				break;
+			blk.dboff = d->p - db;
+			blk.count = d->count;
+			blk.path = paths.len;
+			bufadd(&blocks, &blk, sizeof(blk));
+			bufadd(&paths, d->path, prevlen);
+			bufadd(&paths, "", 1);
+			nblk++;
+		}
+		if ((len = nextpath(d)) == -1)
+			break;
+		for (p = d->path; p + 2 < d->path + len; p++)
+			taccadd(tacclookup(&tab, &size, &used, TRIKEY(p)),
+			    nblk - 1);
+		prevlen = len;
+		npath++;
+	}
+
+	if ((sorted = malloc(MAX(used, 1) * sizeof(*sorted))) == NULL)
+		err(1, NULL);
+	for (used = i = 0; i < size; i++)
+		if (tab[i].last != 0)
+			sorted[used++] = &tab[i];
+	qsort(sorted, used, sizeof(*sorted), tacccmp);
+
+	name = triname(database);
+	if (asprintf(&tmp, "%s.XXXXXX", name) == -1)
+		err(1, NULL);
+	if ((fd = mkstemp(tmp)) == -1)
+		err(1, "%s", tmp);
+	(void)fchmod(fd, 0444);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRI_MAGIC, sizeof(hdr.magic));
+	hdr.dbsize = sb.st_size;
+	hdr.dbmtime = sb.st_mtime;
+	hdr.nblocks = nblk;
+	hdr.ntri = used;
+	hdr.boff = sizeof(hdr);
+	hdr.toff = hdr.boff + blocks.len;
+	hdr.poff = hdr.toff + used * sizeof(struct tri);
+	for (off = 0, i = 0; i < used; i++)
+		off += sorted[i]->len;
+	hdr.soff = hdr.poff + off;
+	hdr.size = hdr.soff + paths.len;
+
+	writeall(fd, &hdr, sizeof(hdr), tmp);
+	writeall(fd, blocks.p, blocks.len, tmp);
+	for (off = 0, i = 0; i < used; i++) {
+		memset(&tri, 0, sizeof(tri));
+		tri.key = sorted[i]->key;
+		tri.len = sorted[i]->len;
+		tri.off = off;
+		off += tri.len;
+		writeall(fd, &tri, sizeof(tri), tmp);
+	}
+	for (i = 0; i < used; i++)
+		writeall(fd, sorted[i]->buf, sorted[i]->len, tmp);
+	writeall(fd, paths.p, paths.len, tmp);
+	if (close(fd) == -1)
+		err(1, "%s", tmp);
+	if (rename(tmp, name) == -1) {
+		(void)unlink(tmp);
+		err(1, "%s", name);
+	}
+
+	for (i = 0; i < size; i++)
+		free(tab[i].buf);
+	free(tab);
+	free(sorted);
+	free(blocks.p);
+	free(paths.p);
+	free(tmp);
+	free(name);
+	free(d);
+	(void)munmap(db, dblen);
+}
+
+/*
+ * Searching.
+ */
+
+static struct tri *
+trifind(struct trisearch *ts, u_int32_t key)
+{
+	struct tri *t;
+	size_t lo, hi, mid;
+
+	t = (struct tri *)(ts->index + ts->hdr->toff);
+	for (lo = 0, hi = ts->hdr->ntri; lo < hi;) {
+		mid = (lo + hi) / 2;
+		if (t[mid].key == key)
+			return (&t[mid]);
+		if (t[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (NULL);
+}
+
+/* Decode a posting list; returns the number of blocks. */
+static size_t
+postings(struct trisearch *ts, struct tri *t, u_int32_t *blk)
+{
+	u_char *p, *end;
+	u_int32_t cur, delta;
+	size_t n;
+	int shift;
+
+	p = ts->index + ts->hdr->poff + t->off;
+	end = p + t->len;
+	for (n = 0, cur = 0; p < end;) {
+		for (delta = 0, shift = 0; p < end; shift += 7) {
+			delta |= (u_int32_t)(*p & 0x7f) << shift;
+			if ((*p++ & 0x80) == 0)
+				break;
+		}
+		cur += delta;
+		if (cur - 1 < ts->hdr->nblocks)
+			blk[n++] = cur - 1;
+	}
+	return (n);
+}
+
+static int
+keycmp(const void *a, const void *b)
+{
+	u_int32_t x = *(const u_int32_t *)a, y = *(const u_int32_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+static int
+tricmp(const void *a, const void *b)
+{
+	const struct tri *x = *(struct tri * const *)a;
+	const struct tri *y = *(struct tri * const *)b;
+
+	return (x->len < y->len ? -1 : x->len > y->len);
+}
+
+/*
+ * Collect the trigrams that every path matching the pattern has to
+ * contain: those of the runs of plain characters, outside of bracket
+ * expressions and not escaped.  With -i, trigrams of non-ASCII bytes
+ * are left out since they are not folded in the index.
+ */
+static size_t
+patkeys(char *pat, u_int32_t **keys)
+{
+	u_char *p, *run;
+	size_t n, size;
+
+	n = size = 0;
+	*keys = NULL;
+	for (p = run = (u_char *)pat;; p++) {
+		if (*p != '\0' && index(LOCATE_REG, *p) == NULL &&
+		    (!f_icase || isascii(*p)))
+			continue;
+		for (; run + 2 < p; run++) {
+			if (n == size) {
+				size = size ? size * 2 : 16;
+				if ((*keys = realloc(*keys,
+				    size * sizeof(**keys))) == NULL)
+					err(1, NULL);
+			}
+			(*keys)[n++] = TRIKEY(run);
+		}
+		if (*p == '\0')
+			break;
+		if (*p == '\\' && p[1] != '\0')
+			p++;
+		else if (*p == '[') {
+			run = p + 1;
+			if (*run == '!' || *run == '^')
+				run++;
+			if (*run == ']')
+				run++;
+			if ((p = (u_char *)strchr((char *)run, ']')) == NULL)
+				break;
+		}
+		run = p + 1;
+	}
+	return (n);
+}
+
+/*
+ * Return the blocks that may hold matches of the pattern, or NULL if
+ * every block has to be searched.
+ */
+static u_int32_t *
+candidates(struct trisearch *ts, size_t *ncand)
+{
+	u_int32_t *keys, *cand, *blk;
+	struct tri **tris;
+	size_t nkeys, ntris, i, j, k, m, n;
+
+	if ((nkeys = patkeys(ts->pat, &keys)) == 0)
+		return (NULL);
+	qsort(keys, nkeys, sizeof(*keys), keycmp);
+	if ((tris = malloc(nkeys * sizeof(*tris))) == NULL)
+		err(1, NULL);
+	for (ntris = i = 0; i < nkeys; i++) {
+		if (i > 0 && keys[i] == keys[i - 1])
+			continue;
+		if ((tris[ntris] = trifind(ts, keys[i])) == NULL) {
+			/* a trigram that is not in any path */
+			free(keys);
+			free(tris);
+			*ncand = 0;
+			if ((cand = malloc(sizeof(*cand))) == NULL)
+				err(1, NULL);
+			return (cand);
+		}
+		ntris++;
+	}
+	free(keys);
+
+	/* intersect, shortest posting list first */
+	qsort(tris, ntris, sizeof(*tris), tricmp);
+	if ((cand = malloc((tris[0]->len + 1) * sizeof(*cand))) == NULL ||
+	    (blk = malloc((tris[0]->len + 1) * sizeof(*blk))) == NULL)
+		err(1, NULL);
+	*ncand = postings(ts, tris[0], cand);
+	for (i = 1; i < ntris && *ncand > 0; i++) {
+		if ((blk = realloc(blk, (tris[i]->len + 1) *
+		    sizeof(*blk))) == NULL)
+			err(1, NULL);
+		n = postings(ts, tris[i], blk);
+		for (j = k = m = 0; j < *ncand && m < n;)
+			if (cand[j] < blk[m])
+				j++;
+			else if (cand[j] > blk[m])
+				m++;
+			else {
+				cand[k++] = cand[j++];
+				m++;
+			}
+		*ncand = k;
+	}
+	free(blk);
+	free(tris);
+	return (cand);
+}
+
+/* Match a path as fastfind() does. */
+static int
+trimatch(struct trisearch *ts, u_char *path, int len)
+{
+	u_char *s, *end, *p, *q, *sub;
+
+	sub = (u_char *)ts->sub;
+	if (!f_icase) {
+		if (strstr((char *)path, ts->sub) == NULL)
+			return (0);
+	} else {
+		if ((size_t)len < ts->sublen)
+			return (0);
+		for (s = path, end = path + len - ts->sublen; s <= end; s++) {
+			for (p = sub, q = s; *p != '\0'; p++, q++)
+				if (*q != *p && TOLOWER(*q) != *p)
+					break;
+			if (*p == '\0')
+				break;
+		}
+		if (s > end)
+			return (0);
+	}
+	return (!ts->glob ||
+	    !fnmatch(ts->pat, (char *)path, f_icase ? FNM_CASEFOLD : 0));
+}
+
+static void *
+triwork(void *arg)
+{
+	struct triwork *w = arg;
+	struct trisearch *ts = w->ts;
+	struct triblk *b;
+	struct dbstate d;
+	size_t i;
+	int n, len;
+
+	w->outlen = 0;
+	d.end = ts->db + ts->dblen;
+	d.bigram1 = ts->bigram1;
+	d.bigram2 = ts->bigram2;
+	for (i = 0; i < w->nblk; i++) {
+		b = (struct triblk *)(ts->index + ts->hdr->boff) + w->blk[i];
+		d.p = ts->db + b->dboff;
+		d.count = b->count;
+		(void)strlcpy((char *)d.path, (char *)ts->index +
+		    ts->hdr->soff + b->path, sizeof(d.path));
+		for (n = 0; n < TRI_BSIZE && (len = nextpath(&d)) != -1; n++) {
+			if (!trimatch(ts, d.path, len))
+				continue;
+			if (w->outlen + len + 1 > w->outsize) {
+				w->outsize = MAX(w->outsize * 2,
+				    w->outlen + len + 1 + 4096);
+				if ((w->out = realloc(w->out,
+				    w->outsize)) == NULL)
+					err(1, NULL);
+			}
+			memcpy(w->out + w->outlen, d.path, len + 1);
+			w->outlen += len + 1;
+		}
+	}
+	return (NULL);
+}
+
+static void
+triprint(struct triwork *w)
+{
+	char *p, *end;
+
+	for (p = w->out, end = p + w->outlen; p < end; p += strlen(p) + 1)
+		if (f_silent)
+			counter++;
+		else if (f_limit) {
+			counter++;
+			if (f_limit >= counter)
+				(void)printf("%s%c", p, separator);
+			else
+				errx(0, "[show only %d lines]", counter - 1);
+		} else
+			(void)printf("%s%c", p, separator);
+}
+
+/*
+ * Match the candidate blocks, in rounds of at most TRI_BATCH blocks
+ * per thread to bound the memory held by the matches.
+ */
+static void
+trirun(struct trisearch *ts, u_int32_t *cand, size_t ncand, int nthreads)
+{
+	struct triwork *w;
+	size_t i, j, n, per;
+	int t, nt;
+
+	if ((w = calloc(nthreads, sizeof(*w))) == NULL)
+		err(1, NULL);
+	for (i = 0; i < ncand; i += n) {
+		n = MIN(ncand - i, (size_t)nthreads * TRI_BATCH);
+		per = (n + nthreads - 1) / nthreads;
+		for (nt = 0, j = i; j < i + n; nt++, j += per) {
+			w[nt].ts = ts;
+			w[nt].blk = cand + j;
+			w[nt].nblk = MIN(per, i + n - j);
+		}
+		if (nt == 1)
+			(void)triwork(&w[0]);
+		else {
+			for (t = 0; t < nt; t++)
+				if ((errno = pthread_create(&w[t].thread, NULL,
+				    triwork, &w[t])) != 0)
+					err(1, "pthread_create");
+			for (t = 0; t < nt; t++)
+				(void)pthread_join(w[t].thread, NULL);
+		}
+		for (t = 0; t < nt; t++)
+			triprint(&w[t]);
+	}
+	for (t = 0; t < nthreads; t++)
+		free(w[t].out);
+	free(w);
+}
+
+/* Check that the tables of an index lie within it. */
+static int
+trivalid(u_char *index, size_t ilen)
+{
+	struct trihdr *h = (struct trihdr *)index;
+	struct triblk *b;
+	struct tri *t;
+	u_char *path;
+	u_int32_t i;
+
+	if (h->boff > ilen || h->nblocks > (ilen - h->boff) / sizeof(*b) ||
+	    h->toff > ilen || h->ntri > (ilen - h->toff) / sizeof(*t) ||
+	    h->poff > ilen || h->soff > ilen)
+		return (0);
+	b = (struct triblk *)(index + h->boff);
+	for (i = 0; i < h->nblocks; i++) {
+		if (b[i].dboff < 2 * NBG || b[i].dboff >= h->dbsize ||
+		    b[i].path >= ilen - h->soff)
+			return (0);
+		path = index + h->soff + b[i].path;
+		if ((path = memchr(path, '\0', index + ilen - path)) == NULL ||
+		    b[i].count > (u_int32_t)(path - (index + h->soff +
+		    b[i].path)))
+			return (0);
+	}
+	t = (struct tri *)(index + h->toff);
+	for (i = 0; i < h->ntri; i++)
+		if (t[i].off > ilen - h->poff ||
+		    t[i].len > ilen - h->poff - t[i].off)
+			return (0);
+	return (1);
+}
+
+/*
+ * Search a database with its trigram index.  Returns 0, without doing
+ * anything, if there is no index, it is damaged or it does not belong to
+ * the database.
+ */
+int
+tri_search(char *database, char **s)
+{
+	struct trisearch ts;
+	struct dbstate d;
+	struct stat sb;
+	u_int32_t *cand;
+	size_t ilen, ncand, i;
+	char *name, *p, *patend;
+	long ncpu;
+	int fd;
+
+	name = triname(database);
+	if ((fd = open(name, O_RDONLY)) == -1) {
+		free(name);
+		return (0);
+	}
+	memset(&ts, 0, sizeof(ts));
+	ts.index = mapfile(name, fd, &ilen);
+	(void)close(fd);
+	free(name);
+	ts.hdr = (struct trihdr *)ts.index;
+	if (ilen < sizeof(struct trihdr) ||
+	    memcmp(ts.hdr->magic, TRI_MAGIC, sizeof(ts.hdr->magic)) != 0 ||
+	    ts.hdr->size != ilen || !trivalid(ts.index, ilen) ||
+	    (fd = open(database, O_RDONLY)) == -1) {
+		if (ts.index != NULL)
+			(void)munmap(ts.index, ilen);
+		return (0);
+	}
+	if (fstat(fd, &sb) == -1 || (u_int64_t)sb.st_size != ts.hdr->dbsize ||
+	    sb.st_mtime != ts.hdr->dbmtime) {
+		(void)close(fd);
+		(void)munmap(ts.index, ilen);
+		return (0);
+	}
+	if ((ts.db = mapfile(database, fd, &ts.dblen)) == NULL)
+		errx(1, "database too small: %s", database);
+	(void)close(fd);
+	dbinit(&d, ts.db, ts.dblen, ts.bigram1, ts.bigram2, database);
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	ncpu = MAX(MIN(ncpu, TRI_THREADS), 1);
+
+	/* foreach search string ... */
+	for (; *s != NULL; s++) {
+		if (f_icase)
+			tolower_word((u_char *)*s);
+		ts.pat = *s;
+		for (p = *s; *p != '\0'; p++)
+			if (index(LOCATE_REG, *p) != NULL)
+				break;
+		ts.glob = *p != '\0';
+		patend = patprep(*s);
+		if (*patend == '\0')
+			p = patend;
+		else
+			for (p = patend; p[-1] != '\0'; p--)
+				;
+		ts.sublen = *patend == '\0' ? 0 : patend - p + 1;
+		if ((ts.sub = strndup(p, ts.sublen)) == NULL)
+			err(1, NULL);
+
+		if ((cand = candidates(&ts, &ncand)) == NULL) {
+			ncand = ts.hdr->nblocks;
+			if ((cand = malloc((ncand + 1) *
+			    sizeof(*cand))) == NULL)
+				err(1, NULL);
+			for (i = 0; i < ncand; i++)
+				cand[i] = i;
+		}
+		trirun(&ts, cand, ncand, (int)ncpu);
+		free(cand);
+		free(ts.sub);
+	}
+
+	(void)munmap(ts.db, ts.dblen);
+	(void)munmap(ts.index, ilen);
+	return (1);
+}
@@ -34,9 +34,14 @@ if [ "$(id -u)" = "0" ]; then
 	chown nobody $FCODES
 	tmpdb=`su -fm nobody -c "$0"` || rc=1
 	if [ $rc = 0 ]; then
-		install -m 0444 -o nobody -g wheel $FCODES /var/db/locate.database
+		# -p keeps the modification time the index was built for
+		install -p -m 0444 -o nobody -g wheel $FCODES /var/db/locate.database
+		if [ -f $FCODES.tri ]; then
+			install -p -m 0444 -o nobody -g wheel $FCODES.tri \
+			    /var/db/locate.database.tri
+		fi
 	fi
-	rm $FCODES
+	rm -f $FCODES $FCODES.tri
 	exit $rc
 fi
 : ${LOCATE_CONFIG="/etc/locate.rc"}
@@ -57,10 +62,12 @@ PATH=$LIBEXECDIR:/bin:/usr/bin:$PATH; export PATH
 set -o noglob
 
 : ${mklocatedb:=locate.mklocatedb}      # make locate database program
+: ${locate:=locate}                     # locate program
 : ${FCODES:=/var/db/locate.database}    # the database
 : ${SEARCHPATHS:="/"}                   # directories to be put in the database
 : ${PRUNEPATHS:="/private/tmp /private/var/folders /private/var/tmp */Backups.backupdb"} # unwanted directories
 : ${FILESYSTEMS:="hfs ufs apfs"}        # allowed filesystems
+: ${DIRCACHE:=""}                       # directory cache, for incremental runs
 : ${find:=find}
 
 case X"$SEARCHPATHS" in 
@@ -88,13 +95,24 @@ esac
 tmp=$TMPDIR/_updatedb$$
 trap 'rm -f $tmp; rmdir $TMPDIR; exit' 0 1 2 3 5 10 15
 		
-# search locally
+# search locally; with a directory cache only changed directories are read
 # echo $find $SEARCHPATHS $excludes -or -print && exit
-if $find -s $SEARCHPATHS $excludes -or -print 2>/dev/null |
-        $mklocatedb -presort > $tmp
+if [ -n "$DIRCACHE" ]; then
+	filelist() {
+		$locate -u "$DIRCACHE" -P "$PRUNEPATHS" -F "$FILESYSTEMS" \
+		    $SEARCHPATHS
+	}
+else
+	filelist() {
+		$find -s $SEARCHPATHS $excludes -or -print
+	}
+fi
+
+if filelist 2>/dev/null | $mklocatedb -presort > $tmp
 then
 	case X"`$find $tmp -size -257c -print`" in
-		X) cat $tmp > $FCODES;;
+		X) cat $tmp > $FCODES
+		   $locate -d $FCODES -T || rm -f $FCODES.tri;;
 		*) echo "updatedb: locate database $tmp is empty"
 		   exit 1
 	esac
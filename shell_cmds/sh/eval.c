@@ -356,10 +356,12 @@ evalfor(union node *n, int flags)
 	int status;
 
 	emptyarglist(&arglist);
+	cleardircache();
 	for (argp = n->nfor.args ; argp ; argp = argp->narg.next) {
 		oexitstatus = exitstatus;
 		expandarg(argp, &arglist, EXP_FULL | EXP_TILDE);
 	}
+	cleardircache();
 
 	loopnest++;
 	status = 0;
@@ -858,6 +860,7 @@ evalcommand(union node *cmd, int flags, struct backcmd *backcmd)
 	exitstatus = 0;
 	/* Add one slot at the beginning for tryexec(). */
 	appendarglist(&arglist, nullstr);
+	cleardircache();
 	for (argp = cmd->ncmd.args ; argp ; argp = argp->narg.next) {
 		if (varflag && isassignment(argp->narg.text)) {
 			expandarg(argp, varflag == 1 ? &varlist : &arglist,
@@ -869,6 +872,7 @@ evalcommand(union node *cmd, int flags, struct backcmd *backcmd)
 	}
 	appendarglist(&arglist, nullstr);
 	expredir(cmd->ncmd.redirect);
+	cleardircache();
 	argc = arglist.count - 2;
 	argv = &arglist.args[1];
 
@@ -910,13 +914,11 @@ evalcommand(union node *cmd, int flags, struct backcmd *backcmd)
 				 * updating the table while this command
 				 * runs, by the command finding mechanism
 				 * is heavily integrated with hash handling,
-				 * so we just delete the hash before and after
-				 * the command runs. Partly deleting like
-				 * changepatch() does doesn't seem worth the
-				 * bookinging effort, since most such runs add
-				 * directories in front of the new PATH.
+				 * so we delete the entries which may differ
+				 * between the two paths before and after
+				 * the command runs, like changepath() does.
 				 */
-				clearcmdentry();
+				clearcmdpath(path);
 				do_clearcmdentry = 1;
 			}
 
@@ -958,7 +960,7 @@ evalcommand(union node *cmd, int flags, struct backcmd *backcmd)
 						argc -= 2;
 					}
 					path = _PATH_STDPATH;
-					clearcmdentry();
+					clearcmdpath(path);
 					do_clearcmdentry = 1;
 				} else if (!strcmp(argv[1], "--")) {
 					if (argc == 2)
@@ -1179,7 +1181,7 @@ out:
 	if (lastarg)
 		setvar("_", lastarg, 0);
 	if (do_clearcmdentry)
-		clearcmdentry();
+		clearcmdpath(path);
 }
 
 
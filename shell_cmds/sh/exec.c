@@ -43,6 +43,7 @@ __FBSDID("$FreeBSD: head/bin/sh/exec.c 296813 2016-03-13 22:54:14Z jilles $");
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
 #include <paths.h>
 #include <stdlib.h>
 
@@ -79,21 +80,30 @@ __FBSDID("$FreeBSD: head/bin/sh/exec.c 296813 2016-03-13 22:54:14Z jilles $");
 #define eaccess(path, mode) faccessat(AT_FDCWD, path, mode, AT_EACCESS)
 #endif /* __APPLE__ */
 
-#define CMDTABLESIZE 31		/* should be prime */
+#define CMDTABLESIZE 32		/* initial size, must be a power of 2 */
 
 
 
 struct tblentry {
-	struct tblentry *next;	/* next entry in hash chain */
+	unsigned int hash;	/* hash value of cmdname */
 	union param param;	/* definition of builtin function */
 	int special;		/* flag for special builtin commands */
 	signed char cmdtype;	/* index identifying command */
+	char cd;		/* found via a relative PATH entry */
 	char cmdname[];		/* name of command */
 };
 
 
-static struct tblentry *cmdtable[CMDTABLESIZE];
+/*
+ * The command table uses open addressing with linear probing.  It starts
+ * out in cmdtable0 and is doubled whenever it becomes half full.
+ */
+static struct tblentry *cmdtable0[CMDTABLESIZE];
+static struct tblentry **cmdtable = cmdtable0;
+static unsigned int cmdtabmask = CMDTABLESIZE - 1;
+static unsigned int cmdtabcount;
 static int cmdtable_cd = 0;	/* cmdtable contains cd-dependent entries */
+static unsigned int lastcmdentry;	/* slot of the last cmdlookup */
 int exerrno = 0;			/* Last exec error */
 
 
@@ -102,6 +112,8 @@ static void printentry(struct tblentry *, int);
 static struct tblentry *cmdlookup(const char *, int);
 static void delete_cmd_entry(void);
 static void addcmdentry(const char *, struct cmdentry *);
+static void prunecmdtable(int, int);
+static int pathfirstchange(const char *, const char *);
 
 
 
@@ -227,8 +239,8 @@ padvance(const char **path, const char *name)
 int
 hashcmd(int argc __unused, char **argv __unused)
 {
-	struct tblentry **pp;
 	struct tblentry *cmdp;
+	unsigned int i;
 	int c;
 	int verbose;
 	struct cmdentry entry;
@@ -245,11 +257,10 @@ hashcmd(int argc __unused, char **argv __unused)
 		}
 	}
 	if (*argptr == NULL) {
-		for (pp = cmdtable ; pp < &cmdtable[CMDTABLESIZE] ; pp++) {
-			for (cmdp = *pp ; cmdp ; cmdp = cmdp->next) {
-				if (cmdp->cmdtype == CMDNORMAL)
-					printentry(cmdp, verbose);
-			}
+		for (i = 0; i <= cmdtabmask; i++) {
+			cmdp = cmdtable[i];
+			if (cmdp != NULL && cmdp->cmdtype == CMDNORMAL)
+				printentry(cmdp, verbose);
 		}
 		return 0;
 	}
@@ -429,8 +440,10 @@ find_command(const char *name, struct cmdentry *entry, int act,
 	return;
 
 success:
-	if (cd)
+	if (cd) {
+		cmdp->cd = 1;
 		cmdtable_cd = 1;
+	}
 	entry->cmdtype = cmdp->cmdtype;
 	entry->u = cmdp->param;
 	entry->special = cmdp->special;
@@ -461,15 +474,15 @@ find_builtin(const char *name, int *special)
 
 
 /*
- * Called when a cd is done.  If any entry in cmdtable depends on the current
- * directory, simply clear cmdtable completely.
+ * Called when a cd is done.  Entries which were found through a relative
+ * PATH entry depend on the current directory and are removed.
  */
 
 void
 hashcd(void)
 {
 	if (cmdtable_cd)
-		clearcmdentry();
+		prunecmdtable(0, 1);
 }
 
 
@@ -481,51 +494,126 @@ hashcd(void)
  */
 
 void
-changepath(const char *newval __unused)
+changepath(const char *newval)
+{
+	prunecmdtable(pathfirstchange(pathval(), newval), 0);
+}
+
+
+/*
+ * Called around a command which is looked up in a PATH other than
+ * pathval(), such as a PATH=... assignment in front of the command or
+ * command -p.  Only entries which may resolve differently in the two
+ * paths are removed.
+ */
+
+void
+clearcmdpath(const char *path)
 {
-	clearcmdentry();
+	prunecmdtable(pathfirstchange(pathval(), path), 0);
 }
 
 
 /*
- * Clear out command entries.  The argument specifies the first entry in
- * PATH which has changed.
+ * Clear out command entries.
  */
 
 void
 clearcmdentry(void)
 {
-	struct tblentry **tblp;
-	struct tblentry **pp;
+	prunecmdtable(0, 0);
+}
+
+
+/*
+ * Return the index of the first entry which differs between the two
+ * paths, or INT_MAX if they are the same.
+ */
+
+static int
+pathfirstchange(const char *old, const char *new)
+{
+	int idx;
+
+	for (idx = 0; *old == *new; old++, new++) {
+		if (*old == '\0')
+			return INT_MAX;
+		if (*old == ':')
+			idx++;
+	}
+	/* One path is a prefix of the other, ending at a colon. */
+	if ((*old == '\0' && *new == ':') || (*old == ':' && *new == '\0'))
+		idx++;
+	return idx;
+}
+
+
+/*
+ * Remove the CMDNORMAL entries whose PATH index is idx or larger.  If
+ * cdonly is set, only remove the entries which depend on the current
+ * directory.
+ */
+
+static void
+prunecmdtable(int idx, int cdonly)
+{
 	struct tblentry *cmdp;
+	unsigned int i;
 
+	if (idx == INT_MAX)
+		return;
 	INTOFF;
-	for (tblp = cmdtable ; tblp < &cmdtable[CMDTABLESIZE] ; tblp++) {
-		pp = tblp;
-		while ((cmdp = *pp) != NULL) {
-			if (cmdp->cmdtype == CMDNORMAL) {
-				*pp = cmdp->next;
-				ckfree(cmdp);
-			} else {
-				pp = &cmdp->next;
-			}
-		}
+	for (i = 0; i <= cmdtabmask; ) {
+		cmdp = cmdtable[i];
+		if (cmdp != NULL && cmdp->cmdtype == CMDNORMAL &&
+		    cmdp->param.index >= idx && (cmdp->cd || !cdonly)) {
+			/* The slot is refilled from later in the chain. */
+			lastcmdentry = i;
+			delete_cmd_entry();
+		} else
+			i++;
 	}
-	cmdtable_cd = 0;
+	if (idx == 0)
+		cmdtable_cd = 0;
 	INTON;
 }
 
 
+/*
+ * Double the size of the command table.  Called with interrupts off.
+ */
+
+static void
+growcmdtable(void)
+{
+	struct tblentry **oldtab, *cmdp;
+	unsigned int oldmask, i, j;
+
+	oldtab = cmdtable;
+	oldmask = cmdtabmask;
+	cmdtabmask = oldmask * 2 + 1;
+	cmdtable = ckmalloc((cmdtabmask + 1) * sizeof(*cmdtable));
+	memset(cmdtable, 0, (cmdtabmask + 1) * sizeof(*cmdtable));
+	for (i = 0; i <= oldmask; i++) {
+		if ((cmdp = oldtab[i]) == NULL)
+			continue;
+		for (j = cmdp->hash & cmdtabmask; cmdtable[j] != NULL;
+		    j = (j + 1) & cmdtabmask)
+			;
+		cmdtable[j] = cmdp;
+	}
+	if (oldtab != cmdtable0)
+		ckfree(oldtab);
+}
+
+
 /*
  * Locate a command in the command hash table.  If "add" is nonzero,
  * add the command to the table if it is not already present.  The
- * variable "lastcmdentry" is set to point to the address of the link
- * pointing to the entry, so that delete_cmd_entry can delete the
- * entry.
+ * variable "lastcmdentry" is set to the slot of the entry, so that
+ * delete_cmd_entry can delete the entry.
  */
 
-static struct tblentry **lastcmdentry;
-
 
 static struct tblentry *
 cmdlookup(const char *name, int add)
@@ -533,46 +621,66 @@ cmdlookup(const char *name, int add)
 	unsigned int hashval;
 	const char *p;
 	struct tblentry *cmdp;
-	struct tblentry **pp;
+	unsigned int i;
 	size_t len;
 
-	p = name;
-	hashval = (unsigned char)*p << 4;
-	while (*p)
-		hashval += *p++;
-	pp = &cmdtable[hashval % CMDTABLESIZE];
-	for (cmdp = *pp ; cmdp ; cmdp = cmdp->next) {
-		if (equal(cmdp->cmdname, name))
+	hashval = 2166136261U;
+	for (p = name; *p; p++)
+		hashval = (hashval ^ (unsigned char)*p) * 16777619U;
+	len = p - name;
+	for (i = hashval & cmdtabmask; (cmdp = cmdtable[i]) != NULL;
+	    i = (i + 1) & cmdtabmask) {
+		if (cmdp->hash == hashval && equal(cmdp->cmdname, name))
 			break;
-		pp = &cmdp->next;
 	}
 	if (add && cmdp == NULL) {
 		INTOFF;
-		len = strlen(name);
-		cmdp = *pp = ckmalloc(sizeof (struct tblentry) + len + 1);
-		cmdp->next = NULL;
+		if (2 * (cmdtabcount + 1) > cmdtabmask + 1) {
+			growcmdtable();
+			for (i = hashval & cmdtabmask; cmdtable[i] != NULL;
+			    i = (i + 1) & cmdtabmask)
+				;
+		}
+		cmdp = cmdtable[i] = ckmalloc(sizeof (struct tblentry) + len + 1);
+		cmdtabcount++;
+		cmdp->hash = hashval;
 		cmdp->cmdtype = CMDUNKNOWN;
+		cmdp->cd = 0;
 		memcpy(cmdp->cmdname, name, len + 1);
 		INTON;
 	}
-	lastcmdentry = pp;
+	lastcmdentry = i;
 	return cmdp;
 }
 
 /*
- * Delete the command entry returned on the last lookup.
+ * Delete the command entry returned on the last lookup.  Entries further
+ * along the probe sequence are moved back so that no tombstones are needed.
  */
 
 static void
 delete_cmd_entry(void)
 {
 	struct tblentry *cmdp;
+	unsigned int i, j, k;
 
 	INTOFF;
-	cmdp = *lastcmdentry;
-	*lastcmdentry = cmdp->next;
-	ckfree(cmdp);
-	INTON;
+	i = lastcmdentry;
+	ckfree(cmdtable[i]);
+	cmdtabcount--;
+	for (j = i;;) {
+		cmdtable[i] = NULL;
+		do {
+			j = (j + 1) & cmdtabmask;
+			if ((cmdp = cmdtable[j]) == NULL) {
+				INTON;
+				return;
+			}
+			k = cmdp->hash & cmdtabmask;
+		} while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+		cmdtable[i] = cmdp;
+		i = j;
+	}
 }
 
 
@@ -664,7 +772,7 @@ typecmd_impl(int argc, char **argv, int cmd, const char *path)
 	int error1 = 0;
 
 	if (path != pathval())
-		clearcmdentry();
+		clearcmdpath(path);
 
 	for (i = 1; i < argc; i++) {
 		/* First look at the keywords */
@@ -762,7 +870,7 @@ typecmd_impl(int argc, char **argv, int cmd, const char *path)
 	}
 
 	if (path != pathval())
-		clearcmdentry();
+		clearcmdpath(path);
 
 	return error1;
 }
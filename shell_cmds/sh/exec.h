@@ -75,3 +75,4 @@ int unsetfunc(const char *);
 int isfunc(const char *);
 int typecmd_impl(int, char **, int, const char *);
 void clearcmdentry(void);
+void clearcmdpath(const char *);
@@ -458,6 +458,7 @@ expbackq(union node *cmd, int quoted, int flag, struct worddest *dst)
 	INTOFF;
 	saveargbackq = argbackq;
 	p = grabstackstr(dest);
+	cleardircache();
 	evalbackcmd(cmd, &in);
 	ungrabstackstr(p, dest);
 	argbackq = saveargbackq;
@@ -1022,6 +1023,392 @@ varvalue(const char *name, int quoted, int subtype, int flag,
 static char expdir[PATH_MAX];
 #define expdir_end (expdir + sizeof(expdir))
 
+/*
+ * Directory listings read during pathname generation are kept until
+ * cleardircache() is called, which the evaluator does before and after
+ * expanding the words of a command and before a command substitution.
+ * This way a command using several patterns in the same directory,
+ * such as ls *.c *.h, reads it only once.
+ */
+
+#define DIRCACHESIZE	128	/* must be a power of 2 */
+#define DIRCACHEMAX	(4 * 1024 * 1024)	/* bytes of names kept */
+
+struct dcent {
+	int off;		/* offset of the name in names */
+	int namlen;		/* length of the name */
+	unsigned char type;	/* d_type */
+};
+
+struct dircache {
+	struct dircache *next;	/* next entry in hash chain */
+	unsigned int hash;	/* hash value of path */
+	int cached;		/* entry is in dircachetab */
+	int nent;		/* number of entries */
+	struct dcent *ent;
+	char *names;
+	char path[];
+};
+
+static struct dircache *dircachetab[DIRCACHESIZE];
+static size_t dircachebytes;
+
+/*
+ * A pattern for a single pathname component, compiled once per call to
+ * expandmeta().  Patterns using only '*' are matched as a list of literal
+ * pieces; patterns without '*' whose brackets and '?' only need to match
+ * single bytes are matched with one bitmap per character.  Anything else
+ * goes through patmatch().
+ */
+
+#define GP_GENERIC	0
+#define GP_STARS	1	/* literal pieces separated by '*' */
+#define GP_CLASS	2	/* fixed length, one byte set per character */
+
+struct globpat {
+	struct globpat *next;
+	const char *pattern;	/* the pattern text this was compiled from */
+	int type;
+	int n;			/* number of pieces or characters */
+	int *plen;		/* GP_STARS: length of each piece */
+	char *text;		/* GP_STARS: the pieces, concatenated */
+	unsigned char (*set)[32];	/* GP_CLASS: byte sets */
+};
+
+static struct globpat *globpats;
+
+static void
+freedircache(struct dircache *dc)
+{
+	ckfree(dc->ent);
+	ckfree(dc->names);
+	ckfree(dc);
+}
+
+void
+cleardircache(void)
+{
+	struct dircache *dc, *next;
+	int i;
+
+	if (dircachebytes == 0)
+		return;
+	INTOFF;
+	for (i = 0; i < DIRCACHESIZE; i++) {
+		for (dc = dircachetab[i]; dc != NULL; dc = next) {
+			next = dc->next;
+			freedircache(dc);
+		}
+		dircachetab[i] = NULL;
+	}
+	dircachebytes = 0;
+	INTON;
+}
+
+/*
+ * Return the listing of a directory, reading it if it is not in the cache.
+ * If the cache is full, the listing is returned with cached == 0 and must
+ * be freed by the caller.  Called with interrupts off.
+ */
+static struct dircache *
+readdircache(const char *path)
+{
+	struct dircache *dc;
+	struct dcent *ent;
+	struct dirent *dp;
+	DIR *dirp;
+	const char *p;
+	char *names;
+	unsigned int hashval;
+	int nent, entcap, namlen;
+	size_t len, cap;
+
+	hashval = 2166136261U;
+	for (p = path; *p; p++)
+		hashval = (hashval ^ (unsigned char)*p) * 16777619U;
+	for (dc = dircachetab[hashval & (DIRCACHESIZE - 1)]; dc != NULL;
+	    dc = dc->next)
+		if (dc->hash == hashval && equal(dc->path, path))
+			return dc;
+
+	if ((dirp = opendir(path)) == NULL)
+		return NULL;
+	nent = 0;
+	entcap = 64;
+	ent = ckmalloc(entcap * sizeof(*ent));
+	len = 0;
+	cap = 1024;
+	names = ckmalloc(cap);
+	while (! int_pending() && (dp = readdir(dirp)) != NULL) {
+		namlen = dp->d_namlen;
+		if (nent == entcap) {
+			entcap *= 2;
+			ent = ckrealloc(ent, entcap * sizeof(*ent));
+		}
+		while (len + namlen + 1 > cap) {
+			cap *= 2;
+			names = ckrealloc(names, cap);
+		}
+		ent[nent].off = len;
+		ent[nent].namlen = namlen;
+		ent[nent].type = dp->d_type;
+		memcpy(names + len, dp->d_name, namlen + 1);
+		len += namlen + 1;
+		nent++;
+	}
+	closedir(dirp);
+	if (int_pending()) {
+		ckfree(ent);
+		ckfree(names);
+		return NULL;
+	}
+	dc = ckmalloc(sizeof(*dc) + strlen(path) + 1);
+	dc->hash = hashval;
+	dc->nent = nent;
+	dc->ent = ent;
+	dc->names = names;
+	strcpy(dc->path, path);
+	dc->cached = dircachebytes + len <= DIRCACHEMAX;
+	if (dc->cached) {
+		dc->next = dircachetab[hashval & (DIRCACHESIZE - 1)];
+		dircachetab[hashval & (DIRCACHESIZE - 1)] = dc;
+		dircachebytes += len + 1;
+	}
+	return dc;
+}
+
+/*
+ * Returns true if the name is in the cached listing of the directory.
+ */
+static int
+dircachehas(const char *dir, const char *name)
+{
+	struct dircache *dc;
+	const char *p;
+	unsigned int hashval;
+	size_t namlen;
+	int i;
+
+	hashval = 2166136261U;
+	for (p = dir; *p; p++)
+		hashval = (hashval ^ (unsigned char)*p) * 16777619U;
+	for (dc = dircachetab[hashval & (DIRCACHESIZE - 1)]; dc != NULL;
+	    dc = dc->next)
+		if (dc->hash == hashval && equal(dc->path, dir))
+			break;
+	if (dc == NULL)
+		return 0;
+	namlen = strlen(name);
+	for (i = 0; i < dc->nent; i++)
+		if ((size_t)dc->ent[i].namlen == namlen &&
+		    memcmp(dc->names + dc->ent[i].off, name, namlen) == 0)
+			return 1;
+	return 0;
+}
+
+/*
+ * Find the end of a bracket expression the way patmatch() parses it,
+ * starting after the '['.  Returns NULL if the bracket is not closed.
+ */
+static const char *
+bracketend(const char *p)
+{
+	const char *nameend;
+	char c;
+
+	if (*p == '!' || *p == '^')
+		p++;
+	c = *p++;
+	do {
+		if (c == '\0')
+			return NULL;
+		if (c == '[' && *p == ':') {
+			nameend = strstr(p + 1, ":]");
+			if (nameend != NULL && nameend != p + 1 &&
+			    nameend - (p + 1) < 20)
+				p = nameend + 2;
+		}
+		if (c == CTLESC)
+			c = *p++;
+		if (*p == '-' && p[1] != ']') {
+			p++;
+			if (*p == CTLESC)
+				p++;
+			if (*p == '\0')
+				return NULL;
+			p++;
+		}
+	} while ((c = *p++) != ']');
+	return p;
+}
+
+/*
+ * Compile a pathname component pattern, terminated by '\0'.
+ */
+static struct globpat *
+compilepat(const char *pattern)
+{
+	struct globpat *gp;
+	const char *p, *end;
+	char *t;
+	char one[2], *br;
+	int nstar, nclass, high, i, c;
+
+	for (gp = globpats; gp != NULL; gp = gp->next)
+		if (gp->pattern == pattern)
+			return gp;
+	gp = ckmalloc(sizeof(*gp));
+	gp->pattern = pattern;
+	gp->type = GP_GENERIC;
+	gp->plen = NULL;
+	gp->text = NULL;
+	gp->set = NULL;
+	gp->next = globpats;
+	globpats = gp;
+
+	nstar = nclass = high = 0;
+	for (p = pattern; *p; p++) {
+		if (*p == CTLESC)
+			p++;
+		else if (*p == '*')
+			nstar++;
+		else if (*p == '?' || *p == '[')
+			nclass++;
+		if (*p & 0x80)
+			high = 1;
+	}
+	if (nclass == 0) {
+		gp->type = GP_STARS;
+		gp->n = nstar + 1;
+		gp->plen = ckmalloc(gp->n * sizeof(*gp->plen));
+		gp->text = t = ckmalloc(strlen(pattern) + 1);
+		i = 0;
+		gp->plen[0] = 0;
+		for (p = pattern; *p; p++) {
+			if (*p == '*') {
+				gp->plen[++i] = 0;
+				continue;
+			}
+			if (*p == CTLESC)
+				p++;
+			*t++ = *p;
+			gp->plen[i]++;
+		}
+		return gp;
+	}
+	if (nstar != 0 || high)
+		return gp;
+
+	i = 0;
+	for (p = pattern; *p; i++) {
+		if (*p == '[' && (end = bracketend(p + 1)) != NULL)
+			p = end;
+		else {
+			if (*p == CTLESC)
+				p++;
+			p++;
+		}
+	}
+	gp->n = i;
+	gp->set = ckmalloc(i * sizeof(*gp->set));
+	memset(gp->set, 0, i * sizeof(*gp->set));
+	br = stalloc(strlen(pattern) + 1);
+	one[1] = '\0';
+	for (i = 0, p = pattern; *p; i++) {
+		if (*p == '?') {
+			for (c = 1; c < (localeisutf8 ? 0x80 : 0x100); c++)
+				gp->set[i][c >> 3] |= 1 << (c & 7);
+			p++;
+		} else if (*p == '[' && (end = bracketend(p + 1)) != NULL) {
+			/* Let patmatch() decide which bytes are members. */
+			memcpy(br, p, end - p);
+			br[end - p] = '\0';
+			for (c = 1; c < (localeisutf8 ? 0x80 : 0x100); c++) {
+				one[0] = c;
+				if (patmatch(br, one))
+					gp->set[i][c >> 3] |= 1 << (c & 7);
+			}
+			p = end;
+		} else {
+			if (*p == CTLESC)
+				p++;
+			c = (unsigned char)*p++;
+			gp->set[i][c >> 3] |= 1 << (c & 7);
+		}
+	}
+	stunalloc(br);
+	gp->type = GP_CLASS;
+	return gp;
+}
+
+static void
+freeglobpats(void)
+{
+	struct globpat *gp;
+
+	while ((gp = globpats) != NULL) {
+		globpats = gp->next;
+		if (gp->plen != NULL)
+			ckfree(gp->plen);
+		if (gp->text != NULL)
+			ckfree(gp->text);
+		if (gp->set != NULL)
+			ckfree(gp->set);
+		ckfree(gp);
+	}
+}
+
+/*
+ * Returns true if the compiled pattern matches the name.
+ */
+static int
+globmatch(const struct globpat *gp, const char *name, int namlen)
+{
+	const char *t, *q, *end;
+	int i, c;
+
+	switch (gp->type) {
+	case GP_STARS:
+		t = gp->text;
+		if (namlen < gp->plen[0] || memcmp(name, t, gp->plen[0]) != 0)
+			return 0;
+		if (gp->n == 1)
+			return namlen == gp->plen[0];
+		q = name + gp->plen[0];
+		end = name + namlen - gp->plen[gp->n - 1];
+		t += gp->plen[0];
+		for (i = 1; i < gp->n - 1; i++) {
+			if (gp->plen[i] == 0)
+				continue;
+			q = memmem(q, end - q > 0 ? end - q : 0, t, gp->plen[i]);
+			if (q == NULL)
+				return 0;
+			q += gp->plen[i];
+			t += gp->plen[i];
+		}
+		return q <= end && memcmp(end, t, gp->plen[gp->n - 1]) == 0;
+	case GP_CLASS:
+		if (namlen != gp->n)
+			break;
+		for (i = 0; i < namlen; i++) {
+			c = (unsigned char)name[i];
+			if (localeisutf8 && c & 0x80)
+				return patmatch(gp->pattern, name);
+			if ((gp->set[i][c >> 3] & 1 << (c & 7)) == 0)
+				return 0;
+		}
+		return 1;
+	default:
+		return patmatch(gp->pattern, name);
+	}
+	/* In UTF-8 a name of another length may still match. */
+	if (localeisutf8)
+		for (i = 0; i < namlen; i++)
+			if (name[i] & 0x80)
+				return patmatch(gp->pattern, name);
+	return 0;
+}
+
 /*
  * Perform pathname generation and remove control characters.
  * At this point, the only control characters should be CTLESC.
@@ -1041,6 +1428,7 @@ expandmeta(char *pattern, struct arglist *dstlist)
 		if (c == '*' || c == '?' || c == '[') {
 			INTOFF;
 			expmeta(expdir, pattern, dstlist);
+			freeglobpats();
 			INTON;
 			break;
 		}
@@ -1070,14 +1458,19 @@ expmeta(char *enddir, char *name, struct arglist *arglist)
 	const char *q;
 	const char *start;
 	char *endname;
+	char *lastname;
 	int metaflag;
 	struct stat statb;
-	DIR *dirp;
-	struct dirent *dp;
+	struct dircache *dc;
+	struct globpat *gp;
+	const char *dname;
+	int i;
 	int atend;
 	int matchdot;
 	int esc;
 	int namlen;
+	int found;
+	unsigned char type;
 
 	metaflag = 0;
 	start = name;
@@ -1113,6 +1506,7 @@ expmeta(char *enddir, char *name, struct arglist *arglist)
 	if (metaflag == 0) {	/* we've reached the end of the file name */
 		if (enddir != expdir)
 			metaflag++;
+		lastname = enddir;
 		for (p = name ; ; p++) {
 			if (*p == CTLESC)
 				p++;
@@ -1122,7 +1516,24 @@ expmeta(char *enddir, char *name, struct arglist *arglist)
 			if (enddir == expdir_end)
 				return;
 		}
-		if (metaflag == 0 || lstat(expdir, &statb) >= 0)
+		if (metaflag == 0) {
+			appendarglist(arglist, stsavestr(expdir));
+			return;
+		}
+		/*
+		 * A single name after the last pattern is looked up in the
+		 * listing of its directory if that has been read already.
+		 * Not finding it there proves nothing on a case-insensitive
+		 * file system, so fall back to lstat().
+		 */
+		found = 0;
+		if (*lastname != '\0' && strchr(lastname, '/') == NULL) {
+			lastname[-1] = '\0';
+			found = dircachehas(lastname - 1 == expdir ? "/" : expdir,
+			    lastname);
+			lastname[-1] = '/';
+		}
+		if (found || lstat(expdir, &statb) >= 0)
 			appendarglist(arglist, stsavestr(expdir));
 		return;
 	}
@@ -1145,10 +1556,11 @@ expmeta(char *enddir, char *name, struct arglist *arglist)
 		p = expdir;
 		enddir[-1] = '\0';
 	}
-	if ((dirp = opendir(p)) == NULL)
-		return;
+	dc = readdircache(p);
 	if (enddir != expdir)
 		enddir[-1] = '/';
+	if (dc == NULL)
+		return;
 	if (*endname == 0) {
 		atend = 1;
 	} else {
@@ -1162,20 +1574,23 @@ expmeta(char *enddir, char *name, struct arglist *arglist)
 		p++;
 	if (*p == '.')
 		matchdot++;
-	while (! int_pending() && (dp = readdir(dirp)) != NULL) {
-		if (dp->d_name[0] == '.' && ! matchdot)
+	gp = compilepat(start);
+	for (i = 0; i < dc->nent && ! int_pending(); i++) {
+		dname = dc->names + dc->ent[i].off;
+		namlen = dc->ent[i].namlen;
+		type = dc->ent[i].type;
+		if (dname[0] == '.' && ! matchdot)
 			continue;
-		if (patmatch(start, dp->d_name)) {
-			namlen = dp->d_namlen;
+		if (globmatch(gp, dname, namlen)) {
 			if (enddir + namlen + 1 > expdir_end)
 				continue;
-			memcpy(enddir, dp->d_name, namlen + 1);
+			memcpy(enddir, dname, namlen + 1);
 			if (atend)
 				appendarglist(arglist, stsavestr(expdir));
 			else {
-				if (dp->d_type != DT_UNKNOWN &&
-				    dp->d_type != DT_DIR &&
-				    dp->d_type != DT_LNK)
+				if (type != DT_UNKNOWN &&
+				    type != DT_DIR &&
+				    type != DT_LNK)
 					continue;
 				if (enddir + namlen + 2 > expdir_end)
 					continue;
@@ -1185,7 +1600,8 @@ expmeta(char *enddir, char *name, struct arglist *arglist)
 			}
 		}
 	}
-	closedir(dirp);
+	if (! dc->cached)
+		freedircache(dc);
 	if (! atend)
 		endname[-esc - 1] = esc ? CTLESC : '/';
 }
@@ -1534,8 +1950,10 @@ freebsd_wordexpcmd(int argc __unused, char **argv __unused)
 		}
 	outcslow(' ', out1);
 	emptyarglist(&arglist);
+	cleardircache();
 	for (n = args; n != NULL; n = n->narg.next)
 		expandarg(n, &arglist, EXP_FULL | EXP_TILDE);
+	cleardircache();
 	for (i = 0, len = 0; i < arglist.count; i++)
 		len += strlen(arglist.args[i]);
 	out1fmt("%016x %016zx", arglist.count, len);
@@ -58,5 +58,6 @@ void emptyarglist(struct arglist *);
 void appendarglist(struct arglist *, char *);
 union node;
 void expandarg(union node *, struct arglist *, int);
+void cleardircache(void);
 void rmescapes(char *);
 int casematch(union node *, const char *);
@@ -45,9 +45,25 @@ __FBSDID("$FreeBSD: head/bin/sh/memalloc.c 278818 2015-02-15 21:41:29Z jilles $"
 #include "error.h"
 #include "mystring.h"
 #include "expand.h"
+#include "options.h"
+#include "builtins.h"
 #include <stdlib.h>
 #include <unistd.h>
 
+/*
+ * Allocation counters, printed by the memstat builtin.
+ */
+
+static struct {
+	unsigned long mallocs;		/* ckmalloc calls */
+	unsigned long reallocs;		/* ckrealloc calls */
+	unsigned long frees;		/* ckfree calls */
+	unsigned long stallocs;		/* stalloc calls */
+	unsigned long stblocks;		/* stack blocks allocated */
+	unsigned long streused;		/* stack blocks reused */
+	int stmax;			/* largest stack block */
+} memstat;
+
 /*
  * Like malloc, but returns an error when out of space.
  */
@@ -57,6 +73,7 @@ ckmalloc(size_t nbytes)
 {
 	pointer p;
 
+	memstat.mallocs++;
 	INTOFF;
 	p = malloc(nbytes);
 	INTON;
@@ -73,6 +90,7 @@ ckmalloc(size_t nbytes)
 pointer
 ckrealloc(pointer p, int nbytes)
 {
+	memstat.reallocs++;
 	INTOFF;
 	p = realloc(p, nbytes);
 	INTON;
@@ -84,6 +102,7 @@ ckrealloc(pointer p, int nbytes)
 void
 ckfree(pointer p)
 {
+	memstat.frees++;
 	INTOFF;
 	free(p);
 	INTON;
@@ -113,19 +132,27 @@ savestr(const char *s)
  * handling code to handle interrupts in the middle of a parse.
  *
  * The size 496 was chosen because with 16-byte alignment the total size
- * for the allocated block is 512.
+ * for the allocated block is 512.  Each block on the stack doubles the
+ * size of the next one, up to 64k, so deep or long-running evaluations
+ * do not go to malloc every 512 bytes.  The most recently freed block is
+ * kept for reuse, as loops tend to push and pop the same block over and
+ * over.
  */
 
 #define MINSIZE 496		/* minimum size of a block. */
+#define MAXSHIFT 7		/* largest size is (MINSIZE + 16) << MAXSHIFT */
 
 
 struct stack_block {
 	struct stack_block *prev;
+	int size;		/* allocated size of the block */
 	/* Data follows */
 };
 #define SPACE(sp)	((char*)(sp) + ALIGN(sizeof(struct stack_block)))
 
 static struct stack_block *stackp;
+static struct stack_block *stackspare;	/* freed block kept for reuse */
+static int stackdepth;			/* number of blocks on the stack */
 char *stacknxt;
 int stacknleft;
 char *sstrend;
@@ -135,29 +162,62 @@ static void
 stnewblock(int nbytes)
 {
 	struct stack_block *sp;
-	int allocsize;
+	int allocsize, minsize;
 
-	if (nbytes < MINSIZE)
-		nbytes = MINSIZE;
+	minsize = ((MINSIZE + 16) << (stackdepth < MAXSHIFT ?
+	    stackdepth : MAXSHIFT)) - 16;
+	if (nbytes < minsize)
+		nbytes = minsize;
 
 	allocsize = ALIGN(sizeof(struct stack_block)) + ALIGN(nbytes);
 
 	INTOFF;
-	sp = ckmalloc(allocsize);
+	if (stackspare != NULL && stackspare->size >= allocsize) {
+		sp = stackspare;
+		stackspare = NULL;
+		allocsize = sp->size;
+		memstat.streused++;
+	} else {
+		sp = ckmalloc(allocsize);
+		sp->size = allocsize;
+		memstat.stblocks++;
+		if (allocsize > memstat.stmax)
+			memstat.stmax = allocsize;
+	}
 	sp->prev = stackp;
 	stacknxt = SPACE(sp);
 	stacknleft = allocsize - (stacknxt - (char*)sp);
 	sstrend = stacknxt + stacknleft;
 	stackp = sp;
+	stackdepth++;
 	INTON;
 }
 
 
+/*
+ * Free a block popped off the stack, or keep it as the spare block if it
+ * is at least as large as the current one and not oversized.
+ */
+
+static void
+stfreeblock(struct stack_block *sp)
+{
+	if (sp->size <= (MINSIZE + 16) << MAXSHIFT &&
+	    (stackspare == NULL || sp->size >= stackspare->size)) {
+		if (stackspare != NULL)
+			ckfree(stackspare);
+		stackspare = sp;
+	} else
+		ckfree(sp);
+}
+
+
 pointer
 stalloc(int nbytes)
 {
 	char *p;
 
+	memstat.stallocs++;
 	nbytes = ALIGN(nbytes);
 	if (nbytes > stacknleft)
 		stnewblock(nbytes);
@@ -214,7 +274,8 @@ popstackmark(struct stackmark *mark)
 	while (stackp != mark->stackp) {
 		sp = stackp;
 		stackp = sp->prev;
-		ckfree(sp);
+		stackdepth--;
+		stfreeblock(sp);
 	}
 	stacknxt = mark->stacknxt;
 	stacknleft = mark->stacknleft;
@@ -261,6 +322,9 @@ growstackblock(int min)
 		oldstackp = stackp;
 		stackp = oldstackp->prev;
 		sp = ckrealloc((pointer)oldstackp, newlen);
+		sp->size = newlen;
+		if (newlen > memstat.stmax)
+			memstat.stmax = newlen;
 		sp->prev = stackp;
 		stackp = sp;
 		stacknxt = SPACE(sp);
@@ -340,3 +404,30 @@ stputs(const char *data, char *p)
 {
 	return (stputbin(data, strlen(data), p));
 }
+
+
+/*
+ * The memstat builtin prints the allocation counters.  With -r, the
+ * counters are reset afterwards.
+ */
+
+int
+memstatcmd(int argc __unused, char **argv __unused)
+{
+	int c, reset;
+
+	reset = 0;
+	while ((c = nextopt("r")) != '\0')
+		reset = 1;
+	out1fmt("ckmalloc %lu\nckrealloc %lu\nckfree %lu\n",
+	    memstat.mallocs, memstat.reallocs, memstat.frees);
+	out1fmt("stalloc %lu\nstblocks %lu\nstreused %lu\nstmax %d\n",
+	    memstat.stallocs, memstat.stblocks, memstat.streused,
+	    memstat.stmax);
+	if (reset) {
+		memstat.mallocs = memstat.reallocs = memstat.frees = 0;
+		memstat.stallocs = memstat.stblocks = memstat.streused = 0;
+		memstat.stmax = 0;
+	}
+	return 0;
+}
@@ -69,7 +69,7 @@ __FBSDID("$FreeBSD: head/bin/sh/var.c 306843 2016-10-08 13:40:12Z jilles $");
 #endif
 
 
-#define VTABSIZE 39
+#define VTABSIZE 64		/* initial size, must be a power of 2 */
 
 
 struct varinit {
@@ -129,7 +129,14 @@ static const struct varinit varinit[] = {
 	  NULL }
 };
 
-static struct var *vartab[VTABSIZE];
+/*
+ * The variable table uses open addressing with linear probing.  It starts
+ * out in vartab0 and is doubled whenever it becomes half full.
+ */
+static struct var *vartab0[VTABSIZE];
+static struct var **vartab = vartab0;
+static unsigned int vtabmask = VTABSIZE - 1;
+static unsigned int vtabcount;
 
 static const char *const locale_names[7] = {
 	"LC_COLLATE", "LC_CTYPE", "LC_MONETARY",
@@ -140,7 +147,9 @@ static const int locale_categories[7] = {
 };
 
 static int varequal(const char *, const char *);
-static struct var *find_var(const char *, struct var ***, int *);
+static struct var *find_var(const char *, unsigned int *, int *);
+static void addvar(struct var *, unsigned int);
+static void delvar(struct var *);
 static int localevar(const char *);
 static void setvareq_const(const char *s, int flags);
 
@@ -157,14 +166,13 @@ initvar(void)
 	char ppid[20];
 	const struct varinit *ip;
 	struct var *vp;
-	struct var **vpp;
+	unsigned int hashval;
 	char **envp;
 
 	for (ip = varinit ; (vp = ip->var) != NULL ; ip++) {
-		if (find_var(ip->text, &vpp, &vp->name_len) != NULL)
+		if (find_var(ip->text, &hashval, &vp->name_len) != NULL)
 			continue;
-		vp->next = *vpp;
-		*vpp = vp;
+		addvar(vp, hashval);
 		vp->text = __DECONST(char *, ip->text);
 		vp->flags = ip->flags | VSTRFIXED | VTEXTFIXED;
 		vp->func = ip->func;
@@ -172,9 +180,8 @@ initvar(void)
 	/*
 	 * PS1 depends on uid
 	 */
-	if (find_var("PS1", &vpp, &vps1.name_len) == NULL) {
-		vps1.next = *vpp;
-		*vpp = &vps1;
+	if (find_var("PS1", &hashval, &vps1.name_len) == NULL) {
+		addvar(&vps1, hashval);
 		vps1.text = __DECONST(char *, geteuid() ? "PS1=$ " : "PS1=# ");
 		vps1.flags = VSTRFIXED|VTEXTFIXED;
 	}
@@ -319,14 +326,15 @@ change_env(const char *s, int set)
 void
 setvareq(char *s, int flags)
 {
-	struct var *vp, **vpp;
+	struct var *vp;
+	unsigned int hashval;
 	int nlen;
 
 	if (aflag)
 		flags |= VEXPORT;
 	if (forcelocal && !(flags & (VNOSET | VNOLOCAL)))
 		mklocal(s);
-	vp = find_var(s, &vpp, &nlen);
+	vp = find_var(s, &hashval, &nlen);
 	if (vp != NULL) {
 		if (vp->flags & VREADONLY) {
 			if ((flags & (VTEXTFIXED|VSTACK)) == 0)
@@ -380,9 +388,8 @@ setvareq(char *s, int flags)
 	vp->flags = flags;
 	vp->text = s;
 	vp->name_len = nlen;
-	vp->next = *vpp;
 	vp->func = NULL;
-	*vpp = vp;
+	addvar(vp, hashval);
 	if ((vp->flags & VEXPORT) && localevar(s)) {
 		change_env(s, 1);
 		(void) setlocale(LC_ALL, "");
@@ -547,21 +554,21 @@ char **
 environment(void)
 {
 	int nenv;
-	struct var **vpp;
+	unsigned int i;
 	struct var *vp;
 	char **env, **ep;
 
 	nenv = 0;
-	for (vpp = vartab ; vpp < vartab + VTABSIZE ; vpp++) {
-		for (vp = *vpp ; vp ; vp = vp->next)
-			if (vp->flags & VEXPORT)
-				nenv++;
+	for (i = 0; i <= vtabmask; i++) {
+		vp = vartab[i];
+		if (vp != NULL && vp->flags & VEXPORT)
+			nenv++;
 	}
 	ep = env = stalloc((nenv + 1) * sizeof *env);
-	for (vpp = vartab ; vpp < vartab + VTABSIZE ; vpp++) {
-		for (vp = *vpp ; vp ; vp = vp->next)
-			if (vp->flags & VEXPORT)
-				*ep++ = vp->text;
+	for (i = 0; i <= vtabmask; i++) {
+		vp = vartab[i];
+		if (vp != NULL && vp->flags & VEXPORT)
+			*ep++ = vp->text;
 	}
 	*ep = NULL;
 	return env;
@@ -592,31 +599,29 @@ var_compare(const void *a, const void *b)
 int
 showvarscmd(int argc __unused, char **argv __unused)
 {
-	struct var **vpp;
 	struct var *vp;
 	const char *s;
 	const char **vars;
+	unsigned int j;
 	int i, n;
 
 	/*
 	 * POSIX requires us to sort the variables.
 	 */
 	n = 0;
-	for (vpp = vartab; vpp < vartab + VTABSIZE; vpp++) {
-		for (vp = *vpp; vp; vp = vp->next) {
-			if (!(vp->flags & VUNSET))
-				n++;
-		}
+	for (j = 0; j <= vtabmask; j++) {
+		vp = vartab[j];
+		if (vp != NULL && !(vp->flags & VUNSET))
+			n++;
 	}
 
 	INTOFF;
 	vars = ckmalloc(n * sizeof(*vars));
 	i = 0;
-	for (vpp = vartab; vpp < vartab + VTABSIZE; vpp++) {
-		for (vp = *vpp; vp; vp = vp->next) {
-			if (!(vp->flags & VUNSET))
-				vars[i++] = vp->text;
-		}
+	for (j = 0; j <= vtabmask; j++) {
+		vp = vartab[j];
+		if (vp != NULL && !(vp->flags & VUNSET))
+			vars[i++] = vp->text;
 	}
 
 	qsort(vars, n, sizeof(*vars), var_compare);
@@ -648,8 +653,8 @@ showvarscmd(int argc __unused, char **argv __unused)
 int
 exportcmd(int argc __unused, char **argv)
 {
-	struct var **vpp;
 	struct var *vp;
+	unsigned int i;
 	char **ap;
 	char *name;
 	char *p;
@@ -688,30 +693,27 @@ exportcmd(int argc __unused, char **argv)
 			setvar(name, p, flag);
 		}
 	} else {
-		for (vpp = vartab ; vpp < vartab + VTABSIZE ; vpp++) {
-			for (vp = *vpp ; vp ; vp = vp->next) {
-				if (vp->flags & flag) {
-					if (values) {
-						/*
-						 * Skip improper variable names
-						 * so the output remains usable
-						 * as shell input.
-						 */
-						if (!isassignment(vp->text))
-							continue;
-						out1str(cmdname);
-						out1c(' ');
-					}
-					if (values && !(vp->flags & VUNSET)) {
-						outbin(vp->text,
-						    vp->name_len + 1, out1);
-						out1qstr(vp->text +
-						    vp->name_len + 1);
-					} else
-						outbin(vp->text, vp->name_len,
-						    out1);
-					out1c('\n');
+		for (i = 0; i <= vtabmask; i++) {
+			vp = vartab[i];
+			if (vp != NULL && vp->flags & flag) {
+				if (values) {
+					/*
+					 * Skip improper variable names so
+					 * the output remains usable as
+					 * shell input.
+					 */
+					if (!isassignment(vp->text))
+						continue;
+					out1str(cmdname);
+					out1c(' ');
 				}
+				if (values && !(vp->flags & VUNSET)) {
+					outbin(vp->text, vp->name_len + 1,
+					    out1);
+					out1qstr(vp->text + vp->name_len + 1);
+				} else
+					outbin(vp->text, vp->name_len, out1);
+				out1c('\n');
 			}
 		}
 	}
@@ -749,7 +751,6 @@ void
 mklocal(char *name)
 {
 	struct localvar *lvp;
-	struct var **vpp;
 	struct var *vp;
 
 	INTOFF;
@@ -759,13 +760,14 @@ mklocal(char *name)
 		memcpy(lvp->text, optval, sizeof optval);
 		vp = NULL;
 	} else {
-		vp = find_var(name, &vpp, NULL);
+		vp = find_var(name, NULL, NULL);
 		if (vp == NULL) {
 			if (strchr(name, '='))
 				setvareq(savestr(name), VSTRFIXED | VNOLOCAL);
 			else
 				setvar(name, NULL, VSTRFIXED | VNOLOCAL);
-			vp = *vpp;	/* the new variable */
+			/* the new variable */
+			vp = find_var(name, NULL, NULL);
 			lvp->text = NULL;
 			lvp->flags = VUNSET;
 		} else {
@@ -808,12 +810,13 @@ poplocalvars(void)
 		} else {
 			islocalevar = (vp->flags | lvp->flags) & VEXPORT &&
 			    localevar(lvp->text);
+			/* Like setvareq(), call func before the change. */
+			if (vp->func)
+				(*vp->func)(lvp->text + vp->name_len + 1);
 			if ((vp->flags & VTEXTFIXED) == 0)
 				ckfree(vp->text);
 			vp->flags = lvp->flags;
 			vp->text = lvp->text;
-			if (vp->func)
-				(*vp->func)(vp->text + vp->name_len + 1);
 			if (islocalevar) {
 				change_env(vp->text, vp->flags & VEXPORT &&
 				    (vp->flags & VUNSET) == 0);
@@ -882,10 +885,9 @@ unsetcmd(int argc __unused, char **argv __unused)
 int
 unsetvar(const char *s)
 {
-	struct var **vpp;
 	struct var *vp;
 
-	vp = find_var(s, &vpp, NULL);
+	vp = find_var(s, NULL, NULL);
 	if (vp == NULL)
 		return (0);
 	if (vp->flags & VREADONLY)
@@ -902,7 +904,7 @@ unsetvar(const char *s)
 	if ((vp->flags & VSTRFIXED) == 0) {
 		if ((vp->flags & VTEXTFIXED) == 0)
 			ckfree(vp->text);
-		*vpp = vp->next;
+		delvar(vp);
 		ckfree(vp);
 	}
 	return (0);
@@ -931,37 +933,97 @@ varequal(const char *p, const char *q)
 /*
  * Search for a variable.
  * 'name' may be terminated by '=' or a NUL.
- * vppp is set to the pointer to vp, or the list head if vp isn't found
+ * hashp is set to the hash value of 'name'
  * lenp is set to the number of characters in 'name'
  */
 
 static struct var *
-find_var(const char *name, struct var ***vppp, int *lenp)
+find_var(const char *name, unsigned int *hashp, int *lenp)
 {
-	unsigned int hashval;
+	unsigned int hashval, i;
 	int len;
-	struct var *vp, **vpp;
+	struct var *vp;
 	const char *p = name;
 
-	hashval = 0;
+	hashval = 2166136261U;
 	while (*p && *p != '=')
-		hashval = 2 * hashval + (unsigned char)*p++;
+		hashval = (hashval ^ (unsigned char)*p++) * 16777619U;
 	len = p - name;
 
 	if (lenp)
 		*lenp = len;
-	vpp = &vartab[hashval % VTABSIZE];
-	if (vppp)
-		*vppp = vpp;
+	if (hashp)
+		*hashp = hashval;
 
-	for (vp = *vpp ; vp ; vpp = &vp->next, vp = *vpp) {
-		if (vp->name_len != len)
+	for (i = hashval & vtabmask; (vp = vartab[i]) != NULL;
+	    i = (i + 1) & vtabmask) {
+		if (vp->hash != hashval || vp->name_len != len)
 			continue;
 		if (memcmp(vp->text, name, len) != 0)
 			continue;
-		if (vppp)
-			*vppp = vpp;
 		return vp;
 	}
 	return NULL;
 }
+
+/*
+ * Enter a variable which is not in the table yet, doubling the table
+ * first if it would become more than half full.  Called with interrupts
+ * off or during initialization.
+ */
+
+static void
+addvar(struct var *vp, unsigned int hashval)
+{
+	struct var **oldtab;
+	unsigned int oldmask, i, j;
+
+	if (2 * (vtabcount + 1) > vtabmask + 1) {
+		oldtab = vartab;
+		oldmask = vtabmask;
+		vtabmask = oldmask * 2 + 1;
+		vartab = ckmalloc((vtabmask + 1) * sizeof(*vartab));
+		memset(vartab, 0, (vtabmask + 1) * sizeof(*vartab));
+		for (j = 0; j <= oldmask; j++) {
+			if (oldtab[j] == NULL)
+				continue;
+			for (i = oldtab[j]->hash & vtabmask; vartab[i] != NULL;
+			    i = (i + 1) & vtabmask)
+				;
+			vartab[i] = oldtab[j];
+		}
+		if (oldtab != vartab0)
+			ckfree(oldtab);
+	}
+	vp->hash = hashval;
+	for (i = hashval & vtabmask; vartab[i] != NULL; i = (i + 1) & vtabmask)
+		;
+	vartab[i] = vp;
+	vtabcount++;
+}
+
+/*
+ * Remove a variable from the table.  Entries further along the probe
+ * sequence are moved back so that no tombstones are needed.
+ */
+
+static void
+delvar(struct var *vp)
+{
+	unsigned int i, j, k;
+
+	for (i = vp->hash & vtabmask; vartab[i] != vp; i = (i + 1) & vtabmask)
+		;
+	vtabcount--;
+	for (j = i;;) {
+		vartab[i] = NULL;
+		do {
+			j = (j + 1) & vtabmask;
+			if ((vp = vartab[j]) == NULL)
+				return;
+			k = vp->hash & vtabmask;
+		} while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+		vartab[i] = vp;
+		i = j;
+	}
+}
@@ -50,7 +50,7 @@
 
 
 struct var {
-	struct var *next;		/* next entry in hash list */
+	unsigned int hash;		/* hash value of the name */
 	int flags;			/* flags are defined above */
 	int name_len;			/* length of name */
 	char *text;			/* name=value */
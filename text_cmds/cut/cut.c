@@ -46,6 +46,7 @@ static const char sccsid[] = "@(#)cut.c	8.3 (Berkeley) 5/4/95";
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <langinfo.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdio.h>
@@ -71,10 +72,30 @@ int	b_cut(FILE *, const char *);
 int	b_n_cut(FILE *, const char *);
 int	c_cut(FILE *, const char *);
 int	f_cut(FILE *, const char *);
+int	fast_f_cut(FILE *, const char *);
 void	get_list(char *);
 void	needpos(size_t);
+static	int blines(FILE *, const char *,
+	    int (*)(const char *, size_t, int, const char *));
+static	int b_line(const char *, size_t, int, const char *);
+static	int f_line(const char *, size_t, int, const char *);
+static	void oput(const char *, size_t);
+static	void oflush(void);
 static 	void usage(void);
 
+/*
+ * Buffers for the block-oriented byte and field paths: input is read
+ * straight from the descriptor in large chunks and split on newlines
+ * with memchr(), and the selected pieces of each line are gathered in
+ * an output buffer that is handed to stdio in one piece.
+ */
+#define	BLKSIZE		(64 * 1024)
+static char	*rbuf;
+static size_t	 rbufsize;
+static char	 obuf[BLKSIZE];
+static size_t	 olen;
+static int	 utf8;		/* -f input must be checked for EILSEQ */
+
 int
 main(int argc, char *argv[])
 {
@@ -132,7 +153,9 @@ main(int argc, char *argv[])
 		usage();
 
 	if (fflag)
-		fcn = f_cut;
+		fcn = strlen(dcharmb) == 1 && (MB_CUR_MAX == 1 ||
+		    (utf8 = strcmp(nl_langinfo(CODESET), "UTF-8") == 0)) ?
+		    fast_f_cut : f_cut;
 	else if (cflag)
 		fcn = MB_CUR_MAX > 1 ? c_cut : b_cut;
 	else if (bflag)
@@ -239,31 +262,36 @@ needpos(size_t n)
 }
 
 int
-b_cut(FILE *fp, const char *fname /* __unused */)
+b_cut(FILE *fp, const char *fname)
 {
-	int ch, col;
-	char *pos;
 
-	ch = 0;
-	for (;;) {
-		pos = positions + 1;
-		for (col = maxval; col; --col) {
-			if ((ch = getc(fp)) == EOF)
-				return (0);
-			if (ch == '\n')
-				break;
-			if (*pos++)
-				(void)putchar(ch);
-		}
-		if (ch != '\n') {
-			if (autostop)
-				while ((ch = getc(fp)) != EOF && ch != '\n')
-					(void)putchar(ch);
-			else
-				while ((ch = getc(fp)) != EOF && ch != '\n');
+	return (blines(fp, fname, b_line));
+}
+
+static int
+b_line(const char *p, size_t len, int nl, const char *fname __unused)
+{
+	size_t col, end;
+
+	/*
+	 * Emit runs of selected positions with one copy each.  A final
+	 * line without a newline only gets one added if it reached the
+	 * last listed position, as the character-at-a-time version did.
+	 */
+	for (col = 1; col <= maxval && col <= len; col = end) {
+		if (!positions[col]) {
+			end = col + 1;
+			continue;
 		}
-		(void)putchar('\n');
+		for (end = col + 1; end <= maxval && end <= len &&
+		    positions[end]; end++)
+			;
+		oput(p + col - 1, end - col);
 	}
+	if (autostop && len > maxval)
+		oput(p + maxval, len - maxval);
+	if (nl || len >= maxval)
+		oput("\n", 1);
 	return (0);
 }
 
@@ -465,6 +493,148 @@ f_cut(FILE *fp, const char *fname)
 	return (0);
 }
 
+int
+fast_f_cut(FILE *fp, const char *fname)
+{
+
+	return (blines(fp, fname, f_line));
+}
+
+static int
+f_line(const char *lbuf, size_t len, int nl, const char *fname)
+{
+	const char *p, *q, *ep;
+	size_t field;
+	int output;
+	mbstate_t mbs;
+	size_t clen;
+
+	ep = lbuf + len;
+	if (utf8) {
+		/* Only lines with non-ASCII bytes need decoding. */
+		for (p = lbuf; p < ep && (*p & 0x80) == 0; p++)
+			;
+		memset(&mbs, 0, sizeof(mbs));
+		for (; p < ep; p += clen) {
+			clen = mbrlen(p, ep - p, &mbs);
+			if (clen == (size_t)-1 || clen == (size_t)-2) {
+				errno = EILSEQ;
+				warn("%s", fname);
+				return (1);
+			}
+			if (clen == 0)
+				clen = 1;
+		}
+	}
+
+	if ((q = memchr(lbuf, dcharmb[0], len)) == NULL) {
+		if (!sflag) {
+			oput(lbuf, len);
+			if (nl)
+				oput("\n", 1);
+		}
+		return (0);
+	}
+
+	/*
+	 * Walk the fields up to the highest one requested; the rest of the
+	 * line is only looked at again for an open-ended range.
+	 */
+	output = 0;
+	for (field = 1, p = lbuf;; p = q + 1) {
+		if (field != 1)
+			q = memchr(p, dcharmb[0], ep - p);
+		if (q == NULL)
+			q = ep;
+		if (positions[field]) {
+			if (output++)
+				oput(dcharmb, 1);
+			oput(p, q - p);
+		}
+		if (q == ep || field++ == maxval)
+			break;
+	}
+	if (q != ep && autostop) {
+		if (output)
+			oput(dcharmb, 1);
+		oput(q + 1, ep - q - 1);
+	}
+	oput("\n", 1);
+	return (0);
+}
+
+/*
+ * Feed each line of fp, without its newline, to fn.  The last argument
+ * tells whether the line was terminated.  Returns the first nonzero
+ * value fn returned, which also ends processing of the file.
+ */
+static int
+blines(FILE *fp, const char *fname,
+    int (*fn)(const char *, size_t, int, const char *))
+{
+	char *p, *q, *ep;
+	size_t have;
+	ssize_t nr;
+	int fd, rval;
+
+	if (rbuf == NULL) {
+		rbufsize = BLKSIZE;
+		if ((rbuf = malloc(rbufsize)) == NULL)
+			err(1, "malloc");
+	}
+	fd = fileno(fp);
+	have = 0;
+	rval = 0;
+	for (;;) {
+		if (have == rbufsize) {
+			/* A line longer than the buffer. */
+			rbufsize *= 2;
+			if ((rbuf = realloc(rbuf, rbufsize)) == NULL)
+				err(1, "realloc");
+		}
+		if ((nr = read(fd, rbuf + have, rbufsize - have)) < 0)
+			errx(EX_IOERR, "Error reading %s", fname);
+		if (nr == 0)
+			break;
+		ep = rbuf + have + nr;
+		for (p = rbuf; (q = memchr(p, '\n', ep - p)) != NULL;
+		    p = q + 1)
+			if ((rval = fn(p, q - p, 1, fname)) != 0)
+				goto out;
+		have = ep - p;
+		memmove(rbuf, p, have);
+	}
+	if (have > 0)
+		rval = fn(rbuf, have, 0, fname);
+out:
+	oflush();
+	return (rval);
+}
+
+static void
+oput(const char *p, size_t len)
+{
+
+	if (len > sizeof(obuf) - olen) {
+		oflush();
+		if (len >= sizeof(obuf)) {
+			(void)fwrite(p, 1, len, stdout);
+			return;
+		}
+	}
+	memcpy(obuf + olen, p, len);
+	olen += len;
+}
+
+static void
+oflush(void)
+{
+
+	if (olen > 0)
+		(void)fwrite(obuf, 1, olen, stdout);
+	olen = 0;
+}
+
 static void
 usage(void)
 {
@@ -51,6 +51,7 @@ static char sccsid[] = "@(#)join.c	8.6 (Berkeley) 5/4/95";
 
 #include <sys/param.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <err.h>
 #include <errno.h>
@@ -78,6 +79,7 @@ static char sccsid[] = "@(#)join.c	8.6 (Berkeley) 5/4/95";
 typedef struct {
 	char *line;		/* line */
 	u_long linealloc;	/* line allocated count */
+	u_long linelen;		/* line length */
 	char **fields;		/* line field(s) */
 	u_long fieldcnt;	/* line field(s) count */
 	u_long fieldalloc;	/* line field(s) allocated count */
@@ -112,9 +114,46 @@ int spans = 1;			/* span multiple delimiters (-t) */
 char *empty;			/* empty field replacement string (-e) */
 static wchar_t default_tabchar[] = L" \t";
 wchar_t *tabchar = default_tabchar;/* delimiter characters (-t) */
+char bytetab[3];		/* tabchar as bytes, if it can be used as such */
+int bytecoll;			/* the collating sequence is byte order */
+int hflag;			/* hash join (-H) */
 
+/*
+ * For -H the smaller file is read into a hash table keyed on its join
+ * field, and the other one is streamed past it.  Lines and field
+ * arrays are copied into an arena; entries sharing a bucket are chained
+ * in input order so matches come out in the order they were read.
+ */
+typedef struct {
+	LINE line;		/* line, pointing into the arena */
+	u_long hash;		/* hash of the join field */
+	u_long next;		/* next entry in the bucket, or HNIL */
+	int paired;		/* seen in the other file */
+} HENT;
+
+#define	HNIL	((u_long)-1)
+#define	ARENASZ	(1024 * 1024)
+
+typedef struct arena {
+	struct arena *next;
+	size_t used, size;
+	char mem[];
+} ARENA;
+
+ARENA *arena;
+HENT *hents;			/* entries, in input order */
+u_long hentcnt, hentalloc;
+u_long *hheads, *htails;	/* bucket chains */
+u_long hsize;			/* bucket count, a power of 2 */
+
+void *aalloc(size_t);
 int  cmp(LINE *, u_long, LINE *, u_long);
 void fieldarg(char *);
+void hadd(LINE *, u_long);
+void hgrow(void);
+void hjoin(INPUT *, INPUT *);
+u_long hkey(LINE *, u_long);
+int  readline(INPUT *, LINE *);
 void joinlines(INPUT *, INPUT *);
 int  mbscoll(const char *, const char *);
 char *mbssep(char **, const wchar_t *);
@@ -131,7 +170,7 @@ main(int argc, char *argv[])
 {
 	INPUT *F1, *F2;
 	int aflag, ch, cval, vflag;
-	char *end;
+	char *cp, *end;
 
 	setlocale(LC_ALL, "");
 
@@ -141,7 +180,7 @@ main(int argc, char *argv[])
 	aflag = vflag = 0;
 	if (!COMPAT_MODE("bin/join", "Unix2003"))
 		obsolete(argv);
-	while ((ch = getopt(argc, argv, "\01a:e:j:1:2:o:t:v:")) != -1) {
+	while ((ch = getopt(argc, argv, "\01a:e:Hj:1:2:o:t:v:")) != -1) {
 		switch (ch) {
 		case '\01':		/* See comment in obsolete(). */
 			aflag = 1;
@@ -180,6 +219,9 @@ main(int argc, char *argv[])
 		case 'e':
 			empty = optarg;
 			break;
+		case 'H':
+			hflag = 1;
+			break;
 		case 'j':
 			if ((F1->joinf = F2->joinf =
 			    strtol(optarg, &end, 10)) < 1)
@@ -243,6 +285,25 @@ main(int argc, char *argv[])
 	if (F1->fp == stdin && F2->fp == stdin)
 		errx(1, "only one input file may be stdin");
 
+	/*
+	 * In single-byte locales fields can be split with strsep(3) as
+	 * long as the delimiters are ASCII, and in the C locale they can
+	 * be compared with strcmp(3).
+	 */
+	if (MB_CUR_MAX == 1 && wcslen(tabchar) < sizeof(bytetab) &&
+	    tabchar[0] < 0x80 && (tabchar[1] == L'\0' || tabchar[1] < 0x80)) {
+		bytetab[0] = tabchar[0];
+		bytetab[1] = tabchar[0] != L'\0' ? tabchar[1] : '\0';
+	}
+	cp = setlocale(LC_COLLATE, NULL);
+	bytecoll = cp == NULL || strcmp(cp, "C") == 0 ||
+	    strcmp(cp, "POSIX") == 0;
+
+	if (hflag) {
+		hjoin(F1, F2);
+		exit(0);
+	}
+
 	slurp(F1);
 	slurp(F2);
 	while (F1->setcnt && F2->setcnt) {
@@ -287,9 +348,7 @@ void
 slurp(INPUT *F)
 {
 	LINE *lp, *lastlp, tmp;
-	size_t len;
 	int cnt;
-	char *bp, *fieldp;
 
 	/*
 	 * Read all of the lines from an input file that have the same
@@ -332,40 +391,8 @@ slurp(INPUT *F)
 			F->pushbool = 0;
 			continue;
 		}
-		if ((bp = fgetln(F->fp, &len)) == NULL) {
-			if (ferror(F->fp)) {
-				err(EX_IOERR, NULL);
-			}
+		if (!readline(F, lp))
 			return;
-		}
-		if (lp->linealloc <= len + 1) {
-			lp->linealloc += MAX(100, len + 1 - lp->linealloc);
-			if ((lp->line =
-			    realloc(lp->line, lp->linealloc)) == NULL)
-				err(1, NULL);
-		}
-		memmove(lp->line, bp, len);
-
-		/* Replace trailing newline, if it exists. */
-		if (bp[len - 1] == '\n')
-			lp->line[len - 1] = '\0';
-		else
-			lp->line[len] = '\0';
-		bp = lp->line;
-
-		/* Split the line into fields, allocate space as necessary. */
-		lp->fieldcnt = 0;
-		while ((fieldp = mbssep(&bp, tabchar)) != NULL) {
-			if (spans && *fieldp == '\0')
-				continue;
-			if (lp->fieldcnt == lp->fieldalloc) {
-				lp->fieldalloc += 50;
-				if ((lp->fields = realloc(lp->fields,
-				    lp->fieldalloc * sizeof(char *))) == NULL)
-					err(1, NULL);
-			}
-			lp->fields[lp->fieldcnt++] = fieldp;
-		}
 
 		/* See if the join field value has changed. */
 		if (lastlp != NULL && cmp(lp, F->joinf, lastlp, F->joinf)) {
@@ -376,6 +403,55 @@ slurp(INPUT *F)
 	}
 }
 
+/*
+ * Read the next line of a file into lp, reusing its buffers, and split
+ * it into fields.  Returns 0 at end of file.
+ */
+int
+readline(INPUT *F, LINE *lp)
+{
+	size_t len;
+	char *bp, *fieldp;
+
+	if ((bp = fgetln(F->fp, &len)) == NULL) {
+		if (ferror(F->fp)) {
+			err(EX_IOERR, NULL);
+		}
+		return (0);
+	}
+	if (lp->linealloc <= len + 1) {
+		lp->linealloc += MAX(100, len + 1 - lp->linealloc);
+		if ((lp->line =
+		    realloc(lp->line, lp->linealloc)) == NULL)
+			err(1, NULL);
+	}
+	memmove(lp->line, bp, len);
+
+	/* Replace trailing newline, if it exists. */
+	if (bp[len - 1] == '\n')
+		lp->line[--len] = '\0';
+	else
+		lp->line[len] = '\0';
+	lp->linelen = len;
+	bp = lp->line;
+
+	/* Split the line into fields, allocate space as necessary. */
+	lp->fieldcnt = 0;
+	while ((fieldp = *bytetab != '\0' ? strsep(&bp, bytetab) :
+	    mbssep(&bp, tabchar)) != NULL) {
+		if (spans && *fieldp == '\0')
+			continue;
+		if (lp->fieldcnt == lp->fieldalloc) {
+			lp->fieldalloc += 50;
+			if ((lp->fields = realloc(lp->fields,
+			    lp->fieldalloc * sizeof(char *))) == NULL)
+				err(1, NULL);
+		}
+		lp->fields[lp->fieldcnt++] = fieldp;
+	}
+	return (1);
+}
+
 char *
 mbssep(char **stringp, const wchar_t *delim)
 {
@@ -417,6 +493,8 @@ cmp(LINE *lp1, u_long fieldno1, LINE *lp2, u_long fieldno2)
 		return (lp2->fieldcnt <= fieldno2 ? 0 : 1);
 	if (lp2->fieldcnt <= fieldno2)
 		return (-1);
+	if (bytecoll)
+		return (strcmp(lp1->fields[fieldno1], lp2->fields[fieldno2]));
 	return (mbscoll(lp1->fields[fieldno1], lp2->fields[fieldno2]));
 }
 
@@ -426,6 +504,9 @@ mbscoll(const char *s1, const char *s2)
 	wchar_t *w1, *w2;
 	int ret;
 
+	/* Most comparisons are within a set of equal join fields. */
+	if (strcmp(s1, s2) == 0)
+		return (0);
 	if (MB_CUR_MAX == 1)
 		return (strcoll(s1, s2));
 	if ((w1 = towcs(s1)) == NULL || (w2 = towcs(s2)) == NULL)
@@ -450,6 +531,157 @@ towcs(const char *s)
 	return (wcs);
 }
 
+void *
+aalloc(size_t n)
+{
+	ARENA *a;
+	size_t size;
+
+	n = (n + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if (arena == NULL || arena->size - arena->used < n) {
+		size = MAX(ARENASZ, n);
+		if ((a = malloc(sizeof(ARENA) + size)) == NULL)
+			err(1, NULL);
+		a->next = arena;
+		a->used = 0;
+		a->size = size;
+		arena = a;
+	}
+	arena->used += n;
+	return (arena->mem + arena->used - n);
+}
+
+/*
+ * Hash the join field of a line.  Lines without one hash alike, as
+ * they compare equal to each other in cmp().
+ */
+u_long
+hkey(LINE *lp, u_long fieldno)
+{
+	const u_char *p;
+	u_long h;
+
+	if (lp->fieldcnt <= fieldno)
+		return (0);
+	h = 2166136261UL;
+	for (p = (const u_char *)lp->fields[fieldno]; *p != '\0'; p++)
+		h = (h ^ *p) * 16777619UL;
+	return (h != 0 ? h : 1);
+}
+
+void
+hgrow(void)
+{
+	u_long i, b;
+
+	hsize = hsize ? hsize * 2 : 1024;
+	if ((hheads = realloc(hheads, hsize * sizeof(u_long))) == NULL ||
+	    (htails = realloc(htails, hsize * sizeof(u_long))) == NULL)
+		err(1, NULL);
+	memset(hheads, 0xff, hsize * sizeof(u_long));
+	for (i = 0; i < hentcnt; i++) {
+		b = hents[i].hash & (hsize - 1);
+		hents[i].next = HNIL;
+		if (hheads[b] == HNIL)
+			hheads[b] = i;
+		else
+			hents[htails[b]].next = i;
+		htails[b] = i;
+	}
+}
+
+/*
+ * Copy a line into the arena and add it to the hash table.
+ */
+void
+hadd(LINE *lp, u_long fieldno)
+{
+	HENT *he;
+	u_long b, i;
+
+	if (hentcnt == hentalloc) {
+		hentalloc = hentalloc ? hentalloc * 2 : 1024;
+		if ((hents = realloc(hents, hentalloc * sizeof(HENT))) == NULL)
+			err(1, NULL);
+	}
+	if (hentcnt >= hsize)
+		hgrow();
+	he = &hents[hentcnt];
+	he->line.linelen = he->line.linealloc = lp->linelen + 1;
+	he->line.line = aalloc(lp->linelen + 1);
+	memcpy(he->line.line, lp->line, lp->linelen + 1);
+	he->line.fieldcnt = he->line.fieldalloc = lp->fieldcnt;
+	he->line.fields = aalloc(lp->fieldcnt * sizeof(char *));
+	for (i = 0; i < lp->fieldcnt; i++)
+		he->line.fields[i] =
+		    he->line.line + (lp->fields[i] - lp->line);
+	he->hash = hkey(lp, fieldno);
+	he->next = HNIL;
+	he->paired = 0;
+	b = he->hash & (hsize - 1);
+	if (hheads[b] == HNIL)
+		hheads[b] = hentcnt;
+	else
+		hents[htails[b]].next = hentcnt;
+	htails[b] = hentcnt++;
+}
+
+/*
+ * Hash join (-H): the inputs need not be sorted, and join fields are
+ * compared byte for byte.  Output follows the order of the streamed
+ * file; unpairable lines from the loaded file are written at the end.
+ */
+void
+hjoin(INPUT *F1, INPUT *F2)
+{
+	struct stat sb1, sb2;
+	INPUT *T, *S;
+	LINE line, *lp, *tlp;
+	HENT *he;
+	u_long h, i;
+	int paired;
+
+	/* Load the smaller file, and never the one that is not a file. */
+	T = F2;
+	if (fstat(fileno(F1->fp), &sb1) == 0 && S_ISREG(sb1.st_mode) &&
+	    (fstat(fileno(F2->fp), &sb2) != 0 || !S_ISREG(sb2.st_mode) ||
+	    sb1.st_size < sb2.st_size))
+		T = F1;
+	S = T == F1 ? F2 : F1;
+
+	memset(&line, 0, sizeof(line));
+	if (hsize == 0)
+		hgrow();
+	while (readline(T, &line))
+		hadd(&line, T->joinf);
+
+	lp = &line;
+	while (readline(S, lp)) {
+		h = hkey(lp, S->joinf);
+		paired = 0;
+		for (i = hheads[h & (hsize - 1)]; i != HNIL; i = he->next) {
+			he = &hents[i];
+			tlp = &he->line;
+			if (he->hash != h || (h != 0 &&
+			    strcmp(tlp->fields[T->joinf], lp->fields[S->joinf])))
+				continue;
+			paired = he->paired = 1;
+			if (!joinout)
+				continue;
+			if (S == F1)
+				outtwoline(F1, lp, F2, tlp);
+			else
+				outtwoline(F1, tlp, F2, lp);
+		}
+		if (!paired && S->unpair)
+			outoneline(S, lp);
+	}
+	if (T->unpair)
+		for (i = 0; i < hentcnt; i++)
+			if (!hents[i].paired)
+				outoneline(T, &hents[i].line);
+}
+
 void
 joinlines(INPUT *F1, INPUT *F2)
 {
@@ -684,7 +916,7 @@ void
 usage(void)
 {
 	(void)fprintf(stderr, "%s %s\n%s\n",
-	    "usage: join [-a fileno | -v fileno ] [-e string] [-1 field]",
+	    "usage: join [-a fileno | -v fileno ] [-e string] [-H] [-1 field]",
 	    "[-2 field]",
 		"            [-o list] [-t char] file1 file2");
 	exit(1);
@@ -56,6 +56,7 @@ static char sccsid[] = "@(#)look.c	8.2 (Berkeley) 5/4/95";
  * the manual page.
  */
 
+#include <sys/param.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -65,6 +66,7 @@ static char sccsid[] = "@(#)look.c	8.2 (Berkeley) 5/4/95";
 #include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -81,12 +83,44 @@ static char _path_words[] = _PATH_WORDS;
 #define	GREATER		1
 #define	LESS		(-1)
 
-int dflag, fflag;
+int dflag, fflag, iflag;
+
+/*
+ * In the C locale without -d or -f, lines are compared with the key as
+ * bytes.
+ */
+char	*bkey;
+size_t	 bkeylen;
+
+/*
+ * With -i, a sidecar index records the offset of every IDXSTRIDE'th
+ * line, so the binary search probes known line starts.  It is kept in
+ * file.lookidx, rebuilt when the file's size or mtime no longer match,
+ * and used from memory when it cannot be written.
+ */
+#define	IDXMAGIC	"LOOKIDX1"
+#define	IDXSUFFIX	".lookidx"
+#define	IDXSTRIDE	16
+
+struct idxhdr {
+	char		magic[8];
+	uint64_t	size;		/* size of the indexed file */
+	int64_t		mtime;		/* and its modification time */
+	uint64_t	stride;		/* lines between offsets */
+	uint64_t	count;		/* offsets that follow */
+};
+
+const uint64_t	*idxoff;	/* line offsets, or NULL */
+uint64_t	 idxcnt;
+char		*idxbase;	/* start of the indexed file */
 
 char    *binary_search(wchar_t *, char *, char *);
+int      bcompare(char *, char *);
 int      compare(wchar_t *, char *, char *);
+char    *index_search(wchar_t *, char *, char *);
+void    *loadindex(const char *, struct stat *, char *, char *, size_t *);
 char    *linear_search(wchar_t *, char *, char *);
-int      look(wchar_t *, char *, char *);
+int      look(wchar_t *, char *, char *, char **);
 wchar_t	*prepkey(const char *, wchar_t);
 void     print_from(wchar_t *, char *, char *);
 
@@ -96,25 +130,36 @@ int
 main(int argc, char *argv[])
 {
 	struct stat sb;
-	int ch, fd, match;
+	int ch, fd, i, match, nfiles;
 	wchar_t termchar;
-	char *back, *front;
-	char *file;
-	wchar_t *key;
+	char *back, *front, *start, *lp, *cp;
+	char *file, *keyfile;
+	wchar_t **keys;
+	char **bkeys;
+	size_t idxlen, len, nkeys, keysalloc;
+	void *idx;
+	FILE *kfp;
 
 	(void) setlocale(LC_CTYPE, "");
 
 	// file = _path_words;
 	file = NULL;
+	keyfile = NULL;
 	termchar = L'\0';
-	while ((ch = getopt(argc, argv, "dft:")) != -1)
+	while ((ch = getopt(argc, argv, "b:dfit:")) != -1)
 		switch(ch) {
+		case 'b':
+			keyfile = optarg;
+			break;
 		case 'd':
 			dflag = 1;
 			break;
 		case 'f':
 			fflag = 1;
 			break;
+		case 'i':
+			iflag = 1;
+			break;
 		case 't':
 			if (mbrtowc(&termchar, optarg, MB_LEN_MAX, NULL) !=
 			    strlen(optarg))
@@ -129,15 +174,70 @@ main(int argc, char *argv[])
 
 /* 4384130 */
 #ifdef __APPLE__
-	if (argc <= 0)
+	if (argc <= 0 && keyfile == NULL)
 #else
-	if (argc == 0)
+	if (argc == 0 && keyfile == NULL)
 #endif
 		usage();
-	if (argc == 1) 			/* But set -df by default. */
+	nfiles = keyfile == NULL ? argc - 1 : argc;
+	if (nfiles == 0) 			/* But set -df by default. */
 		dflag = fflag = 1;
-	key = prepkey(*argv++, termchar);
-	if (argc >= 2) {
+
+	/*
+	 * The search strings: the argument, or with -b, each line of
+	 * keyfile.
+	 */
+	nkeys = keysalloc = 0;
+	keys = NULL;
+	if (keyfile == NULL) {
+		nkeys = keysalloc = 1;
+		if ((keys = malloc(sizeof(*keys))) == NULL)
+			err(2, NULL);
+		keys[0] = prepkey(*argv++, termchar);
+	} else {
+		if (strcmp(keyfile, "-") == 0)
+			kfp = stdin;
+		else if ((kfp = fopen(keyfile, "r")) == NULL)
+			err(2, "%s", keyfile);
+		while ((lp = fgetln(kfp, &len)) != NULL) {
+			if (nkeys == keysalloc) {
+				keysalloc = keysalloc ? keysalloc * 2 : 64;
+				if ((keys = realloc(keys,
+				    keysalloc * sizeof(*keys))) == NULL)
+					err(2, NULL);
+			}
+			if (len > 0 && lp[len - 1] == '\n')
+				len--;
+			if ((cp = malloc(len + 1)) == NULL)
+				err(2, NULL);
+			memcpy(cp, lp, len);
+			cp[len] = '\0';
+			keys[nkeys++] = prepkey(cp, termchar);
+			free(cp);
+		}
+		if (ferror(kfp))
+			err(2, "%s", keyfile);
+		if (kfp != stdin)
+			fclose(kfp);
+	}
+
+	bkeys = NULL;
+	cp = setlocale(LC_CTYPE, NULL);
+	if (!dflag && !fflag && MB_CUR_MAX == 1 && cp != NULL &&
+	    (strcmp(cp, "C") == 0 || strcmp(cp, "POSIX") == 0)) {
+		if ((bkeys = calloc(nkeys, sizeof(*bkeys))) == NULL)
+			err(2, NULL);
+		for (i = 0; i < nkeys; i++) {
+			len = wcstombs(NULL, keys[i], 0);
+			if (len == (size_t)-1)
+				continue;
+			if ((bkeys[i] = malloc(len + 1)) == NULL)
+				err(2, NULL);
+			wcstombs(bkeys[i], keys[i], len + 1);
+		}
+	}
+
+	if (nfiles > 0) {
 		// file = *argv++;
 		file = malloc(LINE_MAX * sizeof(char)); 
 		sprintf(file, "%s", *argv);
@@ -162,9 +262,25 @@ main(int argc, char *argv[])
 		if ((front = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, (off_t)0)) == MAP_FAILED)
 			err(2, "%s", file);
 		back = front + sb.st_size;
-		match *= (look(key, front, back));
+		idx = iflag ? loadindex(file, &sb, front, back, &idxlen) : NULL;
+		/*
+		 * When the keys come in order, each search can start where
+		 * the previous one ended.
+		 */
+		start = front;
+		for (i = 0; i < nkeys; i++) {
+			if (i > 0 && wcscmp(keys[i - 1], keys[i]) > 0)
+				start = front;
+			bkey = bkeys != NULL ? bkeys[i] : NULL;
+			bkeylen = bkey != NULL ? strlen(bkey) : 0;
+			match *= (look(keys[i], start, back, &start));
+		}
+		if (idx != NULL)
+			munmap(idx, idxlen);
+		idxoff = NULL;
+		munmap(front, (size_t)sb.st_size);
 		close(fd);
-	} while (argc-- > 2 && (file = *argv++));
+	} while (nfiles-- > 1 && (file = *argv++));
 
 	exit(match);
 }
@@ -206,10 +322,14 @@ prepkey(const char *string, wchar_t termchar)
 }
 
 int
-look(wchar_t *string, char *front, char *back)
+look(wchar_t *string, char *front, char *back, char **startp)
 {
 
-	front = binary_search(string, front, back);
+	if (idxoff != NULL)
+		front = index_search(string, front, back);
+	else
+		front = binary_search(string, front, back);
+	*startp = front;
 	front = linear_search(string, front, back);
 
 	if (front)
@@ -282,6 +402,152 @@ binary_search(wchar_t *string, char *front, char *back)
 	return (front);
 }
 
+/*
+ * Binary search through the sidecar index.  Returns the start of the
+ * last indexed line at or after "front" that sorts before "string", or
+ * "front" if there is none; the first match is then at most IDXSTRIDE
+ * lines further on.
+ */
+char *
+index_search(wchar_t *string, char *front, char *back)
+{
+	char *base = idxbase;
+	uint64_t lo, hi, mid;
+
+	/* Skip the offsets that lie before front. */
+	lo = 0;
+	hi = idxcnt;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (idxoff[mid] < (uint64_t)(front - base))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Find the first line that is not less than string. */
+	hi = idxcnt;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (base + idxoff[mid] >= back ||
+		    compare(string, base + idxoff[mid], back) != GREATER)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (lo == 0 || base + idxoff[lo - 1] < front)
+		return (front);
+	return (base + idxoff[lo - 1]);
+}
+
+/*
+ * Map the sidecar index of a file, building it if it is missing or out
+ * of date.  Returns the memory to be unmapped, and sets idxoff and
+ * idxcnt, or NULL if there is no index and none can be saved.
+ */
+void *
+loadindex(const char *file, struct stat *sbp, char *front, char *back,
+    size_t *lenp)
+{
+	struct idxhdr hdr, *hp;
+	struct stat isb;
+	char *path, *tmp, *p;
+	uint64_t *off;
+	size_t alloc, cnt, len, n;
+	void *m;
+	int ifd;
+
+	idxbase = front;
+	if (asprintf(&path, "%s%s", file, IDXSUFFIX) < 0)
+		err(2, NULL);
+	if ((ifd = open(path, O_RDONLY, 0)) >= 0) {
+		if (fstat(ifd, &isb) == 0 &&
+		    (size_t)isb.st_size >= sizeof(hdr) &&
+		    (m = mmap(NULL, (size_t)isb.st_size, PROT_READ,
+		    MAP_SHARED, ifd, (off_t)0)) != MAP_FAILED) {
+			hp = m;
+			if (memcmp(hp->magic, IDXMAGIC, sizeof(hp->magic)) == 0 &&
+			    hp->size == (uint64_t)sbp->st_size &&
+			    hp->mtime == (int64_t)sbp->st_mtime &&
+			    hp->stride == IDXSTRIDE &&
+			    hp->count == (isb.st_size - sizeof(hdr)) /
+			    sizeof(uint64_t)) {
+				close(ifd);
+				free(path);
+				idxoff = (const uint64_t *)(hp + 1);
+				idxcnt = hp->count;
+				*lenp = (size_t)isb.st_size;
+				return (m);
+			}
+			munmap(m, (size_t)isb.st_size);
+		}
+		close(ifd);
+	}
+
+	/*
+	 * Building the index reads the whole file, which only pays off
+	 * if it can be saved for later runs; otherwise fall back to the
+	 * plain binary search.
+	 */
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0)
+		err(2, NULL);
+	if ((ifd = mkstemp(tmp)) < 0) {
+		free(tmp);
+		free(path);
+		return (NULL);
+	}
+
+	/* Collect the start of every IDXSTRIDE'th line. */
+	alloc = 1024;
+	cnt = 0;
+	if ((off = malloc(alloc * sizeof(*off))) == NULL)
+		err(2, NULL);
+	for (p = front, n = 0; p < back; n++) {
+		if (n % IDXSTRIDE == 0) {
+			if (cnt == alloc) {
+				alloc *= 2;
+				if ((off = realloc(off,
+				    alloc * sizeof(*off))) == NULL)
+					err(2, NULL);
+			}
+			off[cnt++] = p - front;
+		}
+		if ((p = memchr(p, '\n', back - p)) == NULL)
+			break;
+		p++;
+	}
+
+	/* Save it for next time, but don't insist. */
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, IDXMAGIC, sizeof(hdr.magic));
+	hdr.size = sbp->st_size;
+	hdr.mtime = sbp->st_mtime;
+	hdr.stride = IDXSTRIDE;
+	hdr.count = cnt;
+	len = cnt * sizeof(*off);
+	if (write(ifd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    write(ifd, off, len) != (ssize_t)len ||
+	    fchmod(ifd, sbp->st_mode & 0666) != 0) {
+		close(ifd);
+		unlink(tmp);
+	} else if (close(ifd) != 0 || rename(tmp, path) != 0)
+		unlink(tmp);
+	free(tmp);
+	free(path);
+
+	/* Hand back an anonymous mapping so the caller can munmap it. */
+	*lenp = sizeof(hdr) + len;
+	if ((m = mmap(NULL, *lenp, PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_PRIVATE, -1, (off_t)0)) == MAP_FAILED)
+		err(2, NULL);
+	memcpy(m, &hdr, sizeof(hdr));
+	memcpy((struct idxhdr *)m + 1, off, len);
+	free(off);
+	idxoff = (const uint64_t *)((struct idxhdr *)m + 1);
+	idxcnt = cnt;
+	return (m);
+}
+
 /*
  * Find the first line that starts with string, linearly searching from front
  * to back.
@@ -316,10 +582,15 @@ linear_search(wchar_t *string, char *front, char *back)
 void
 print_from(wchar_t *string, char *front, char *back)
 {
+	char *nl;
+	size_t len;
+
 	for (; front < back && compare(string, front, back) == EQUAL; ++front) {
-		for (; front < back && *front != '\n'; ++front)
-			if (putchar(*front) == EOF)
-				err(2, "stdout");
+		nl = memchr(front, '\n', back - front);
+		len = (nl != NULL ? nl : back) - front;
+		if (fwrite(front, 1, len, stdout) != len)
+			err(2, "stdout");
+		front += len;
 		if (putchar('\n') == EOF)
 			err(2, "stdout");
 	}
@@ -344,6 +615,8 @@ compare(wchar_t *s1, char *s2, char *back)
 	wchar_t ch1, ch2;
 	size_t len2;
 
+	if (bkey != NULL)
+		return (bcompare(s2, back));
 	for (; *s1 && s2 < back && *s2 != '\n'; ++s1, s2 += len2) {
 		ch1 = *s1;
 		len2 = mbrtowc(&ch2, s2, back - s2, NULL);
@@ -364,9 +637,29 @@ compare(wchar_t *s1, char *s2, char *back)
 	return (*s1 ? GREATER : EQUAL);
 }
 
+/*
+ * compare() for the byte key: the line is compared up to its newline
+ * or the length of the key, whichever comes first.
+ */
+int
+bcompare(char *s2, char *back)
+{
+	char *nl;
+	size_t len;
+	int r;
+
+	len = MIN(bkeylen, (size_t)(back - s2));
+	if ((nl = memchr(s2, '\n', len)) != NULL)
+		len = nl - s2;
+	if ((r = memcmp(bkey, s2, len)) != 0)
+		return (r < 0 ? LESS : GREATER);
+	return (len < bkeylen ? GREATER : EQUAL);
+}
+
 static void
 usage(void)
 {
-	(void)fprintf(stderr, "usage: look [-df] [-t char] string [file ...]\n");
+	(void)fprintf(stderr, "usage: look [-dfi] [-t char] string [file ...]\n"
+	    "       look -b keyfile [-dfi] [-t char] [file ...]\n");
 	exit(2);
 }
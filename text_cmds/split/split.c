@@ -48,6 +48,8 @@ static const char sccsid[] = "@(#)split.c	8.2 (Berkeley) 4/16/94";
 #endif
 
 #include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <ctype.h>
 #include <err.h>
@@ -56,6 +58,7 @@ static const char sccsid[] = "@(#)split.c	8.2 (Berkeley) 4/16/94";
 #include <inttypes.h>
 #include <limits.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -65,6 +68,7 @@ static const char sccsid[] = "@(#)split.c	8.2 (Berkeley) 4/16/94";
 #include <sysexits.h>
 
 #define DEFLINE	1000			/* Default num lines per file. */
+#define MAXTHREADS	8		/* Writers for mapped input. */
 
 off_t	 bytecnt;			/* Byte count to split on. */
 long	 numlines;			/* Line count to split on. */
@@ -75,10 +79,34 @@ char	 fname[MAXPATHLEN];		/* File name prefix. */
 regex_t	 rgx;
 int	 pflag;
 long	 sufflen = 2;			/* File name suffix length. */
+long	 chunks;			/* Number of files to split into. */
+int	 lchunks;			/* Keep lines whole in chunks. */
+char	*fpnt;				/* Where the suffix goes in fname. */
+long	 fnum;				/* Number of the next output file. */
 
+/*
+ * Regular input split by lines or into a number of chunks is mapped,
+ * the chunk boundaries are worked out first, and the chunks are then
+ * written out by several threads, each to its own file.
+ */
+struct chunkq {
+	pthread_mutex_t	 lock;
+	const char	*base;		/* the mapped input */
+	off_t		*bounds;	/* chunk i is [bounds[i], bounds[i+1]) */
+	char		**names;	/* output file names */
+	long		 n;		/* number of chunks */
+	long		 next;		/* next chunk to write */
+};
+
+off_t copyout(off_t);
+void initname(void);
+int nextname(void);
 void newfile(void);
 void split1(void);
 void split2(void);
+void splitmap(void);
+void writechunks(const char *, off_t *, long);
+void *writer(void *);
 static void usage(void);
 
 int
@@ -91,7 +119,7 @@ main(int argc, char **argv)
 
 	setlocale(LC_ALL, "");
 
-	while ((ch = getopt(argc, argv, "0123456789a:b:l:p:")) != -1)
+	while ((ch = getopt(argc, argv, "0123456789a:b:l:n:p:")) != -1)
 		switch (ch) {
 		case '0': case '1': case '2': case '3': case '4':
 		case '5': case '6': case '7': case '8': case '9':
@@ -133,6 +161,18 @@ main(int argc, char **argv)
 				errx(EX_USAGE, "%s: offset too large", optarg);
 			bytecnt = (off_t)(bytecnti * scale);
 			break;
+		case 'n':		/* Number of chunks. */
+			p = optarg;
+			if (strncmp(p, "l/", 2) == 0) {
+				lchunks = 1;
+				p += 2;
+			}
+			errno = 0;
+			if ((chunks = strtol(p, &ep, 10)) <= 0 || *ep ||
+			    errno != 0)
+				errx(EX_USAGE,
+				    "%s: illegal number of chunks", optarg);
+			break;
 		case 'p' :      /* pattern matching. */
 			if (regcomp(&rgx, optarg, REG_EXTENDED|REG_NOSUB) != 0)
 				errx(EX_USAGE, "%s: illegal regexp", optarg);
@@ -168,6 +208,8 @@ main(int argc, char **argv)
 		errx(EX_USAGE, "suffix is too long");
 	if (pflag && (numlines != 0 || bytecnt != 0))
 		usage();
+	if (chunks != 0 && (pflag || numlines != 0 || bytecnt != 0))
+		usage();
 
 	if (numlines == 0)
 		numlines = DEFLINE;
@@ -177,6 +219,12 @@ main(int argc, char **argv)
 	if (ifd == -1)				/* Stdin by default. */
 		ifd = 0;
 
+	initname();
+	if (chunks != 0 || (!pflag && !bytecnt)) {
+		splitmap();
+		if (chunks != 0)
+			errx(EX_USAGE, "-n requires a regular file");
+	}
 	if (bytecnt) {
 		split1();
 		exit (0);
@@ -194,10 +242,28 @@ main(int argc, char **argv)
 void
 split1(void)
 {
+	struct stat sb;
 	off_t bcnt;
 	char *C;
 	ssize_t dist, len;
 
+	/*
+	 * Regular files are copied a chunk at a time, which the kernel
+	 * can do without passing the data through this process.
+	 */
+	if (fstat(ifd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+		do {
+			if ((bcnt = lseek(ifd, (off_t)0, SEEK_CUR)) == -1 ||
+			    fstat(ifd, &sb) != 0)
+				break;
+			if (bcnt >= sb.st_size)
+				exit(0);
+			newfile();
+		} while (copyout(bytecnt) == bytecnt);
+		if (bcnt != -1)
+			exit(0);
+	}
+
 	for (bcnt = 0;;)
 		switch ((len = read(ifd, bfr, MAXBSIZE))) {
 		case 0:
@@ -235,6 +301,191 @@ split1(void)
 		}
 }
 
+/*
+ * copyout --
+ *	Copy up to len bytes from the input to the current file.  Returns
+ *	the number of bytes copied, which is less than len only at end of
+ *	file.
+ */
+off_t
+copyout(off_t len)
+{
+	off_t done;
+	ssize_t n;
+
+	done = 0;
+	n = 0;
+#ifdef __linux__
+	while (done < len && (n = copy_file_range(ifd, NULL, ofd, NULL,
+	    (size_t)MIN(len - done, 1 << 30), 0)) > 0)
+		done += n;
+	if (done == len || n == 0)
+		return (done);
+	if (errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+	    errno != EOPNOTSUPP && errno != EBADF)
+		err(EX_IOERR, "copy_file_range");
+#endif
+	while (done < len &&
+	    (n = read(ifd, bfr, (size_t)MIN(len - done, MAXBSIZE))) > 0) {
+		if (write(ofd, bfr, n) != n)
+			err(EX_IOERR, "write");
+		done += n;
+	}
+	if (n == -1)
+		err(EX_IOERR, "read");
+	return (done);
+}
+
+/*
+ * splitmap --
+ *	Split a regular file by lines or into chunks, if the input is one.
+ *	Returns only if it is not.
+ */
+void
+splitmap(void)
+{
+	struct stat sb;
+	const char *base, *p, *end, *last;
+	off_t *bounds, start, size;
+	long lcnt, n, nalloc;
+
+	if (fstat(ifd, &sb) != 0 || !S_ISREG(sb.st_mode) ||
+	    (start = lseek(ifd, (off_t)0, SEEK_CUR)) == -1)
+		return;
+	if ((size = sb.st_size) <= start) {
+		/* split by lines of nothing makes no files */
+		if (chunks == 0)
+			exit(0);
+		base = NULL;
+	} else if ((base = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED,
+	    ifd, (off_t)0)) == MAP_FAILED) {
+		if (chunks != 0)
+			err(EX_IOERR, "mmap");
+		return;
+	}
+
+	nalloc = chunks != 0 ? chunks + 1 : 64;
+	if ((bounds = malloc(nalloc * sizeof(*bounds))) == NULL)
+		err(EX_OSERR, NULL);
+	n = 0;
+	bounds[0] = start;
+	if (chunks != 0) {
+		/*
+		 * Chunk i nominally ends at (i + 1) * size / chunks; with l/,
+		 * it is extended to the end of the line it ends in.
+		 */
+		size -= start;
+		for (n = 0; n < chunks; n++) {
+			bounds[n + 1] = start + (n + 1) * (size / chunks);
+			if (n == chunks - 1)
+				bounds[n + 1] = start + size;
+			if (bounds[n + 1] < bounds[n])
+				bounds[n + 1] = bounds[n];
+			if (lchunks && bounds[n + 1] > bounds[n] &&
+			    bounds[n + 1] < start + size &&
+			    base[bounds[n + 1] - 1] != '\n') {
+				p = memchr(base + bounds[n + 1], '\n',
+				    start + size - bounds[n + 1]);
+				bounds[n + 1] = p != NULL ?
+				    p - base + 1 : start + size;
+			}
+		}
+	} else {
+		/*
+		 * A new file starts after every numlines newlines, as long as
+		 * another complete line follows.
+		 */
+		end = base + size;
+		last = NULL;
+		lcnt = 0;
+		for (p = base + start;
+		    (p = memchr(p, '\n', end - p)) != NULL; p++) {
+			last = p;
+			if (++lcnt < numlines)
+				continue;
+			lcnt = 0;
+			if (n + 2 >= nalloc) {
+				nalloc *= 2;
+				if ((bounds = realloc(bounds,
+				    nalloc * sizeof(*bounds))) == NULL)
+					err(EX_OSERR, NULL);
+			}
+			bounds[++n] = p - base + 1;
+		}
+		if (n > 0 && (last == NULL || bounds[n] > last - base))
+			n--;
+		bounds[++n] = size;
+	}
+	writechunks(base, bounds, n);
+	exit(0);
+}
+
+/*
+ * writechunks --
+ *	Write each of n chunks of base to its own file.
+ */
+void
+writechunks(const char *base, off_t *bounds, long n)
+{
+	struct chunkq q;
+	pthread_t tid[MAXTHREADS];
+	long i, nthreads;
+
+	if ((q.names = malloc(n * sizeof(*q.names))) == NULL)
+		err(EX_OSERR, NULL);
+	for (i = 0; i < n && nextname(); i++)
+		if ((q.names[i] = strdup(fname)) == NULL)
+			err(EX_OSERR, NULL);
+	pthread_mutex_init(&q.lock, NULL);
+	q.base = base;
+	q.bounds = bounds;
+	q.n = i;
+	q.next = 0;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = MAX(1, MIN(nthreads, MIN(q.n, MAXTHREADS)));
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&tid[i], NULL, writer, &q) != 0)
+			break;
+	if (i == 0)
+		writer(&q);
+	nthreads = i;
+	for (i = 0; i < nthreads; i++)
+		pthread_join(tid[i], NULL);
+	if (q.n < n)
+		errx(EX_DATAERR, "too many files");
+}
+
+void *
+writer(void *arg)
+{
+	struct chunkq *q = arg;
+	const char *p;
+	off_t len;
+	ssize_t n;
+	long i;
+	int fd;
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		i = q->next++;
+		pthread_mutex_unlock(&q->lock);
+		if (i >= q->n)
+			break;
+		if ((fd = open(q->names[i], O_WRONLY | O_CREAT | O_TRUNC,
+		    DEFFILEMODE)) < 0)
+			err(EX_IOERR, "%s", q->names[i]);
+		p = q->base + q->bounds[i];
+		for (len = q->bounds[i + 1] - q->bounds[i]; len > 0;
+		    len -= n, p += n)
+			if ((n = write(fd, p, (size_t)MIN(len, 1 << 30))) <= 0)
+				err(EX_IOERR, "%s", q->names[i]);
+		if (close(fd) != 0)
+			err(EX_IOERR, "%s", q->names[i]);
+	}
+	return (NULL);
+}
+
 /*
  * split2 --
  *	Split the input by lines.
@@ -294,22 +545,40 @@ writeit:
 void
 newfile(void)
 {
-	long i, maxfiles, tfnum;
-	static long fnum;
-	static int defname;
-	static char *fpnt;
-
-	if (ofd == -1) {
-		if (fname[0] == '\0') {
-			fname[0] = 'x';
-			fpnt = fname + 1;
-			defname = 1;
-		} else {
-			fpnt = fname + strlen(fname);
-			defname = 0;
-		}
+
+	if (ofd == -1)
 		ofd = fileno(stdout);
-	}
+	if (!nextname())
+		errx(EX_DATAERR, "too many files");
+	if (!freopen(fname, "w", stdout))
+		err(EX_IOERR, "%s", fname);
+	file_open = 1;
+}
+
+/*
+ * initname --
+ *	Set up the file name prefix.
+ */
+void
+initname(void)
+{
+
+	if (fname[0] == '\0') {
+		fname[0] = 'x';
+		fpnt = fname + 1;
+	} else
+		fpnt = fname + strlen(fname);
+}
+
+/*
+ * nextname --
+ *	Put the name of the next output file in fname.  Returns 0 if
+ *	the suffixes have run out.
+ */
+int
+nextname(void)
+{
+	long i, maxfiles, tfnum;
 
 	/* maxfiles = 26^sufflen, but don't use libm. */
 	for (maxfiles = 1, i = 0; i < sufflen; i++)
@@ -317,7 +586,7 @@ newfile(void)
 			errx(EX_USAGE, "suffix is too long (max %ld)", i);
 
 	if (fnum == maxfiles)
-		errx(EX_DATAERR, "too many files");
+		return (0);
 
 	/* Generate suffix of sufflen letters */
 	tfnum = fnum;
@@ -329,16 +598,15 @@ newfile(void)
 	fpnt[sufflen] = '\0';
 
 	++fnum;
-	if (!freopen(fname, "w", stdout))
-		err(EX_IOERR, "%s", fname);
-	file_open = 1;
+	return (1);
 }
 
 static void
 usage(void)
 {
 	(void)fprintf(stderr,
-"usage: split [-a sufflen] [-b byte_count] [-l line_count] [-p pattern]\n");
+"usage: split [-a sufflen] [-b byte_count] [-l line_count] [-n [l/]chunks]\n"
+"             [-p pattern]\n");
 	(void)fprintf(stderr,
 "             [file [prefix]]\n");
 	exit(EX_USAGE);
@@ -42,6 +42,10 @@
 
 #define TAILMAPLEN (4<<20)
 
+#define TAILSCANLEN	(1<<20)		/* backwards scan window */
+#define TAILSCANLINES	65536		/* lines wanted before using threads */
+#define TAILSCANTHREADS	8
+
 struct mapinfo {
 	off_t	mapoff;
 	off_t	maxoff;
@@ -54,6 +58,8 @@ struct file_info {
 	FILE *fp;
 	char *file_name;
 	struct stat st;
+	int ready;		/* the watcher saw activity */
+	int wd;			/* inotify watch, or -1 */
 };
 
 typedef struct file_info file_info_t;
@@ -71,6 +77,8 @@ void ierr(void);
 void oerr(void);
 int mapprint(struct mapinfo *, off_t, off_t);
 int maparound(struct mapinfo *, off_t);
+const char *rnewline(const char *, size_t);
+off_t rlinestart(int, off_t, off_t);
 
 extern int Fflag, fflag, tail_qflag, rflag, rval, no_files;
 extern const char *tail_fname;
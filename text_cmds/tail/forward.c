@@ -43,17 +43,23 @@ static const char sccsid[] = "@(#)forward.c	8.1 (Berkeley) 6/6/93";
 #endif
 
 #include <sys/param.h>
-#include <sys/mount.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/mman.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#else
+#include <sys/mount.h>
 #include <sys/event.h>
+#endif
 
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -65,13 +71,23 @@ static const char sccsid[] = "@(#)forward.c	8.1 (Berkeley) 6/6/93";
 static void rlines(FILE *, off_t, struct stat *);
 static void show(file_info_t *);
 static void set_events(file_info_t *files);
+static int wait_events(file_info_t *files);
 
 /* defines for inner loop actions */
 #define USE_SLEEP	0
 #define USE_KQUEUE	1
 #define ADD_EVENTS	2
+#define USE_INOTIFY	3
+
+#define SHOWBUFSZ	65536
 
+#ifdef __linux__
+static char *wdready;		/* watch descriptors with pending events */
+static int nwdready;
+#else
 struct kevent *ev;
+static int nev;
+#endif
 int action = USE_SLEEP;
 int kq;
 
@@ -198,186 +214,55 @@ rlines(fp, off, sbp)
 	off_t off;
 	struct stat *sbp;
 {
-#ifdef __APPLE__
 	/* Using mmap on network filesystems can frequently lead
 	to distress, and even on local file systems other processes
 	truncating the file can also lead to upset. */
 
-	/* Seek to sbp->st_blksize before the end of the file, find
-	all the newlines.   If there are enough, print the last off
-	lines.  Otherwise go back another sbp->st_blksize bytes,
-	and count newlines.  Avoid re-reading blocks when possible. */
-
-	// +1 because we capture line ends and we want off line _starts_,
-	// +1 because the first line might be partial when try_at != 0
-	off_t search_for = off +2;
-	off_t try_at = sbp->st_size;
-	off_t last_try = sbp->st_size;
-	off_t found_this_pass = 0;
-	off_t found_total = 0;
-	off_t *found_at = calloc(search_for, sizeof(off_t));
-
-	flockfile(fp);
-
-	if (found_at == NULL) {
-		ierr();
-		goto done;
-	}
-
-	if (off == 0 || sbp->st_size == 0) {
-		goto done;
-	}
-
-	/* The last character is special.  Check to make sure that it is a \n,
-	 * and if not, subtract one from the number of \n we need to search for.
-	 */
-	if (0 != fseeko(fp, sbp->st_size - 1, SEEK_SET)) {
-		ierr();
-		goto done;
-	}
-	if ('\n' != getc_unlocked(fp)) {
-		search_for--;
-	}
-
-	while(try_at != 0) {
-		found_this_pass = 0;
-
-		if (try_at < sbp->st_blksize) {
-			found_at[found_this_pass++] = 0;
-			try_at = 0;
-		} else {
-			last_try = try_at;
-			try_at -= sbp->st_blksize;
-		}
-
-		if (0 != fseeko(fp, try_at, SEEK_SET)) {
-			ierr();
-			goto done;
-		}
-
-		char ch;
-		while(EOF != (ch = getc_unlocked(fp))) {
-			if (ch == '\n') {
-				found_at[found_this_pass++ % search_for] = ftello(fp);
-				found_total++;
-			}
-			if (ftello(fp) == last_try && found_total < search_for) {
-				// We just reached the last block we scanned,
-				// and we know there arn't enough lines found
-				// so far to be happy, so we don't have to
-				// read it again.
-				break;
-			}
-		}
-
-		if (found_this_pass >= search_for || try_at == 0) {
-			off_t min = found_at[0];
-			int min_i = 0;
-			int i;
-			int lim = (found_this_pass < search_for) ? found_this_pass : search_for;
-			for(i = 1; i < lim; i++) {
-				if (found_at[i] < min) {
-					min = found_at[i];
-					min_i = i;
-				}
-			}
-
-			off_t target = min;
-
-			if (found_this_pass >= search_for) {
-				// min_i might be a partial line (unless
-				// try_at is 0).   If we  found search_for
-				// lines, min_i+1 is the first known full line
-				// _and_ because we look for an extra line we
-				// don't need to show it.
-				target = found_at[(min_i + 1) % search_for];
-			}
-
-			if (0 != fseeko(fp, target, SEEK_SET)) {
-				ierr();
-				goto done;
-			}
-
-			flockfile(thread_stdout);
-			while(EOF != (ch = getc_unlocked(fp))) {
-				if (EOF == putc_unlocked(ch, thread_stdout)) {
-					funlockfile(thread_stdout);
-					oerr();
-					goto done;
-				}
-			}
-			funlockfile(thread_stdout);
-			goto done;
-		}
-	}
+	/* Find where the last off lines start with pread, then copy
+	from there to the end of the file, including anything written
+	since it was stat'ed. */
+	char buf[SHOWBUFSZ];
+	off_t start;
+	size_t n;
 
-done:
-	funlockfile(fp);
-	free(found_at);
-	return;
-#else
-	struct mapinfo map;
-	off_t curoff, size;
-	int i;
-
-	if (!(size = sbp->st_size))
+	if (off == 0 || sbp->st_size == 0)
 		return;
-	map.start = NULL;
-	map.fd = fileno(fp);
-	map.mapoff = map.maxoff = size;
-
-	/*
-	 * Last char is special, ignore whether newline or not. Note that
-	 * size == 0 is dealt with above, and size == 1 sets curoff to -1.
-	 */
-	curoff = size - 2;
-	while (curoff >= 0) {
-		if (curoff < map.mapoff && maparound(&map, curoff) != 0) {
-			ierr();
-			return;
-		}
-		for (i = curoff - map.mapoff; i >= 0; i--)
-			if (map.start[i] == '\n' && --off == 0)
-				break;
-		/* `i' is either the map offset of a '\n', or -1. */
-		curoff = map.mapoff + i;
-		if (i >= 0)
-			break;
-	}
-	curoff++;
-	if (mapprint(&map, curoff, size - curoff) != 0) {
-		ierr();
-		exit(1);
-	}
-
-	/* Set the file pointer to reflect the length displayed. */
-	if (fseeko(fp, sbp->st_size, SEEK_SET) == -1) {
+	if ((start = rlinestart(fileno(fp), sbp->st_size, off)) < 0 ||
+	    fseeko(fp, start, SEEK_SET) != 0) {
 		ierr();
 		return;
 	}
-	if (map.start != NULL && munmap(map.start, map.maplen)) {
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		if (fwrite(buf, 1, n, thread_stdout) != n)
+			oerr();
+	if (ferror(fp))
 		ierr();
-		return;
-	}
-#endif
 }
 
 static void
 show(file_info_t *file)
 {
-    int ch;
-
-    while ((ch = getc(file->fp)) != EOF) {
+    char buf[SHOWBUFSZ];
+    ssize_t n;
+
+    /*
+     * Read the descriptor rather than the stream: fread() would wait
+     * for a full buffer on a pipe, holding back what already arrived.
+     */
+    while ((n = read(fileno(file->fp), buf, sizeof(buf))) > 0 ||
+	(n == -1 && errno == EINTR)) {
+	if (n == -1)
+		continue;
 	if (last != file && no_files > 1) {
 		if (!tail_qflag)
 			(void)printf("\n==> %s <==\n", file->file_name);
 		last = file;
 	}
-	if (putchar(ch) == EOF)
+	if (fwrite(buf, 1, n, thread_stdout) != (size_t)n)
 		oerr();
+	(void)fflush(stdout);
     }
-    (void)fflush(stdout);
-    if (ferror(file->fp)) {
+    if (n == -1) {
 	    file->fp = NULL;
 	    tail_fname = file->file_name;
 	    ierr();
@@ -386,6 +271,132 @@ show(file_info_t *file)
 	    clearerr(file->fp);
 }
 
+#ifdef __linux__
+/*
+ * Linux has no kqueue; watch the files with inotify instead.  A file
+ * that was opened as stdin is watched through /proc, which follows the
+ * descriptor to whatever it refers to.  Network file systems do not
+ * report remote changes, so they are left to the sleep loop.
+ */
+static void
+set_events(file_info_t *files)
+{
+	int i;
+	file_info_t *file;
+	struct statfs sf;
+	char fdpath[32];
+	const char *path;
+
+	action = USE_INOTIFY;
+	for (i = 0, file = files; i < no_files; i++, file++) {
+		if (file->wd >= 0) {
+			(void)inotify_rm_watch(kq, file->wd);
+			file->wd = -1;
+		}
+		if (! file->fp)
+			continue;
+
+		if (fstatfs(fileno(file->fp), &sf) == 0 &&
+		    (sf.f_type == 0x6969 /* NFS */ ||
+		     sf.f_type == 0xff534d42 /* CIFS */ ||
+		     sf.f_type == 0xfe534d42 /* SMB2 */ ||
+		     sf.f_type == 0x517b /* SMB */)) {
+			action = USE_SLEEP;
+			return;
+		}
+
+		if (file->fp == thread_stdin) {
+			(void)snprintf(fdpath, sizeof(fdpath),
+			    "/proc/self/fd/%d", fileno(file->fp));
+			path = fdpath;
+		} else
+			path = file->file_name;
+		file->wd = inotify_add_watch(kq, path, IN_MODIFY | IN_ATTRIB |
+		    (Fflag ? IN_DELETE_SELF | IN_MOVE_SELF : 0));
+		if (file->wd < 0) {
+			action = USE_SLEEP;
+			return;
+		}
+		if (file->wd >= nwdready) {
+			char *p;
+			int nn = MAX(file->wd + 1, nwdready * 2);
+
+			if ((p = realloc(wdready, nn)) == NULL) {
+				action = USE_SLEEP;
+				return;
+			}
+			memset(p + nwdready, 0, nn - nwdready);
+			wdready = p;
+			nwdready = nn;
+		}
+	}
+}
+
+/*
+ * Wait for inotify to report activity and mark the files concerned.
+ * Everything queued by then is read at once, so a burst of writes to
+ * the same file only shows it once.  Returns 1 if every file should
+ * be looked at, as after a timeout or a queue overflow.
+ */
+static int
+wait_events(file_info_t *files)
+{
+	char buf[SHOWBUFSZ]
+	    __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ie;
+	struct pollfd pfd;
+	struct stat sb;
+	file_info_t *file;
+	ssize_t len;
+	char *p;
+	int i, all, n;
+
+	pfd.fd = kq;
+	pfd.events = POLLIN;
+	/*
+	 * In the -F case we set a timeout to ensure that
+	 * we re-stat the file at least once every second.
+	 */
+	n = poll(&pfd, 1, Fflag ? 1000 : -1);
+	if (n < 0) {
+		if (errno == EINTR)
+			return (0);
+		err(1, "poll");
+	}
+	if (n == 0)
+		return (1);
+
+	all = 0;
+	while ((len = read(kq, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len;
+		    p += sizeof(struct inotify_event) + ie->len) {
+			ie = (struct inotify_event *)p;
+			if (ie->mask & IN_Q_OVERFLOW)
+				all = 1;
+			else if (ie->wd >= 0 && ie->wd < nwdready)
+				wdready[ie->wd] = 1;
+		}
+	}
+	if (len < 0 && errno != EAGAIN && errno != EINTR)
+		err(1, "inotify");
+
+	for (i = 0, file = files; i < no_files; i++, file++) {
+		if (file->fp == NULL || file->wd < 0 || !wdready[file->wd])
+			continue;
+		file->ready = 1;
+		/* file shrank, reposition to end */
+		if (fstat(fileno(file->fp), &sb) == 0 &&
+		    S_ISREG(sb.st_mode) &&
+		    sb.st_size < lseek(fileno(file->fp), (off_t)0, SEEK_CUR) &&
+		    lseek(fileno(file->fp), (off_t)0, SEEK_END) == -1)
+			ierr();
+	}
+	for (i = 0, file = files; i < no_files; i++, file++)
+		if (file->wd >= 0)
+			wdready[file->wd] = 0;
+	return (all);
+}
+#else
 static void
 set_events(file_info_t *files)
 {
@@ -411,11 +422,11 @@ set_events(file_info_t *files)
 		if (Fflag && fileno(file->fp) != STDIN_FILENO) {
 			EV_SET(&ev[n], fileno(file->fp), EVFILT_VNODE,
 			    EV_ADD | EV_ENABLE | EV_CLEAR,
-			    NOTE_DELETE | NOTE_RENAME, 0, 0);
+			    NOTE_DELETE | NOTE_RENAME, 0, file);
 			n++;
 		}
 		EV_SET(&ev[n], fileno(file->fp), EVFILT_READ,
-		    EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, 0);
+		    EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, file);
 		n++;
 	}
 
@@ -424,17 +435,53 @@ set_events(file_info_t *files)
 	}
 }
 
+/*
+ * Collect whatever events kqueue has and mark the files they belong
+ * to.  Returns 1 if every file should be looked at.
+ */
+static int
+wait_events(file_info_t *files)
+{
+	struct timespec ts;
+	file_info_t *file;
+	int i, n;
+
+	ts.tv_sec = 1;
+	ts.tv_nsec = 0;
+	/*
+	 * In the -F case we set a timeout to ensure that
+	 * we re-stat the file at least once every second.
+	 */
+	n = kevent(kq, NULL, 0, ev, nev, Fflag ? &ts : NULL);
+	if (n < 0)
+		err(1, "kevent");
+	if (n == 0)
+		return (1);	/* timeout */
+	for (i = 0; i < n; i++) {
+		file = (file_info_t *)ev[i].udata;
+		file->ready = 1;
+		if (ev[i].filter == EVFILT_READ && ev[i].data < 0) {
+			/* file shrank, reposition to end */
+			if (lseek(ev[i].ident, (off_t)0, SEEK_END) == -1)
+				ierr();
+		}
+	}
+	return (0);
+}
+#endif
+
 /*
  * follow -- display the file, from an offset, forward.
  *
+ * Only the files the watcher reported are read again, so following
+ * many quiet files costs nothing between events.
  */
 void
 follow(file_info_t *files, enum STYLE style, off_t off)
 {
-	int active, i, n = -1;
+	int active, all, i, reopened, n = -1;
 	struct stat sb2;
 	file_info_t *file;
-	struct timespec ts;
 
 	/* Position each of the files */
 
@@ -442,6 +489,8 @@ follow(file_info_t *files, enum STYLE style, off_t off)
 	active = 0;
 	n = 0;
 	for (i = 0; i < no_files; i++, file++) {
+		file->ready = 0;
+		file->wd = -1;
 		if (file->fp) {
 			active = 1;
 			n++;
@@ -459,18 +508,33 @@ follow(file_info_t *files, enum STYLE style, off_t off)
 
 	last = --file;
 
+#ifdef __linux__
+	kq = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (kq < 0)
+		err(1, "inotify_init");
+	wdready = NULL;
+	nwdready = 0;
+#else
 	kq = kqueue();
 	if (kq < 0)
 		err(1, "kqueue");
+	nev = n;
 	ev = malloc(n * sizeof(struct kevent));
 	if (! ev)
 	    err(1, "Couldn't allocate memory for kevents.");
+#endif
 	set_events(files);
 
+	all = 1;
 	for (;;) {
 		for (i = 0, file = files; i < no_files; i++, file++) {
 			if (! file->fp)
 				continue;
+			reopened = 0;
+			/*
+			 * A rotated or recreated file is noticed on every
+			 * pass, whether or not its old inode had events.
+			 */
 			if (Fflag && file->fp && fileno(file->fp) != STDIN_FILENO) {
 				if (stat(file->file_name, &sb2) == 0 &&
 				    (sb2.st_ino != file->st.st_ino ||
@@ -484,37 +548,25 @@ follow(file_info_t *files, enum STYLE style, off_t off)
 					} else {
 						memcpy(&file->st, &sb2, sizeof(struct stat));
 						set_events(files);
+						reopened = 1;
 					}
 				}
 			}
+			if (!all && !file->ready && !reopened)
+				continue;
+			file->ready = 0;
 			show(file);
 		}
 
 		switch (action) {
 		case USE_KQUEUE:
-			ts.tv_sec = 1;
-			ts.tv_nsec = 0;
-			/*
-			 * In the -F case we set a timeout to ensure that
-			 * we re-stat the file at least once every second.
-			 */
-			n = kevent(kq, NULL, 0, ev, 1, Fflag ? &ts : NULL);
-			if (n < 0)
-				err(1, "kevent");
-			if (n == 0) {
-				/* timeout */
-				break;
-			} else if (ev->filter == EVFILT_READ && ev->data < 0) {
-				 /* file shrank, reposition to end */
-				if (lseek(ev->ident, (off_t)0, SEEK_END) == -1) {
-					ierr();
-					continue;
-				}
-			}
+		case USE_INOTIFY:
+			all = wait_events(files);
 			break;
 
 		case USE_SLEEP:
 			(void) usleep(250000);
+			all = 1;
 			break;
 		}
 	}
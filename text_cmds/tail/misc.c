@@ -42,12 +42,16 @@ __FBSDID("$FreeBSD$");
 static const char sccsid[] = "@(#)misc.c	8.1 (Berkeley) 6/6/93";
 #endif
 
+#include <sys/param.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 
 #include <err.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -118,3 +122,144 @@ maparound(struct mapinfo *mip, off_t offset)
 
 	return (0);
 }
+
+/*
+ * Return a pointer to the last newline in the `len' bytes at `p', or
+ * NULL if there is none.  Aligned words are tested a word at a time.
+ */
+const char *
+rnewline(const char *p, size_t len)
+{
+	const uintptr_t ones = (uintptr_t)-1 / 0xff;
+	const uintptr_t highs = ones << 7;
+	const uintptr_t nls = ones * '\n';
+	const char *e = p + len;
+	uintptr_t w;
+
+	while (e > p && ((uintptr_t)e & (sizeof(w) - 1)) != 0)
+		if (*--e == '\n')
+			return (e);
+	while (e - p >= (ptrdiff_t)sizeof(w)) {
+		w = *(const uintptr_t *)(e - sizeof(w)) ^ nls;
+		if (((w - ones) & ~w & highs) != 0)
+			break;
+		e -= sizeof(w);
+	}
+	while (e > p)
+		if (*--e == '\n')
+			return (e);
+	return (NULL);
+}
+
+static int
+preadall(int fd, char *buf, size_t len, off_t off)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = pread(fd, buf, len, off)) <= 0) {
+			if (n == 0)
+				errno = EIO;
+			return (1);
+		}
+		buf += n;
+		len -= n;
+		off += n;
+	}
+	return (0);
+}
+
+struct nlcount {
+	int	fd;
+	off_t	off;
+	char	*buf;
+	off_t	count;
+	int	error;
+};
+
+static void *
+nlcount(void *arg)
+{
+	struct nlcount *nc = arg;
+	char *p, *e;
+
+	nc->count = 0;
+	if ((nc->error = preadall(nc->fd, nc->buf, TAILSCANLEN, nc->off)) != 0)
+		return (NULL);
+	for (p = nc->buf, e = p + TAILSCANLEN;
+	    (p = memchr(p, '\n', e - p)) != NULL; p++)
+		nc->count++;
+	return (NULL);
+}
+
+/*
+ * Return the file offset at which the last `nlines' lines of the first
+ * `size' bytes of `fd' start, or -1 on error.  The last byte is not
+ * looked at, whether newline or not.  The file is scanned backwards in
+ * TAILSCANLEN windows; when many lines are wanted, several windows at
+ * a time are counted by separate threads before the one holding the
+ * answer is searched.
+ */
+off_t
+rlinestart(int fd, off_t size, off_t nlines)
+{
+	struct nlcount nc[TAILSCANTHREADS];
+	pthread_t tid[TAILSCANTHREADS];
+	off_t end, n;
+	char *buf;
+	const char *p, *q;
+	long nt;
+	int found, i, t;
+
+	nt = 1;
+	if (nlines >= TAILSCANLINES &&
+	    (nt = sysconf(_SC_NPROCESSORS_ONLN)) > TAILSCANTHREADS)
+		nt = TAILSCANTHREADS;
+	if (nt < 1)
+		nt = 1;
+	if ((buf = malloc(nt * TAILSCANLEN)) == NULL)
+		return (-1);
+
+	found = 0;
+	for (end = size - 1; end > 0; end -= n) {
+		if (nt > 1 && !found && end >= nt * TAILSCANLEN) {
+			for (i = 0; i < nt; i++) {
+				nc[i].fd = fd;
+				nc[i].off = end - (i + 1) * TAILSCANLEN;
+				nc[i].buf = buf + i * TAILSCANLEN;
+				if (pthread_create(&tid[i], NULL, nlcount,
+				    &nc[i]) != 0)
+					break;
+			}
+			for (t = 0; t < i; t++)
+				pthread_join(tid[t], NULL);
+			if (i < nt)
+				goto error;
+			for (i = 0; i < nt; i++) {
+				if (nc[i].error)
+					goto error;
+				if (nc[i].count >= nlines)
+					break;
+				nlines -= nc[i].count;
+			}
+			n = i * TAILSCANLEN;
+			found = i < nt;
+			continue;
+		}
+		n = MIN(end, TAILSCANLEN);
+		if (preadall(fd, buf, n, end - n) != 0)
+			goto error;
+		for (p = buf + n; (q = rnewline(buf, p - buf)) != NULL; p = q)
+			if (--nlines == 0) {
+				free(buf);
+				return (end - n + (q - buf) + 1);
+			}
+	}
+	free(buf);
+	return (0);
+
+error:
+	free(buf);
+	return (-1);
+}
+
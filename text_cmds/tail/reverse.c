@@ -108,12 +108,18 @@ reverse(FILE *fp, enum STYLE style, off_t off, struct stat *sbp)
 
 /*
  * r_reg -- display a regular file in reverse order by line.
+ *
+ * Lines that lie within the current map window are gathered into an
+ * output buffer and written in large pieces rather than one at a time.
  */
 static void
 r_reg(FILE *fp, enum STYLE style, off_t off, struct stat *sbp)
 {
 	struct mapinfo map;
 	off_t curoff, size, lineend;
+	const char *nl;
+	char *obuf;
+	size_t len, olen;
 	int i;
 
 	if (!(size = sbp->st_size))
@@ -122,6 +128,8 @@ r_reg(FILE *fp, enum STYLE style, off_t off, struct stat *sbp)
 	map.start = NULL;
 	map.mapoff = map.maxoff = size;
 	map.fd = fileno(fp);
+	obuf = malloc(TAILSCANLEN);
+	olen = 0;
 
 	/*
 	 * Last char is special, ignore whether newline or not. Note that
@@ -134,14 +142,19 @@ r_reg(FILE *fp, enum STYLE style, off_t off, struct stat *sbp)
 		    curoff >= map.mapoff + (off_t)map.maplen) {
 			if (maparound(&map, curoff) != 0) {
 				ierr();
-				return;
+				goto done;
 			}
 		}
-		for (i = curoff - map.mapoff; i >= 0; i--) {
-			if (style == RBYTES && --off == 0)
-				break;
-			if (map.start[i] == '\n')
-				break;
+		if (style == RBYTES) {
+			for (i = curoff - map.mapoff; i >= 0; i--) {
+				if (--off == 0)
+					break;
+				if (map.start[i] == '\n')
+					break;
+			}
+		} else {
+			nl = rnewline(map.start, curoff - map.mapoff + 1);
+			i = nl != NULL ? nl - map.start : -1;
 		}
 		/* `i' is either the map offset of a '\n', or -1. */
 		curoff = map.mapoff + i;
@@ -149,9 +162,24 @@ r_reg(FILE *fp, enum STYLE style, off_t off, struct stat *sbp)
 			continue;
 
 		/* Print the line and update offsets. */
-		if (mapprint(&map, curoff + 1, lineend - curoff - 1) != 0) {
-			ierr();
-			return;
+		len = lineend - curoff - 1;
+		if (obuf != NULL && len <= TAILSCANLEN &&
+		    lineend <= map.mapoff + (off_t)map.maplen) {
+			if (len > TAILSCANLEN - olen) {
+				WR(obuf, olen);
+				olen = 0;
+			}
+			memcpy(obuf + olen, map.start + i + 1, len);
+			olen += len;
+		} else {
+			if (olen > 0) {
+				WR(obuf, olen);
+				olen = 0;
+			}
+			if (mapprint(&map, curoff + 1, len) != 0) {
+				ierr();
+				goto done;
+			}
 		}
 		lineend = curoff + 1;
 		curoff--;
@@ -165,12 +193,16 @@ r_reg(FILE *fp, enum STYLE style, off_t off, struct stat *sbp)
 			break;
 		}
 	}
+	if (olen > 0)
+		WR(obuf, olen);
 	if (curoff < 0 && mapprint(&map, 0, lineend) != 0) {
 		ierr();
-		return;
+		goto done;
 	}
 	if (map.start != NULL && munmap(map.start, map.maplen))
 		ierr();
+done:
+	free(obuf);
 }
 
 typedef struct bf {
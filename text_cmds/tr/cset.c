@@ -177,6 +177,26 @@ cset_cache(struct cset *cs)
 	cs->cs_havecache = true;
 }
 
+/*
+ * cset_bounded --
+ *	Determine whether the set is known to hold no characters at or
+ *	above "lim": no classes, not inverted, and every explicit range
+ *	below the limit.
+ */
+bool
+cset_bounded(struct cset *cs, wchar_t lim)
+{
+	struct csnode *t;
+
+	if (cs->cs_invert || cs->cs_classes != NULL)
+		return (false);
+	if ((t = cs->cs_root) == NULL)
+		return (true);
+	while (t->csn_right != NULL)
+		t = t->csn_right;
+	return (t->csn_max < lim);
+}
+
 /*
  * cset_invert --
  *	Invert the character set.
@@ -60,6 +60,7 @@ struct cset *		cset_alloc(void);
 bool 			cset_add(struct cset *, wchar_t);
 void			cset_invert(struct cset *);
 bool			cset_in_hard(struct cset *, wchar_t);
+bool			cset_bounded(struct cset *, wchar_t);
 void			cset_cache(struct cset *);
 
 static __inline bool
@@ -49,6 +49,7 @@ static const char sccsid[] = "@(#)tr.c	8.2 (Berkeley) 5/4/95";
 
 #include <ctype.h>
 #include <err.h>
+#include <langinfo.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdio.h>
@@ -68,7 +69,26 @@ static const char sccsid[] = "@(#)tr.c	8.2 (Berkeley) 5/4/95";
 STR s1 = { STRING1, NORMAL, 0, OOBCH, 0, { 0, OOBCH }, NULL, NULL };
 STR s2 = { STRING2, NORMAL, 0, OOBCH, 0, { 0, OOBCH }, NULL, NULL };
 
+/*
+ * Byte translation tables, used when every character the sets can touch
+ * is encoded as a single byte.  Deletion is applied first, then the
+ * mapping, then squeezing, which is the order of the wide character loops.
+ */
+struct bytetab {
+	u_char	bt_map[NCHARS_SB];
+	bool	bt_del[NCHARS_SB];
+	bool	bt_sqz[NCHARS_SB];
+	bool	bt_hasmap;
+	bool	bt_hasdel;
+	bool	bt_hassqz;
+};
+
+#define	BYTEBUF	(64 * 1024)
+
 static struct cset *setup(char *, STR *, int, int);
+static bool bytetab(struct bytetab *, struct cset *, struct cmap *, int,
+		    struct cset *);
+static bool byteloop(const struct bytetab *);
 static void usage(void);
 
 static void initSTR(STR* s) {
@@ -130,6 +150,7 @@ tr_main(int argc, char **argv)
 	static int carray[NCHARS_SB];
 	struct cmap *map;
 	struct cset *delete , *squeeze;
+	struct bytetab bt;
 	int n, *p;
 	int Cflag, cflag, dflag, sflag, isstring2;
 	wint_t ch, cnt, lastch;
@@ -193,6 +214,17 @@ tr_main(int argc, char **argv)
 		delete = setup(argv[0], &s1, cflag, Cflag);
 		squeeze = setup(argv[1], &s2, 0, 0);
 
+		if (bytetab(&bt, delete, NULL, 0, squeeze)) {
+			if (!byteloop(&bt)) {
+				cset_free(delete);
+				cset_free(squeeze);
+				err(1, NULL);
+			}
+			cset_free(delete);
+			cset_free(squeeze);
+			exit(0);
+		}
+
 		for (lastch = OOBCH; (ch = getwchar()) != WEOF;)
 			if (!cset_in(delete, ch) &&
 			    (lastch != ch || !cset_in(squeeze, ch))) {
@@ -219,6 +251,15 @@ tr_main(int argc, char **argv)
 
 		delete = setup(argv[0], &s1, cflag, Cflag);
 
+		if (bytetab(&bt, delete, NULL, 0, NULL)) {
+			if (!byteloop(&bt)) {
+				cset_free(delete);
+				err(1, NULL);
+			}
+			cset_free(delete);
+			exit(0);
+		}
+
 		while ((ch = getwchar()) != WEOF)
 			if (!cset_in(delete, ch))
 				(void)putwc(ch, thread_stdout); // (void)putwchar(ch);
@@ -237,6 +278,15 @@ tr_main(int argc, char **argv)
 	if (sflag && !isstring2) {
 		squeeze = setup(argv[0], &s1, cflag, Cflag);
 
+		if (bytetab(&bt, NULL, NULL, 0, squeeze)) {
+			if (!byteloop(&bt)) {
+				cset_free(squeeze);
+				err(1, NULL);
+			}
+			cset_free(squeeze);
+			exit(0);
+		}
+
 		for (lastch = OOBCH; (ch = getwchar()) != WEOF;)
 			if (lastch != ch || !cset_in(squeeze, ch)) {
 				lastch = ch;
@@ -393,7 +443,13 @@ endloop:
 	cset_cache(squeeze);
 	cmap_cache(map);
 
-	if (sflag)
+	if (bytetab(&bt, NULL, map, Cflag, sflag ? squeeze : NULL)) {
+		if (!byteloop(&bt)) {
+			cset_free(squeeze);
+			cmap_free(map);
+			err(1, NULL);
+		}
+	} else if (sflag)
 		for (lastch = OOBCH; (ch = getwchar()) != WEOF;) {
 			if (!Cflag || iswrune(ch))
 				ch = cmap_lookup(map, ch);
@@ -436,6 +492,116 @@ setup(char *arg, STR *str, int cflag, int Cflag)
 	return (cs);
 }
 
+/*
+ * Fill in the byte tables for the given delete set, map and squeeze set
+ * (any of which may be NULL).  Returns false if some byte cannot be
+ * treated on its own: a multibyte locale other than UTF-8, or in UTF-8
+ * a set or mapping that reaches past ASCII, so that lead and
+ * continuation bytes could be affected.
+ */
+static bool
+bytetab(struct bytetab *bt, struct cset *delete, struct cmap *map, int Cflag,
+    struct cset *squeeze)
+{
+	wint_t ch, to;
+	int lim;
+
+	if (MB_CUR_MAX == 1)
+		lim = NCHARS_SB;
+	else if (strcmp(nl_langinfo(CODESET), "UTF-8") == 0)
+		lim = 0x80;
+	else
+		return (false);
+
+	if (lim < NCHARS_SB) {
+		if (delete != NULL && !cset_bounded(delete, lim))
+			return (false);
+		if (squeeze != NULL && !cset_bounded(squeeze, lim))
+			return (false);
+		if (map != NULL &&
+		    (map->cm_def != CM_DEF_SELF || cmap_max(map) >= lim))
+			return (false);
+	}
+
+	bt->bt_hasmap = bt->bt_hasdel = bt->bt_hassqz = false;
+	for (ch = 0; ch < NCHARS_SB; ch++) {
+		bt->bt_map[ch] = ch;
+		bt->bt_del[ch] = bt->bt_sqz[ch] = false;
+		if (ch >= lim)
+			continue;
+		if (map != NULL && (!Cflag || iswrune(ch))) {
+			to = cmap_lookup(map, ch);
+			if (to == OOBCH || to >= (wint_t)lim)
+				return (false);
+			bt->bt_map[ch] = to;
+			bt->bt_hasmap |= (to != ch);
+		}
+		if (delete != NULL && cset_in(delete, ch))
+			bt->bt_del[ch] = bt->bt_hasdel = true;
+		if (squeeze != NULL && cset_in(squeeze, ch))
+			bt->bt_sqz[ch] = bt->bt_hassqz = true;
+	}
+	return (true);
+}
+
+/*
+ * Run standard input through the byte tables a block at a time.
+ * Returns false on a read error.
+ */
+static bool
+byteloop(const struct bytetab *bt)
+{
+	u_char *ibuf, *obuf, *p, *ep, *o;
+	ssize_t nr;
+	int c, lastch, fd;
+
+	ibuf = malloc(BYTEBUF);
+	obuf = malloc(BYTEBUF);
+	if (ibuf == NULL || obuf == NULL) {
+		free(ibuf);
+		free(obuf);
+		err(1, NULL);
+	}
+	fd = fileno(thread_stdin);
+	lastch = OOBCH;
+	while ((nr = read(fd, ibuf, BYTEBUF)) > 0) {
+		ep = ibuf + nr;
+		o = obuf;
+		if (!bt->bt_hasdel && !bt->bt_hassqz) {
+			/* Plain translation, the common "tr A-Z a-z". */
+			for (p = ibuf; p + 4 <= ep; p += 4, o += 4) {
+				o[0] = bt->bt_map[p[0]];
+				o[1] = bt->bt_map[p[1]];
+				o[2] = bt->bt_map[p[2]];
+				o[3] = bt->bt_map[p[3]];
+			}
+			for (; p < ep; p++)
+				*o++ = bt->bt_map[*p];
+		} else if (!bt->bt_hasmap && !bt->bt_hassqz) {
+			/* Plain deletion, the common "tr -d '\r'". */
+			for (p = ibuf; p < ep; p++) {
+				*o = *p;
+				o += !bt->bt_del[*p];
+			}
+		} else {
+			for (p = ibuf; p < ep; p++) {
+				if (bt->bt_del[*p])
+					continue;
+				c = bt->bt_map[*p];
+				if (c == lastch && bt->bt_sqz[c])
+					continue;
+				lastch = c;
+				*o++ = c;
+			}
+		}
+		if (o > obuf)
+			(void)fwrite(obuf, 1, o - obuf, thread_stdout);
+	}
+	free(ibuf);
+	free(obuf);
+	return (nr == 0);
+}
+
 int
 charcoll(const void *a, const void *b)
 {
@@ -64,13 +64,58 @@ static const char rcsid[] =
 #include <wctype.h>
 #include "ios_error.h"
 
-static int cflag, dflag, uflag, iflag;
+static int cflag, dflag, uflag, iflag, Hflag;
 static long numchars, numfields;
 static int repeats;
+static int bytekeys;	/* C locale: compare bytes, no wide conversion */
+
+/*
+ * Hash mode (-H): count the distinct lines of unsorted input in a single
+ * pass.  Entries are kept in first-seen order and indexed by an open
+ * addressed table of entry numbers; lines and keys are copied into an
+ * arena.  Once the arena grows past HMEMMAX, what has been counted so
+ * far and the rest of the input are split over HPARTS temporary files
+ * by hash, and each partition is counted on its own.
+ */
+#define	HMEMMAX		(64 * 1024 * 1024)
+#define	HPARTS		16
+#define	HMAXDEPTH	8
+#define	HCHUNK		(1024 * 1024)
+
+enum hkind { HK_BYTES, HK_WIDE, HK_RAW };
+
+struct hent {
+	uint64_t	 he_hash;
+	char		*he_line;
+	const char	*he_key;
+	size_t		 he_keylen;
+	enum hkind	 he_kind;
+	u_long		 he_count;
+};
+
+struct hchunk {
+	struct hchunk	*hc_next;
+	size_t		 hc_used;
+	size_t		 hc_size;
+	char		 hc_data[];
+};
+
+struct htab {
+	struct hent	*ht_ent;	/* entries, first-seen order */
+	size_t		 ht_nent, ht_entsize;
+	size_t		*ht_slot;	/* entry index + 1, 0 if empty */
+	size_t		 ht_nslot;
+	struct hchunk	*ht_chunk;
+	size_t		 ht_mem;
+	u_int		 ht_seed;
+};
 
 static FILE	*file(const char *, const char *);
 static wchar_t	*convert(const char *);
+static const char *bkey(const char *, size_t *);
+static int	 bkeycmp(const char *, const char *);
 static int	 inlcmp(const char *, const char *);
+static void	 hcount(FILE *, const char *, int, FILE *, u_int);
 static void	 show(FILE *, const char *);
 static wchar_t	*skip(wchar_t *);
 static void	 obsolete(char *[]);
@@ -95,7 +140,7 @@ uniq_main (int argc, char *argv[])
 	int ch, comp;
 	size_t prevbuflen, thisbuflen, b1;
 	char *prevline, *thisline, *p;
-	const char *ifn;
+	const char *ifn, *lc;
 #ifndef __APPLE__
 	cap_rights_t rights;
 #endif
@@ -104,14 +149,18 @@ uniq_main (int argc, char *argv[])
     dflag = 0;
     uflag = 0;
     iflag = 0;
+    Hflag = 0;
     numchars = 0;
     numfields = 0;
     repeats = 0;
     
 	(void) setlocale(LC_ALL, "");
+	lc = setlocale(LC_COLLATE, NULL);
+	bytekeys = MB_CUR_MAX == 1 && (lc == NULL ||
+	    strcmp(lc, "C") == 0 || strcmp(lc, "POSIX") == 0);
 
 	obsolete(argv);
-	while ((ch = getopt(argc, argv, "cdif:s:u")) != -1)
+	while ((ch = getopt(argc, argv, "cdHif:s:u")) != -1)
 		switch (ch) {
 		case 'c':
 			cflag = 1;
@@ -119,6 +168,9 @@ uniq_main (int argc, char *argv[])
 		case 'd':
 			dflag = 1;
 			break;
+		case 'H':
+			Hflag = 1;
+			break;
 		case 'i':
 			iflag = 1;
 			break;
@@ -192,6 +244,11 @@ uniq_main (int argc, char *argv[])
 	strerror_init();
 #endif
 
+	if (Hflag) {
+		hcount(ifp, ifn, 0, ofp, 0);
+		exit(0);
+	}
+
 	prevbuflen = thisbuflen = 0;
 	prevline = thisline = NULL;
 
@@ -200,7 +257,7 @@ uniq_main (int argc, char *argv[])
 			err(1, "%s", ifn);
 		exit(0);
 	}
-	tprev = convert(prevline);
+	tprev = bytekeys ? NULL : convert(prevline);
 
 	if (!cflag && uflag && dflag)
 		show(ofp, prevline);
@@ -209,9 +266,11 @@ uniq_main (int argc, char *argv[])
 	while (getline(&thisline, &thisbuflen, ifp) >= 0) {
 		if (tthis != NULL)
 			free(tthis);
-		tthis = convert(thisline);
+		tthis = bytekeys ? NULL : convert(thisline);
 
-		if (tthis == NULL && tprev == NULL)
+		if (bytekeys)
+			comp = bkeycmp(thisline, prevline);
+		else if (tthis == NULL && tprev == NULL)
 			comp = inlcmp(thisline, prevline);
 		else if (tthis == NULL || tprev == NULL)
 			comp = 1;
@@ -279,6 +338,54 @@ convert(const char *str)
 	return (ret);
 }
 
+/*
+ * The comparison key of a line in the C locale: the line without its
+ * newline, less the skipped fields and characters.
+ */
+static const char *
+bkey(const char *str, size_t *lenp)
+{
+	const char *ep;
+	long nchars, nfields;
+
+	ep = str + strlen(str);
+	if (ep > str && ep[-1] == '\n')
+		ep--;
+	for (nfields = 0; str < ep && nfields++ != numfields; ) {
+		while (str < ep && isblank((unsigned char)*str))
+			str++;
+		while (str < ep && !isblank((unsigned char)*str))
+			str++;
+	}
+	for (nchars = numchars; nchars-- && str < ep; ++str)
+		;
+	*lenp = ep - str;
+	return (str);
+}
+
+static int
+bfoldcmp(const char *s1, const char *s2, size_t len)
+{
+
+	for (; len > 0; len--, s1++, s2++)
+		if (tolower((unsigned char)*s1) != tolower((unsigned char)*s2))
+			return (1);
+	return (0);
+}
+
+static int
+bkeycmp(const char *s1, const char *s2)
+{
+	const char *k1, *k2;
+	size_t l1, l2;
+
+	k1 = bkey(s1, &l1);
+	k2 = bkey(s2, &l2);
+	if (l1 != l2)
+		return (1);
+	return (iflag ? bfoldcmp(k1, k2, l1) : memcmp(k1, k2, l1));
+}
+
 static int
 inlcmp(const char *s1, const char *s2)
 {
@@ -328,6 +435,279 @@ skip(wchar_t *str)
 	return(str);
 }
 
+static void *
+halloc(struct htab *ht, size_t len)
+{
+	struct hchunk *hc;
+	size_t size;
+
+	len = (len + 7) & ~(size_t)7;
+	hc = ht->ht_chunk;
+	if (hc == NULL || hc->hc_size - hc->hc_used < len) {
+		size = len > HCHUNK ? len : HCHUNK;
+		if ((hc = malloc(sizeof(*hc) + size)) == NULL)
+			err(1, "malloc");
+		hc->hc_next = ht->ht_chunk;
+		hc->hc_used = 0;
+		hc->hc_size = size;
+		ht->ht_chunk = hc;
+		ht->ht_mem += sizeof(*hc) + size;
+	}
+	hc->hc_used += len;
+	return (hc->hc_data + hc->hc_used - len);
+}
+
+static uint64_t
+hhash(const char *key, size_t len, enum hkind kind, u_int seed)
+{
+	uint64_t h;
+
+	/* FNV-1a, folded for -i on byte keys. */
+	h = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+	if (kind == HK_BYTES && iflag)
+		for (; len > 0; len--, key++)
+			h = (h ^ (u_char)tolower((unsigned char)*key)) *
+			    0x100000001b3ULL;
+	else
+		for (; len > 0; len--, key++)
+			h = (h ^ (u_char)*key) * 0x100000001b3ULL;
+	return (h);
+}
+
+/*
+ * The hash mode key of a line.  *wkeyp is set to the conversion buffer
+ * to free, if one was needed.
+ */
+static const char *
+hkey(const char *line, size_t *keylenp, enum hkind *kindp, wchar_t **wkeyp)
+{
+	wchar_t *wkey;
+
+	*wkeyp = NULL;
+	if (bytekeys) {
+		*kindp = HK_BYTES;
+		return (bkey(line, keylenp));
+	}
+	if ((wkey = convert(line)) != NULL) {
+		*wkeyp = wkey;
+		*keylenp = wcslen(wkey) * sizeof(*wkey);
+		*kindp = HK_WIDE;
+		return ((const char *)wkey);
+	}
+	/* Not a valid string: compare the whole line, as inlcmp() does. */
+	*keylenp = strcspn(line, "\n");
+	*kindp = HK_RAW;
+	return (line);
+}
+
+/*
+ * Add "count" occurrences of "line" to the table.
+ */
+static void
+hadd(struct htab *ht, const char *line, u_long count)
+{
+	struct hent *he;
+	const char *key;
+	wchar_t *wkey;
+	enum hkind kind;
+	size_t i, len, keylen, mask;
+	uint64_t h;
+
+	key = hkey(line, &keylen, &kind, &wkey);
+	h = hhash(key, keylen, kind, ht->ht_seed);
+
+	mask = ht->ht_nslot - 1;
+	for (i = h & mask; ht->ht_slot[i] != 0; i = (i + 1) & mask) {
+		he = &ht->ht_ent[ht->ht_slot[i] - 1];
+		if (he->he_hash == h && he->he_kind == kind &&
+		    he->he_keylen == keylen &&
+		    (kind == HK_BYTES && iflag ?
+		    bfoldcmp(he->he_key, key, keylen) :
+		    memcmp(he->he_key, key, keylen)) == 0) {
+			he->he_count += count;
+			free(wkey);
+			return;
+		}
+	}
+
+	if (ht->ht_nent == ht->ht_entsize) {
+		ht->ht_entsize *= 2;
+		ht->ht_ent = reallocf(ht->ht_ent,
+		    ht->ht_entsize * sizeof(*ht->ht_ent));
+		if (ht->ht_ent == NULL)
+			err(1, "realloc");
+		ht->ht_mem += ht->ht_entsize / 2 * sizeof(*ht->ht_ent);
+	}
+	he = &ht->ht_ent[ht->ht_nent++];
+	ht->ht_slot[i] = ht->ht_nent;
+	len = strlen(line);
+	he->he_line = halloc(ht, len + 1);
+	memcpy(he->he_line, line, len + 1);
+	if (kind == HK_WIDE) {
+		he->he_key = halloc(ht, keylen);
+		memcpy((char *)he->he_key, key, keylen);
+	} else
+		he->he_key = he->he_line + (key - line);
+	he->he_keylen = keylen;
+	he->he_kind = kind;
+	he->he_hash = h;
+	he->he_count = count;
+	free(wkey);
+
+	if (ht->ht_nent * 2 > ht->ht_nslot) {
+		/* Double the index, reinserting from the cached hashes. */
+		free(ht->ht_slot);
+		ht->ht_nslot *= 2;
+		if ((ht->ht_slot = calloc(ht->ht_nslot,
+		    sizeof(*ht->ht_slot))) == NULL)
+			err(1, "calloc");
+		ht->ht_mem += ht->ht_nslot / 2 * sizeof(*ht->ht_slot);
+		mask = ht->ht_nslot - 1;
+		for (len = 0; len < ht->ht_nent; len++) {
+			for (i = ht->ht_ent[len].he_hash & mask;
+			    ht->ht_slot[i] != 0; i = (i + 1) & mask)
+				;
+			ht->ht_slot[i] = len + 1;
+		}
+	}
+}
+
+static void
+hinit(struct htab *ht, u_int seed)
+{
+
+	memset(ht, 0, sizeof(*ht));
+	ht->ht_seed = seed;
+	ht->ht_entsize = 1024;
+	ht->ht_nslot = 2048;
+	if ((ht->ht_ent = malloc(ht->ht_entsize * sizeof(*ht->ht_ent))) ==
+	    NULL || (ht->ht_slot = calloc(ht->ht_nslot,
+	    sizeof(*ht->ht_slot))) == NULL)
+		err(1, "malloc");
+	ht->ht_mem = ht->ht_entsize * sizeof(*ht->ht_ent) +
+	    ht->ht_nslot * sizeof(*ht->ht_slot);
+}
+
+static void
+hfree(struct htab *ht)
+{
+	struct hchunk *hc, *next;
+
+	for (hc = ht->ht_chunk; hc != NULL; hc = next) {
+		next = hc->hc_next;
+		free(hc);
+	}
+	free(ht->ht_ent);
+	free(ht->ht_slot);
+	memset(ht, 0, sizeof(*ht));
+}
+
+/*
+ * Partition records are the count, the line length and the line itself.
+ */
+static void
+hput(FILE *fp, const char *line, u_long count)
+{
+	size_t len;
+
+	len = strlen(line);
+	if (fwrite(&count, sizeof(count), 1, fp) != 1 ||
+	    fwrite(&len, sizeof(len), 1, fp) != 1 ||
+	    fwrite(line, 1, len, fp) != len)
+		err(1, "temporary file");
+}
+
+static ssize_t
+hget(FILE *fp, char **linep, size_t *sizep, u_long *countp)
+{
+	size_t len;
+
+	if (fread(countp, sizeof(*countp), 1, fp) != 1)
+		return (-1);
+	if (fread(&len, sizeof(len), 1, fp) != 1)
+		err(1, "temporary file");
+	if (*sizep < len + 1) {
+		*sizep = len + 1;
+		if ((*linep = reallocf(*linep, *sizep)) == NULL)
+			err(1, "realloc");
+	}
+	if (fread(*linep, 1, len, fp) != len)
+		err(1, "temporary file");
+	(*linep)[len] = '\0';
+	return (len);
+}
+
+static int
+hpart(uint64_t h)
+{
+
+	return (h >> 60);
+}
+
+/*
+ * Count the lines of ifp (or the records of a partition file when
+ * "part" is set) and show the result.
+ */
+static void
+hcount(FILE *ifp, const char *ifn, int part, FILE *ofp, u_int depth)
+{
+	struct htab ht;
+	FILE *parts[HPARTS];
+	const char *key;
+	wchar_t *wkey;
+	enum hkind kind;
+	char *line;
+	size_t i, keylen, linesize;
+	u_long count;
+	int spilled;
+
+	hinit(&ht, depth);
+	line = NULL;
+	linesize = 0;
+	count = 1;
+	spilled = 0;
+	while ((part ? hget(ifp, &line, &linesize, &count) :
+	    getline(&line, &linesize, ifp)) >= 0) {
+		if (spilled) {
+			key = hkey(line, &keylen, &kind, &wkey);
+			hput(parts[hpart(hhash(key, keylen, kind, depth))],
+			    line, count);
+			free(wkey);
+			continue;
+		}
+		hadd(&ht, line, count);
+		if (ht.ht_mem > HMEMMAX && depth < HMAXDEPTH) {
+			for (i = 0; i < HPARTS; i++)
+				if ((parts[i] = tmpfile()) == NULL)
+					err(1, "tmpfile");
+			for (i = 0; i < ht.ht_nent; i++)
+				hput(parts[hpart(ht.ht_ent[i].he_hash)],
+				    ht.ht_ent[i].he_line,
+				    ht.ht_ent[i].he_count);
+			hfree(&ht);
+			spilled = 1;
+		}
+	}
+	if (ferror(ifp))
+		err(1, "%s", ifn);
+	free(line);
+
+	if (!spilled) {
+		for (i = 0; i < ht.ht_nent; i++) {
+			repeats = ht.ht_ent[i].he_count - 1;
+			show(ofp, ht.ht_ent[i].he_line);
+		}
+		hfree(&ht);
+		return;
+	}
+	for (i = 0; i < HPARTS; i++) {
+		if (fflush(parts[i]) != 0 || fseeko(parts[i], 0, SEEK_SET) != 0)
+			err(1, "temporary file");
+		hcount(parts[i], "temporary file", 1, ofp, depth + 1);
+		(void)fclose(parts[i]);
+	}
+}
+
 static FILE *
 file(const char *name, const char *mode)
 {
@@ -371,6 +751,6 @@ static void
 usage(void)
 {
 	(void)fprintf(thread_stderr,
-"usage: uniq [-c | -d | -u] [-i] [-f fields] [-s chars] [input [output]]\n");
+"usage: uniq [-c | -d | -u] [-H] [-i] [-f fields] [-s chars] [input [output]]\n");
 	exit(1);
 }